@@ -0,0 +1,357 @@
+"""Local stand-in for the Particle Cloud event stream and device API.
+
+Serves GET /v1/events and /v1/devices/<id>/events as a chunked Server-Sent
+Events stream of synthetic devices, shaped like the firmware's default build
+(readings inside "env" envelopes, see src/EventEnvelope.h). Point the bridge
+at it with PARTICLE_API=http://localhost:8080 to run it without a Particle
+account, or use it from tools/bridge-bench.py.
+
+The device API (GET /v1/devices, GET /v1/devices/<id>/<variable>, POST
+/v1/devices/<id>/<function>) serves the firmware's configuration functions
+and variables with its validation, for bridge/fleet-config.py. Devices in
+the --profiles fraction read with a stored temperature profile until a
+timing function suspends it, as the firmware does. Calls take
+--call-latency, devices in the --offline fraction time out, --call-fail of
+calls time out at random and more than --api-rate requests per second get
+429, as the real API does under load.
+
+Usage:
+  python bridge/cloud-standin.py [--port 8080] [--devices 100] [--rate 0.1]
+  python bridge/cloud-standin.py --events 100000    # as fast as possible, then close
+  python bridge/cloud-standin.py --stall-after 60   # every connection goes silent after 60 s
+  python bridge/cloud-standin.py --mute-after 60    # ... or sends only keep-alives after 60 s
+  python bridge/cloud-standin.py --devices 500 --offline 0.02 --call-fail 0.05 --profiles 0.3
+
+--rate is events per second per device (the firmware publishes a reading
+every 5 minutes or on a 0.5 C change, i.e. well below 0.1). Between events a
+keep-alive comment is sent every KEEPALIVE_SECONDS.
+"""
+import argparse
+import json
+import random
+import re
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs
+
+CHUNK_BYTES = 16384  # Events per chunk when streaming as fast as possible
+KEEPALIVE_SECONDS = 9
+
+# Timing of a stored temperature profile (a typical DOE result)
+PROFILE_TIMING = (1600, 240, 115, 46)
+
+# Cloud functions that set configuration: variable they change, firmware range
+TIMING_FUNCTIONS = {
+    'setStartSig': ('startSignal', 800, 2000),      # doeConfig limits in the firmware
+    'setRespTO': ('responseTimeout', 150, 300),
+    'setBitTO': ('bitTimeout', 80, 150),
+    'setBitThr': ('bitThreshold', 40, 60),
+}
+
+
+def device_ids(count, seed=1):
+    rng = random.Random(seed)
+    return ['e00fce68' + ''.join(rng.choice('0123456789abcdef') for _ in range(16)) for _ in range(count)]
+
+
+def reading_json(device, temperature, humidity, timestamp):
+    """Firmware createJsonPayload() layout"""
+    return ('{"measurement":"environment","tags":{"location":"default","device":"%s"},'
+            '"fields":{"temperature":%.2f,"humidity":%.2f,"latency":10.0},"timestamp":%d}'
+            % (device, temperature, humidity, timestamp))
+
+
+def sse_message(event_name, data, device, published):
+    wrapper = json.dumps({'data': data, 'ttl': 60,
+                          'published_at': time.strftime('%Y-%m-%dT%H:%M:%S.000Z', time.gmtime(published)),
+                          'coreid': device})
+    return f'event: {event_name}\ndata: {wrapper}\n\n'
+
+
+def to_int(text):
+    """Wiring String::toInt(): leading integer, 0 if there is none"""
+    match = re.match(r'\s*[-+]?\d+', text)
+    return int(match.group()) if match else 0
+
+
+class FleetModel:
+    """Synthetic devices: slow temperature/humidity random walk, one envelope per event"""
+
+    def __init__(self, devices, seed=1, offline=0.0, profiles=0.0):
+        self.devices = device_ids(devices, seed)
+        self.rng = random.Random(seed)
+        self.state = {d: [21.0 + self.rng.uniform(-3, 3), 45.0 + self.rng.uniform(-10, 10), 0]
+                      for d in self.devices}
+        # Firmware defaults (SimpleDHT22::resetTimingDefaults(), publishInterval, shortMsgEnabled)
+        self.config = {d: {'startSignal': 1100, 'responseTimeout': 200, 'bitTimeout': 100,
+                           'bitThreshold': 50, 'publishSec': 300, 'shortMsg': True,
+                           'profile': None, 'override': False}
+                       for d in self.devices}
+        self.offline = set(d for d in self.devices if self.rng.random() < offline)
+        # A stored profile for the device's temperature applies instead of the base timing
+        for d in self.devices:
+            if self.rng.random() < profiles:
+                self.config[d]['profile'] = PROFILE_TIMING
+        self.lock = threading.Lock()
+
+    def call(self, device, function, arg):
+        """Cloud function return value as the firmware computes it, None if not registered"""
+        config = self.config[device]
+        value = to_int(arg)
+        with self.lock:
+            if function in TIMING_FUNCTIONS:
+                key, low, high = TIMING_FUNCTIONS[function]
+                if value < low or value > high:
+                    return -1
+                config[key] = value
+                config['override'] = True  # Manual timing suspends the profiles
+                return value
+            if function == 'setInterval':
+                if value < 30 or value > 3600:
+                    return -1
+                config['publishSec'] = value
+                return value
+            if function == 'enableShort':
+                config['shortMsg'] = not arg or value != 0
+                return int(config['shortMsg'])
+        return None
+
+    def variable(self, device, name):
+        """Cloud variable value, None if not registered"""
+        config = self.config[device]
+        if name == 'timing':
+            return '%d,%d,%d,%d' % (config['startSignal'], config['responseTimeout'],
+                                    config['bitTimeout'], config['bitThreshold'])
+        if name == 'appliedTiming':
+            if config['profile'] and not config['override']:
+                bucket = int((self.state[device][0] + 40) // 10) * 10 - 40
+                return '%d,%d,%d,%d,%dC' % (config['profile'] + (bucket,))
+            return '%d,%d,%d,%d,%s' % (config['startSignal'], config['responseTimeout'], config['bitTimeout'],
+                                       config['bitThreshold'], 'manual' if config['override'] else 'base')
+        if name in ('publishSec', 'shortMsg'):
+            return config[name]
+        if name == 'temperature':
+            return round(self.state[device][0], 1)
+        if name == 'humidity':
+            return round(self.state[device][1], 1)
+        return None
+
+    def event(self, device, now):
+        state = self.state[device]
+        state[0] += self.rng.uniform(-0.1, 0.1)
+        state[1] += self.rng.uniform(-0.3, 0.3)
+        state[2] += 1
+        envelope = f'1 {state[2]}\nsensor/reading\t' + reading_json(device, state[0], state[1], int(now))
+        return sse_message('env', envelope, device, now)
+
+    def burst(self, count, start=1700000000):
+        """count events round-robin over the fleet, pre-rendered"""
+        return [self.event(self.devices[i % len(self.devices)], start + i // len(self.devices))
+                for i in range(count)]
+
+
+class StreamHandler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def write_chunk(self, text):
+        data = text.encode()
+        self.wfile.write(b'%x\r\n%s\r\n' % (len(data), data))
+        self.wfile.flush()
+
+    def send_json(self, status, body, headers=()):
+        data = json.dumps(body).encode()
+        self.send_response(status)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(data)))
+        for name, value in headers:
+            self.send_header(name, value)
+        self.end_headers()
+        self.wfile.write(data)
+
+    def device_api(self, parts, arg=None):
+        """GET /v1/devices[/<id>/<variable>], POST /v1/devices/<id>/<function>"""
+        server = self.server
+        if not server.admit():
+            self.send_json(429, {'error': 'Too many requests'}, [('Retry-After', '1')])
+            return
+        fleet = server.fleet
+        if len(parts) == 2:
+            self.send_json(200, [{'id': d, 'name': f'monitor-{i}', 'online': d not in fleet.offline,
+                                  'connected': d not in fleet.offline}
+                                 for i, d in enumerate(fleet.devices)])
+            return
+        device, name = parts[2], parts[3]
+        if device not in fleet.config:
+            self.send_json(404, {'ok': False, 'error': 'Permission denied'})
+            return
+
+        # A round trip to the device; offline devices and unlucky calls time out
+        time.sleep(server.call_latency)
+        if device in fleet.offline or server.rng.random() < server.call_fail:
+            self.send_json(408, {'ok': False, 'error': 'Timed out.'})
+            return
+        if arg is None:
+            value = fleet.variable(device, name)
+            if value is None:
+                self.send_json(404, {'ok': False, 'error': 'Variable not found'})
+            else:
+                self.send_json(200, {'name': name, 'result': value,
+                                     'coreInfo': {'deviceID': device, 'connected': True}})
+        else:
+            value = fleet.call(device, name, arg)
+            if value is None:
+                self.send_json(404, {'ok': False, 'error': 'Function not found'})
+            else:
+                self.send_json(200, {'id': device, 'name': name, 'connected': True, 'return_value': value})
+
+    def do_POST(self):
+        parts = self.path.split('?', 1)[0].strip('/').split('/')
+        body = self.rfile.read(int(self.headers.get('Content-Length', 0))).decode()
+        if len(parts) != 4 or parts[:2] != ['v1', 'devices']:
+            self.send_error(404)
+            return
+        form = parse_qs(body)
+        if self.headers.get('Content-Type', '').startswith('application/json'):
+            form = {key: [str(value)] for key, value in json.loads(body or '{}').items()}
+        self.device_api(parts, form.get('arg', [''])[0])
+
+    def do_GET(self):
+        path = self.path.split('?', 1)[0]
+        parts = path.strip('/').split('/')
+        if parts == ['v1', 'devices'] or (len(parts) == 4 and parts[:2] == ['v1', 'devices']
+                                          and parts[3] != 'events'):
+            self.device_api(parts)
+            return
+        if parts[:2] != ['v1', 'events'] and not (len(parts) == 4 and parts[:2] == ['v1', 'devices']
+                                                   and parts[3] == 'events'):
+            self.send_error(404)
+            return
+        only = parts[2] if parts[1] == 'devices' else None
+
+        self.send_response(200)
+        self.send_header('Content-Type', 'text/event-stream')
+        self.send_header('Transfer-Encoding', 'chunked')
+        self.end_headers()
+        try:
+            self.write_chunk(':ok\n\n')
+            self.server.stream(self, only)
+            self.wfile.write(b'0\r\n\r\n')
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+
+
+class CloudStandIn(ThreadingHTTPServer):
+    """SSE server; with events set, every connection gets that burst and is then closed"""
+
+    daemon_threads = True
+
+    def __init__(self, port=8080, devices=100, rate=0.1, events=None, seed=1,
+                 stall_after=None, mute_after=None, offline=0.0, call_latency=0.3, call_fail=0.0,
+                 api_rate=None, profiles=0.0):
+        super().__init__(('127.0.0.1', port), StreamHandler)
+        self.fleet = FleetModel(devices, seed, offline, profiles)
+        self.rate = rate
+        self.burst = self.fleet.burst(events) if events else None
+        self.stall_after = stall_after  # Seconds until a connection stops sending anything
+        self.mute_after = mute_after  # Seconds until a connection sends only keep-alives
+        self.call_latency = call_latency  # Seconds per function call or variable read
+        self.call_fail = call_fail  # Fraction of calls that time out
+        self.api_rate = api_rate  # Device API requests per second before 429, None = no limit
+        self.rng = random.Random(seed)
+        self.tokens = api_rate or 0.0
+        self.refilled = time.time()
+        self.api_lock = threading.Lock()
+
+    def admit(self):
+        """Token bucket for the device API, one second of burst"""
+        if not self.api_rate:
+            return True
+        with self.api_lock:
+            now = time.time()
+            self.tokens = min(self.api_rate, self.tokens + (now - self.refilled) * self.api_rate)
+            self.refilled = now
+            if self.tokens < 1:
+                return False
+            self.tokens -= 1
+            return True
+
+    @property
+    def url(self):
+        return f'http://127.0.0.1:{self.server_address[1]}'
+
+    def stream(self, handler, only):
+        if self.burst is not None:
+            pending = []
+            size = 0
+            for message in self.burst:
+                if only and f'"coreid": "{only}"' not in message:
+                    continue
+                pending.append(message)
+                size += len(message)
+                if size >= CHUNK_BYTES:
+                    handler.write_chunk(''.join(pending))
+                    pending, size = [], 0
+            if pending:
+                handler.write_chunk(''.join(pending))
+            return
+
+        devices = [only] if only else self.fleet.devices
+        interval = 1.0 / (self.rate * len(devices))
+        opened = keepalive = next_event = time.time()
+        i = 0
+        while True:
+            now = time.time()
+            if self.stall_after is not None and now - opened > self.stall_after:
+                time.sleep(3600)  # Connection stays open, nothing more arrives
+                continue
+            if self.mute_after is not None and now - opened > self.mute_after:
+                next_event = float('inf')
+            if now >= next_event:
+                handler.write_chunk(self.fleet.event(devices[i % len(devices)], now))
+                keepalive = now
+                next_event += interval
+                i += 1
+            elif now - keepalive >= KEEPALIVE_SECONDS:
+                handler.write_chunk(':\n\n')
+                keepalive = now
+            time.sleep(max(0.0, min(next_event, keepalive + KEEPALIVE_SECONDS) - time.time()))
+
+    def start(self):
+        """Serve on a background thread (for benchmarks)"""
+        threading.Thread(target=self.serve_forever, daemon=True).start()
+        return self
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Local Particle Cloud event stream stand-in')
+    parser.add_argument('--port', type=int, default=8080)
+    parser.add_argument('--devices', type=int, default=100)
+    parser.add_argument('--rate', type=float, default=0.1, help='events per second per device')
+    parser.add_argument('--events', type=int, help='stream this many events at full speed, then close')
+    parser.add_argument('--stall-after', type=float, help='seconds until each connection goes silent')
+    parser.add_argument('--mute-after', type=float, help='seconds until each connection sends only keep-alives')
+    parser.add_argument('--offline', type=float, default=0.0, help='fraction of devices that are offline')
+    parser.add_argument('--call-latency', type=float, default=0.3, help='seconds per function call or variable read')
+    parser.add_argument('--call-fail', type=float, default=0.0, help='fraction of calls that time out')
+    parser.add_argument('--api-rate', type=float, help='device API requests per second before 429')
+    parser.add_argument('--profiles', type=float, default=0.0,
+                        help='fraction of devices reading with a stored temperature profile')
+    args = parser.parse_args()
+
+    server = CloudStandIn(args.port, args.devices, args.rate, args.events,
+                          stall_after=args.stall_after, mute_after=args.mute_after, offline=args.offline,
+                          call_latency=args.call_latency, call_fail=args.call_fail, api_rate=args.api_rate,
+                          profiles=args.profiles)
+    print(f"Particle Cloud stand-in on {server.url} ({args.devices} devices)")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
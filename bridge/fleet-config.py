@@ -0,0 +1,344 @@
+"""Apply a configuration plan to many devices through the Particle Cloud API.
+
+Sets timing and publishing parameters (setStartSig, setRespTO, setBitTO,
+setBitThr, setInterval, enableShort) on every device in the plan,
+concurrently and under a shared request rate limit. Each device's current
+values are read from its variables first, so only settings that differ are
+called and a rerun picks up where a previous one failed. Calls that time
+out or hit the rate limit are retried with jittered backoff; every device
+is then verified by reading its variables again. Timing is read from the
+appliedTiming variable (what the sensor reads with), not timing (the saved
+set), so a device whose temperature profile overrides the saved set is
+called and then checked on the timing it actually uses. One JSON line per
+device goes to the results file.
+
+Usage:
+  python fleet-config.py plan.json [--results fleet-config-results.jsonl]
+  python fleet-config.py --set setBitThr=48 --set setBitTO=110 --devices all
+  python fleet-config.py --doe '{"ss":1600,"rt":240,"bt":115,"bth":46}' --devices @devices.txt --canary 5
+
+Plan file:
+  {
+    "settings": {"setBitThr": 48, "setInterval": 600},
+    "devices": "all",                             (or a list of device ids)
+    "overrides": {"<device id>": {"setBitThr": 50}}
+  }
+A "doe_result" object (a doe/result event's data) may stand in for the
+timing settings. Offline devices are recorded as such and skipped.
+
+Uses PARTICLE_TOKEN and PARTICLE_API like the bridge; run it against
+cloud-standin.py (PARTICLE_API=http://localhost:8080) to try a rollout.
+"""
+import argparse
+import json
+import os
+import random
+import sys
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import requests
+
+PARTICLE_TOKEN = os.environ.get('PARTICLE_TOKEN')
+PARTICLE_API = os.environ.get('PARTICLE_API', 'https://api.particle.io')  # or a local cloud-standin.py
+CALL_TIMEOUT = 30    # Seconds; the cloud gives up on an unreachable device before this
+BACKOFF_BASE = 1     # Seconds, doubled per retry...
+BACKOFF_MAX = 30     # ...up to this
+
+# Function -> (variable that reflects it, field index in a comma list or None).
+# Called in this order, timing first.
+FUNCTIONS = {
+    'setStartSig': ('appliedTiming', 0),
+    'setRespTO': ('appliedTiming', 1),
+    'setBitTO': ('appliedTiming', 2),
+    'setBitThr': ('appliedTiming', 3),
+    'setInterval': ('publishSec', None),
+    'enableShort': ('shortMsg', None),
+}
+TIMING_FUNCTIONS = [f for f, (name, _) in FUNCTIONS.items() if name == 'appliedTiming']
+# doe/result event fields
+DOE_KEYS = {'ss': 'setStartSig', 'rt': 'setRespTO', 'bt': 'setBitTO', 'bth': 'setBitThr'}
+
+
+class RateLimiter:
+    """Token bucket shared by all workers (requests per second, one second of burst)"""
+
+    def __init__(self, rate):
+        self.rate = rate
+        self.tokens = rate
+        self.refilled = time.monotonic()
+        self.lock = threading.Lock()
+
+    def wait(self):
+        while True:
+            with self.lock:
+                now = time.monotonic()
+                self.tokens = min(self.rate, self.tokens + (now - self.refilled) * self.rate)
+                self.refilled = now
+                if self.tokens >= 1:
+                    self.tokens -= 1
+                    return
+                delay = (1 - self.tokens) / self.rate
+            time.sleep(delay)
+
+
+class ApiError(Exception):
+    def __init__(self, status, message, retry_after=None):
+        super().__init__(f'{status} {message}')
+        self.status = status
+        self.retry_after = retry_after
+
+    @property
+    def transient(self):
+        """Worth retrying: device or cloud timeout, rate limit, server error, network"""
+        return self.status in (None, 408, 429) or self.status >= 500
+
+
+def backoff(attempt):
+    """Jittered delay before retry N (1 = first retry)"""
+    return random.uniform(0, min(BACKOFF_MAX, BACKOFF_BASE * 2 ** attempt))
+
+
+class FleetClient:
+    """Particle device API with rate limiting and retries; one HTTP session per thread"""
+
+    def __init__(self, rate, retries):
+        self.limiter = RateLimiter(rate)
+        self.retries = retries
+        self.local = threading.local()
+        self.requests = 0
+        self.retried = 0
+        self.count_lock = threading.Lock()
+
+    def session(self):
+        if not hasattr(self.local, 'session'):
+            self.local.session = requests.Session()
+            self.local.session.headers['Authorization'] = f'Bearer {PARTICLE_TOKEN}'
+        return self.local.session
+
+    def request(self, method, path, data=None):
+        """JSON response of one request, retried while the failure is transient"""
+        attempt = 0
+        while True:
+            self.limiter.wait()
+            with self.count_lock:
+                self.requests += 1
+            try:
+                response = self.session().request(method, f'{PARTICLE_API}/v1/{path}', data=data,
+                                                  timeout=CALL_TIMEOUT)
+                if response.status_code == 200:
+                    return response.json()
+                try:
+                    message = response.json().get('error', response.reason)
+                except ValueError:
+                    message = response.reason
+                error = ApiError(response.status_code, message, response.headers.get('Retry-After'))
+            except requests.exceptions.RequestException as e:
+                error = ApiError(None, type(e).__name__)
+
+            attempt += 1
+            if not error.transient or attempt > self.retries:
+                raise error
+            with self.count_lock:
+                self.retried += 1
+            delay = backoff(attempt)
+            if error.retry_after:
+                delay = max(delay, float(error.retry_after))
+            time.sleep(delay)
+
+    def devices(self):
+        return self.request('GET', 'devices')
+
+    def variable(self, device, name):
+        return self.request('GET', f'devices/{device}/{name}')['result']
+
+    def call(self, device, function, arg):
+        return self.request('POST', f'devices/{device}/{function}', {'arg': str(arg)})['return_value']
+
+
+def expected_return(function, value):
+    return int(value != 0) if function == 'enableShort' else value
+
+
+def current_values(client, device, functions):
+    """Setting values as the device reports them, by function"""
+    variables = {}
+    values = {}
+    for function in functions:
+        name, field = FUNCTIONS[function]
+        if name not in variables:
+            variables[name] = client.variable(device, name)
+        value = variables[name]
+        if field is not None:
+            value = int(str(value).split(',')[field])
+        elif function == 'enableShort':
+            value = int(value in (True, 'true', 1))
+        values[function] = int(value)
+    return values
+
+
+def configure(client, device, settings, dry_run):
+    """Apply settings to one device; returns its result record"""
+    result = {'device': device, 'status': 'ok', 'changed': {}, 'unchanged': [], 'verified': False}
+    started = time.monotonic()
+    try:
+        before = current_values(client, device, settings)
+        needed = {f for f, value in settings.items() if before[f] != expected_return(f, value)}
+        if needed & set(TIMING_FUNCTIONS):
+            # A timing call moves the device off its temperature profile onto the
+            # saved set, so every timing setting in the plan has to be applied
+            needed |= set(TIMING_FUNCTIONS) & set(settings)
+        for function, value in settings.items():
+            if function not in needed:
+                result['unchanged'].append(function)
+                continue
+            result['changed'][function] = [before[function], value]
+            if dry_run:
+                continue
+            returned = client.call(device, function, value)
+            if returned != expected_return(function, value):
+                # The firmware returns -1 for a value outside its limits
+                raise ApiError('rejected', f'{function}({value}) returned {returned}')
+        if dry_run:
+            result['status'] = 'dry-run'
+        elif not result['changed']:
+            result['verified'] = True  # Already read back above
+        else:
+            after = current_values(client, device, settings)
+            wrong = {f: after[f] for f in settings if after[f] != expected_return(f, settings[f])}
+            result['verified'] = not wrong
+            if wrong:
+                result['status'] = 'mismatch'
+                result['error'] = f'reads back {wrong}'
+    except ApiError as e:
+        result['status'] = 'offline' if e.status == 408 else 'failed'
+        result['error'] = str(e)
+    result['seconds'] = round(time.monotonic() - started, 2)
+    return result
+
+
+def normalize(settings):
+    """Function name -> int, accepting doe/result keys; unknown names are an error"""
+    out = {}
+    for key, value in settings.items():
+        function = DOE_KEYS.get(key, key)
+        if function not in FUNCTIONS:
+            raise ValueError(f'unknown setting {key}')
+        out[function] = int(value)
+    return {f: out[f] for f in FUNCTIONS if f in out}
+
+
+def load_plan(args):
+    plan = {'settings': {}, 'devices': None, 'overrides': {}}
+    if args.plan:
+        with open(args.plan) as f:
+            plan.update(json.load(f))
+    settings = dict(plan['settings'])
+    if plan.get('doe_result'):
+        settings.update({k: v for k, v in plan['doe_result'].items() if k in DOE_KEYS})
+    if args.doe:
+        settings.update({k: v for k, v in json.loads(args.doe).items() if k in DOE_KEYS})
+    for item in args.set:
+        key, _, value = item.partition('=')
+        settings[key] = value
+
+    devices = args.devices or plan['devices'] or 'all'
+    if isinstance(devices, str) and devices.startswith('@'):
+        with open(devices[1:]) as f:
+            devices = [line.strip() for line in f if line.strip() and not line.startswith('#')]
+    elif isinstance(devices, str) and devices != 'all':
+        devices = devices.split(',')
+
+    overrides = {device: normalize(values) for device, values in plan['overrides'].items()}
+    return normalize(settings), devices, overrides
+
+
+def rollout(client, targets, executor, dry_run, results_file, summary):
+    """Configure (device, settings) pairs concurrently, logging each result as it lands"""
+    for future in [executor.submit(configure, client, device, settings, dry_run) for device, settings in targets]:
+        result = future.result()
+        results_file.write(json.dumps(result) + '\n')
+        results_file.flush()
+        summary[result['status']] = summary.get(result['status'], 0) + 1
+        if result['status'] not in ('ok', 'dry-run'):
+            print(f"  {result['device']}: {result['status']} {result.get('error', '')}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Apply a configuration plan to a device fleet')
+    parser.add_argument('plan', nargs='?', help='plan file (JSON)')
+    parser.add_argument('--set', action='append', default=[], metavar='FUNCTION=VALUE',
+                        help='setting to apply (repeatable), e.g. setBitThr=48')
+    parser.add_argument('--doe', help='doe/result event data whose ss/rt/bt/bth to apply')
+    parser.add_argument('--devices', help='"all", comma-separated ids or @file with one id per line')
+    parser.add_argument('--workers', type=int, default=32, help='devices configured at once')
+    parser.add_argument('--rate', type=float, default=20, help='API requests per second, all workers')
+    parser.add_argument('--retries', type=int, default=4, help='retries per request on timeout or 429')
+    parser.add_argument('--canary', type=int, default=0,
+                        help='configure this many devices first and stop unless all succeed')
+    parser.add_argument('--include-offline', action='store_true', help='also try devices listed as offline')
+    parser.add_argument('--dry-run', action='store_true', help='read current values, change nothing')
+    parser.add_argument('--results', default='fleet-config-results.jsonl', help='per-device results (appended)')
+    args = parser.parse_args()
+
+    if not PARTICLE_TOKEN:
+        print("ERROR: PARTICLE_TOKEN environment variable is required")
+        sys.exit(1)
+    try:
+        settings, devices, overrides = load_plan(args)
+    except (OSError, ValueError) as e:
+        print(f"ERROR: {e}")
+        sys.exit(1)
+    if not settings and not overrides:
+        print("ERROR: nothing to apply (use a plan file, --set or --doe)")
+        sys.exit(1)
+
+    client = FleetClient(args.rate, args.retries)
+    try:
+        listed = {d['id']: d for d in client.devices()}
+    except ApiError as e:
+        print(f"ERROR: cannot list devices: {e}")
+        sys.exit(1)
+    if devices == 'all':
+        devices = list(listed)
+    summary = {}
+    targets = []
+    skipped = []
+    for device in devices:
+        info = listed.get(device)
+        if info is None or (not info.get('online', info.get('connected')) and not args.include_offline):
+            status = 'offline' if info else 'unknown'
+            skipped.append({'device': device, 'status': status, 'changed': {}, 'unchanged': [],
+                            'verified': False})
+            summary[status] = summary.get(status, 0) + 1
+            continue
+        device_settings = dict(settings)
+        device_settings.update(overrides.get(device, {}))
+        targets.append((device, {f: device_settings[f] for f in FUNCTIONS if f in device_settings}))
+
+    print(f"{'Checking' if args.dry_run else 'Configuring'} {len(targets)} device(s): "
+          + ', '.join(f'{f}={v}' for f, v in settings.items()))
+    started = time.monotonic()
+    with open(args.results, 'a') as results_file, ThreadPoolExecutor(args.workers) as executor:
+        for result in skipped:
+            results_file.write(json.dumps(result) + '\n')
+
+        canary, rest = targets[:args.canary], targets[args.canary:]
+        if canary:
+            rollout(client, canary, executor, args.dry_run, results_file, summary)
+            if summary.get('ok', 0) + summary.get('dry-run', 0) < len(canary):
+                print(f"Canary failed, stopping before the remaining {len(rest)} device(s)")
+                rest = []
+            else:
+                print(f"Canary of {len(canary)} device(s) succeeded")
+        rollout(client, rest, executor, args.dry_run, results_file, summary)
+
+    elapsed = time.monotonic() - started
+    print(f"Done in {elapsed:.1f}s: " + ', '.join(f'{n} {s}' for s, n in sorted(summary.items()))
+          + f" ({client.requests} requests, {client.retried} retried); results in {args.results}")
+    sys.exit(0 if set(summary) <= {'ok', 'dry-run', 'offline'} else 2)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,237 @@
+"""Log raw DHT22 frames streamed over USB serial by the firmware's lab mode.
+
+Starts streaming (sends 'S'), validates each frame's CRC, appends the raw
+frames to a binary log and a per-frame CSV summary, and prints a running
+success rate. Stops streaming (sends 'X') on Ctrl+C.
+
+Usage: python lab-stream-reader.py <port> [--raw frames.bin] [--csv frames.csv]
+                                    [--corpus frames.dhtc] [--label bench-1]
+       python lab-stream-reader.py --import frames.bin --corpus frames.dhtc
+
+<port> may be a serial device (/dev/ttyACM0, COM3) or a pty; pyserial is
+used when installed, otherwise the port is opened as a plain file.
+
+--corpus also appends every frame to a memory-mappable frame corpus (one
+session per run) for the host tools, see tools/FrameCorpus.h; --import
+converts an existing raw log into a corpus session.
+"""
+import argparse
+import os
+import struct
+import sys
+import time
+
+SYNC = b'\xd2\x2d'
+# Must match LabStream.cpp
+HEADER = struct.Struct('<BBH')                   # version, type, payload length
+PAYLOAD = struct.Struct('<IIHHHHBBBB5sBhHHH')    # fixed 34-byte payload header
+MAX_PAYLOAD = PAYLOAD.size + 84 * 2                # DHT_FRAME_EDGES edges
+RESULTS = {0: 'ok', 1: 'timeout', 2: 'checksum', 3: 'range'}
+CSV_COLUMNS = ('seq,ms,start_signal,response_timeout,bit_timeout,bit_threshold,result,fail_step,'
+               'edge_count,min_margin,data,temperature,humidity,max_zero_high,min_one_high')
+
+# Frame corpus: 64-byte header and session table in the first 64 KB, then
+# fixed 208-byte records; must match tools/FrameCorpus.h
+CORPUS_MAGIC = b'DHTCORP\0'
+CORPUS_VERSION = 1
+CORPUS_HEADER = struct.Struct('<8sIIQQII24x')
+CORPUS_SESSION = struct.Struct('<QQqB7x32s')
+CORPUS_RECORD = struct.Struct('<84HIIHHHHBBBx5s3xIHHhH')
+CORPUS_RECORDS_OFFSET = 65536
+CORPUS_SESSION_CAPACITY = 1023
+CORPUS_EDGES = 84
+CORPUS_SOURCE_LAB = 0
+
+
+def crc16(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def parse_payload(payload):
+    (seq, ms, ss, rt, bt, bth, result, fail_step, edge_count, min_margin,
+     data, _reserved, temp10, hum10, max_zero, min_one) = PAYLOAD.unpack_from(payload)
+    edges = struct.unpack_from(f'<{edge_count}H', payload, PAYLOAD.size)
+    return {
+        'seq': seq, 'ms': ms, 'start_signal': ss, 'response_timeout': rt,
+        'bit_timeout': bt, 'bit_threshold': bth, 'result': result, 'fail_step': fail_step,
+        'edge_count': edge_count, 'min_margin': min_margin, 'data': data.hex(),
+        'temperature': temp10 / 10.0, 'humidity': hum10 / 10.0,
+        'max_zero_high': max_zero, 'min_one_high': min_one, 'edges': edges,
+    }
+
+
+def frames(read):
+    """Yield (raw_frame, payload) from a byte reader, resyncing on corruption"""
+    buf = b''
+    while True:
+        chunk = read(4096)
+        if not chunk:
+            if chunk is None:
+                continue
+            return
+        buf += chunk
+        while True:
+            start = buf.find(SYNC)
+            if start < 0:
+                buf = buf[-1:]
+                break
+            if len(buf) - start < 2 + HEADER.size:
+                buf = buf[start:]
+                break
+            version, ftype, length = HEADER.unpack_from(buf, start + 2)
+            if version != 1 or length > MAX_PAYLOAD:
+                buf = buf[start + 1:]  # False sync
+                continue
+            end = start + 2 + HEADER.size + length + 2
+            if len(buf) < end:
+                buf = buf[start:]
+                break
+            body = buf[start + 2:end - 2]
+            (crc,) = struct.unpack_from('<H', buf, end - 2)
+            if crc16(body) != crc:
+                buf = buf[start + 1:]  # Corrupt frame
+                continue
+            yield buf[start:end], buf[start + 2 + HEADER.size:end - 2]
+            buf = buf[end:]
+
+
+class FrameCorpus:
+    """Appends one capture session to a frame corpus"""
+
+    def __init__(self, path, label, source=CORPUS_SOURCE_LAB):
+        if os.path.exists(path):
+            self.file = open(path, 'r+b')
+            magic, version, size, count, _, sessions, _ = CORPUS_HEADER.unpack(
+                self.file.read(CORPUS_HEADER.size))
+            if magic != CORPUS_MAGIC or version != CORPUS_VERSION or size != CORPUS_RECORD.size:
+                raise ValueError(f'{path} is not a version {CORPUS_VERSION} frame corpus')
+            if sessions == CORPUS_SESSION_CAPACITY:
+                raise ValueError(f'{path}: session table full')
+        else:
+            self.file = open(path, 'w+b')
+            count = sessions = 0
+        self.session = sessions
+        self.first = self.count = count
+        self.label = label.encode()[:31]
+        self.source = source
+        self.started = int(time.time())
+        # Records past the header's count are a torn append; overwrite them
+        self.file.seek(CORPUS_RECORDS_OFFSET + count * CORPUS_RECORD.size)
+        self.commit()
+
+    def append(self, frame):
+        edges = list(frame['edges'][:CORPUS_EDGES])
+        edges += [0] * (CORPUS_EDGES - len(edges))
+        self.file.write(CORPUS_RECORD.pack(
+            *edges, frame['seq'], frame['ms'], frame['start_signal'], frame['response_timeout'],
+            frame['bit_timeout'], frame['bit_threshold'], frame['result'], frame['fail_step'],
+            frame['edge_count'], bytes.fromhex(frame['data']), self.session,
+            frame['max_zero_high'], frame['min_one_high'],
+            round(frame['temperature'] * 10), round(frame['humidity'] * 10)))
+        self.count += 1
+
+    def commit(self):
+        """Records first, then the session entry, then the header count"""
+        end = self.file.tell()
+        self.file.flush()
+        self.file.seek(CORPUS_HEADER.size + self.session * CORPUS_SESSION.size)
+        self.file.write(CORPUS_SESSION.pack(self.first, self.count - self.first, self.started,
+                                            self.source, self.label))
+        self.file.flush()
+        self.file.seek(0)
+        self.file.write(CORPUS_HEADER.pack(CORPUS_MAGIC, CORPUS_VERSION, CORPUS_RECORD.size, self.count,
+                                           CORPUS_RECORDS_OFFSET, self.session + 1, CORPUS_SESSION_CAPACITY))
+        self.file.flush()
+        self.file.seek(max(end, CORPUS_RECORDS_OFFSET))
+
+    def close(self):
+        self.commit()
+        self.file.close()
+
+
+def import_raw(raw_path, corpus_path, label):
+    """Convert a raw frame log into one corpus session"""
+    corpus = FrameCorpus(corpus_path, label or os.path.basename(raw_path))
+    with open(raw_path, 'rb') as raw:
+        for _, payload in frames(raw.read):
+            corpus.append(parse_payload(payload))
+    corpus.close()
+    print(f"{corpus.count - corpus.first} frames from {raw_path} appended to {corpus_path}")
+
+
+def open_port(port):
+    try:
+        import serial
+        ser = serial.Serial(port, 115200, timeout=0.5)
+        # A read timeout is not end-of-stream
+        return (lambda n: ser.read(n) or None), ser.write, ser.close
+    except ImportError:
+        fd = os.open(port, os.O_RDWR | getattr(os, 'O_NOCTTY', 0))
+        return (lambda n: os.read(fd, n)), (lambda b: os.write(fd, b)), (lambda: os.close(fd))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Log DHT22 lab stream frames')
+    parser.add_argument('port', nargs='?')
+    parser.add_argument('--raw', default='frames.bin', help='binary log of raw frames')
+    parser.add_argument('--csv', default='frames.csv', help='per-frame CSV summary')
+    parser.add_argument('--corpus', help='also append frames to this frame corpus')
+    parser.add_argument('--label', help='corpus session label (default: port or raw log name)')
+    parser.add_argument('--import', dest='import_raw', metavar='RAW', help='convert a raw log into --corpus')
+    args = parser.parse_args()
+
+    if args.import_raw:
+        if not args.corpus:
+            parser.error('--import needs --corpus')
+        import_raw(args.import_raw, args.corpus, args.label)
+        return
+    if not args.port:
+        parser.error('a port is required')
+
+    corpus = FrameCorpus(args.corpus, args.label or os.path.basename(args.port)) if args.corpus else None
+    read, write, close = open_port(args.port)
+    new_csv = not os.path.exists(args.csv)
+    raw_log = open(args.raw, 'ab')
+    csv_log = open(args.csv, 'a')
+    if new_csv:
+        csv_log.write(CSV_COLUMNS + '\n')
+
+    write(b'S')
+    total = ok = 0
+    started = time.time()
+    try:
+        for raw, payload in frames(read):
+            frame = parse_payload(payload)
+            raw_log.write(raw)
+            csv_log.write(','.join(str(frame[c]) for c in CSV_COLUMNS.split(',')) + '\n')
+            if corpus:
+                corpus.append(frame)
+            total += 1
+            ok += frame['result'] == 0
+            if total % 10 == 0:
+                raw_log.flush()
+                csv_log.flush()
+                if corpus:
+                    corpus.commit()
+            print(f"\r{total} frames, {ok} ok ({100.0 * ok / total:.1f}%), "
+                  f"last: {RESULTS.get(frame['result'], frame['result'])} "
+                  f"margin={frame['min_margin']}us, {time.time() - started:.0f}s", end='')
+    except KeyboardInterrupt:
+        pass
+    finally:
+        write(b'X')
+        close()
+        raw_log.close()
+        csv_log.close()
+        if corpus:
+            corpus.close()
+        print(f"\n{total} frames written to {args.raw} and {args.csv}", file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -1,8 +1,22 @@
 from influxdb_client import InfluxDBClient, Point
 from influxdb_client.client.write_api import SYNCHRONOUS
+from queue import Full
+import argparse
+import base64
+import bisect
+import datetime
+import gzip
+import hashlib
 import json
+import multiprocessing
 import os
+import random
+import re
+import shutil
+import struct
+import sys
 import time
+import traceback
 import requests
 
 # Get configuration from environment variables
@@ -13,30 +27,359 @@ INFLUX_URL = os.environ.get('INFLUX_URL', 'http://localhost:8086')
 INFLUX_TOKEN = os.environ.get('INFLUX_TOKEN')
 INFLUX_ORG = os.environ.get('INFLUX_ORG')
 INFLUX_BUCKET = os.environ.get('INFLUX_BUCKET')
-
-print(f"Starting Particle to InfluxDB Bridge")
-print(f"Device ID: {DEVICE_ID}")
-print(f"Event Name: {EVENT_NAME}")
-print(f"InfluxDB URL: {INFLUX_URL}")
-print(f"InfluxDB Org: {INFLUX_ORG}")
-print(f"InfluxDB Bucket: {INFLUX_BUCKET}")
-
-# Connect to InfluxDB
-influx_client = InfluxDBClient(
-    url=INFLUX_URL,
-    token=INFLUX_TOKEN,
-    org=INFLUX_ORG
-)
-write_api = influx_client.write_api(write_options=SYNCHRONOUS)
+PARTICLE_API = os.environ.get('PARTICLE_API', 'https://api.particle.io')  # or a local cloud-standin.py
+BRIDGE_WORKERS = int(os.environ.get('BRIDGE_WORKERS', '1'))  # Worker processes (raise for fleets)
+# Readings go straight to line protocol with one log line each; 0 = Point objects and full logging
+FAST_PATH = os.environ.get('BRIDGE_FAST_PATH', '1') != '0'
+ARCHIVE_DIR = os.environ.get('ARCHIVE_DIR', 'archive')  # Local event archive, empty = off
+LOG_EVENTS = True  # One log line per event (off while replaying)
+# Reconnect when not even a keep-alive arrived for this long
+STALL_SECONDS = float(os.environ.get('BRIDGE_STALL_SECONDS', '30'))
 
 # Particle Server-Sent Events (SSE) endpoint
 # Note: Particle API filters events by prefix, so "sensor" will match "sensor/reading"
 if DEVICE_ID:
     # Subscribe to specific device events
-    url = f'https://api.particle.io/v1/devices/{DEVICE_ID}/events?access_token={PARTICLE_TOKEN}'
+    url = f'{PARTICLE_API}/v1/devices/{DEVICE_ID}/events?access_token={PARTICLE_TOKEN}'
 else:
     # Subscribe to all devices
-    url = f'https://api.particle.io/v1/events?access_token={PARTICLE_TOKEN}'
+    url = f'{PARTICLE_API}/v1/events?access_token={PARTICLE_TOKEN}'
+
+write_api = None  # Set in each worker process by connect_influx()
+
+
+def connect_influx():
+    """Connect this process to InfluxDB (clients cannot be shared across processes)"""
+    global write_api
+    influx_client = InfluxDBClient(
+        url=INFLUX_URL,
+        token=INFLUX_TOKEN,
+        org=INFLUX_ORG
+    )
+    write_api = influx_client.write_api(write_options=SYNCHRONOUS)
+
+# Multiplexed event envelope (src/EventEnvelope.h): header "<version> <seq>",
+# then one "<event name>\t<event data>" line per message
+ENVELOPE_EVENT = 'env'
+ENVELOPE_HEADER = re.compile(r'^(\d+) (\d+)$')
+envelope_seq = {}  # device id -> last envelope sequence number seen
+
+
+def demux_envelope(event_data, device=None):
+    """Split an envelope into (event name, event data) pairs, None if not an envelope"""
+    lines = event_data.split('\n')
+    header = ENVELOPE_HEADER.match(lines[0])
+    if not header:
+        return None
+    if header.group(1) != '1':
+        print(f"  Unsupported envelope version {header.group(1)}, skipped")
+        return []
+
+    # Sequence restarts at 1 on every boot; a gap means envelopes were lost
+    seq = int(header.group(2))
+    last = envelope_seq.get(device)
+    if last is not None and seq > last + 1 and LOG_EVENTS:
+        print(f"  Envelope gap: {seq - last - 1} envelope(s) missing before #{seq}")
+    envelope_seq[device] = seq
+
+    messages = []
+    for line in lines[1:]:
+        name, sep, data = line.partition('\t')
+        if sep:
+            messages.append((name, data))
+    return messages
+
+
+# Burst capture blocks (src/CaptureStore.h): base64 of an 8-byte header
+# (time uint32, temperature x10 int16, humidity x10 uint16), then per sample
+# varint seconds since the previous one and zigzag varint deltas (x10)
+CAPTURE_EVENT = 'sensor/capture'
+
+
+def read_varint(raw, pos):
+    value = shift = 0
+    while True:
+        byte = raw[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def decode_capture(block):
+    """Decode one capture block into (unix time, temperature, humidity) tuples"""
+    raw = base64.b64decode(block)
+    t, temp, hum = struct.unpack_from('<IhH', raw)
+    samples = [(t, temp / 10, hum / 10)]
+    pos = 8
+    while pos < len(raw):
+        dt, pos = read_varint(raw, pos)
+        dtemp, pos = read_varint(raw, pos)
+        dhum, pos = read_varint(raw, pos)
+        t += dt
+        temp += (dtemp >> 1) ^ -(dtemp & 1)
+        hum += (dhum >> 1) ^ -(dhum & 1)
+        samples.append((t, temp / 10, hum / 10))
+    return samples
+
+
+def process_capture(event_data, device=None):
+    """Write one sensor/capture block to InfluxDB (measurement "capture")"""
+    timestamp = time.strftime('%Y-%m-%d %H:%M:%S')
+    try:
+        data = json.loads(event_data)
+        if not isinstance(data, dict):
+            raise TypeError(f'expected an object, got {type(data).__name__}')
+        samples = decode_capture(data['d'])
+        if len(samples) != data['n']:
+            print(f"  Capture block decoded {len(samples)} samples, expected {data['n']}")
+        if FAST_PATH:
+            prefix = tag_prefix('capture', capture=str(data['id']), device=device or 'unknown')
+            pending_lines.extend(f'{prefix}temperature={temperature},humidity={humidity} {t}000000000'
+                                 for t, temperature, humidity in samples)
+        else:
+            points = [Point('capture')
+                      .tag('device', device or 'unknown')
+                      .tag('capture', str(data['id']))
+                      .field('temperature', temperature)
+                      .field('humidity', humidity)
+                      .time(t * 1_000_000_000)
+                      for t, temperature, humidity in samples]
+            write_api.write(bucket=INFLUX_BUCKET, record=points)
+        if LOG_EVENTS:
+            print(f"[{timestamp}] ✓ Capture {data['id']} part {data['part']}/{data['parts']}: "
+                  f"{len(samples)} samples")
+    except (json.JSONDecodeError, KeyError, TypeError, ValueError, IndexError, struct.error) as e:
+        print(f"[{timestamp}] Bad capture block: {e}")
+
+
+# Line protocol fast path: readings are rendered straight into line protocol
+# and written once per worker batch; tags are escaped once per device
+READING_LAYOUT = re.compile(  # Firmware createJsonPayload(), matched without decoding
+    r'\{"measurement":"([^"\\]+)","tags":\{"location":"([^"\\]*)","device":"([^"\\]*)"\},'
+    r'"fields":\{"temperature":(-?\d+(?:\.\d+)?),"humidity":(-?\d+(?:\.\d+)?)(?:,"latency":(-?\d+(?:\.\d+)?))?\},'
+    r'"timestamp":(\d+)\}$')
+LINE_ESCAPES = str.maketrans({',': '\\,', ' ': '\\ ', '=': '\\='})
+prefix_cache = {}
+pending_lines = []  # Line protocol waiting for flush_lines()
+
+
+def tag_prefix(measurement, **tags):
+    """Escaped "measurement,tag=value,... " (tags sorted, as the InfluxDB client does)"""
+    key = (measurement,) + tuple(sorted(tags.items()))
+    prefix = prefix_cache.get(key)
+    if prefix is None:
+        prefix = measurement.replace(',', '\\,').replace(' ', '\\ ')
+        prefix += ''.join(f',{k.translate(LINE_ESCAPES)}={str(v).translate(LINE_ESCAPES)}'
+                          for k, v in key[1:])
+        prefix = prefix_cache[key] = prefix + ' '
+    return prefix
+
+
+def reading_line(event_data):
+    """Line protocol for a reading, or None if the payload is not a known shape"""
+    match = READING_LAYOUT.match(event_data)
+    if match:
+        measurement, location, device, temperature, humidity, latency, seconds = match.groups()
+    else:
+        try:
+            data = json.loads(event_data)
+            measurement = data['measurement']
+            location, device = data['tags']['location'], data['tags']['device']
+            temperature = float(data['fields']['temperature'])
+            humidity = float(data['fields']['humidity'])
+            latency = data['fields'].get('latency')
+            latency = None if latency is None else float(latency)
+            seconds = int(data['timestamp'])
+        except (json.JSONDecodeError, TypeError, KeyError, ValueError, AttributeError):
+            return None
+    prefix = tag_prefix(measurement, device=device, location=location)
+    if LOG_EVENTS:
+        print(f"[{time.strftime('%Y-%m-%d %H:%M:%S')}] ✓ {device}: {temperature}°C, {humidity}%")
+    fields = f'temperature={temperature},humidity={humidity}'
+    if latency is not None:
+        fields += f',latency={latency}'
+    return f'{prefix}{fields} {seconds}000000000'
+
+
+def flush_lines():
+    """Write the pending line protocol in one request"""
+    if not pending_lines:
+        return
+    try:
+        write_api.write(bucket=INFLUX_BUCKET, record='\n'.join(pending_lines).encode())
+    except Exception as e:
+        timestamp = time.strftime('%Y-%m-%d %H:%M:%S')
+        print(f"[{timestamp}] Error writing {len(pending_lines)} point(s): {e}")
+    pending_lines.clear()
+
+
+# Typed DOE and diagnostic events (src/DOE.*, RemoteTempHumidityMonitor.ino),
+# batched as line protocol in their own measurements:
+#   doe_result     one point per tested configuration
+#   doe_phase      one point per phase summary
+#   doe_config     one point per row of a reassembled doe/phase_data table
+#   system_uptime  uptime, free memory and cloud state
+#   sensor_error   one point per failed read
+UPTIME_FORMAT = re.compile(
+    r' up (?:(\d+) days?, )?(?:(\d+):(\d+)|(\d+) min), cloud: (\w+), free mem: (\d+) bytes')
+# Chunks are cut every 560 characters of the escaped CSV, so a chunk can end
+# inside an escape; the data is matched raw and unescaped once reassembled
+PHASE_DATA_LAYOUT = re.compile(r'\{"param":"([^"\\]*)","chunk":(\d+),"total":(\d+),"data":"(.*)"\}$', re.S)
+OFAT_COLUMNS = ('value', 'success', 'fail', 'success_rate', 'fail_rate')
+FACTORIAL_COLUMNS = ('ss', 'rt', 'bt', 'bth', 'success', 'fail', 'success_rate', 'fail_rate')
+PHASE_DATA_TIMEOUT = 600  # Seconds before an incomplete doe/phase_data set is dropped
+phase_chunks = {}  # (device, param) -> [total, time ns, {chunk index: raw text}, received]
+
+
+def event_time(published):
+    """Nanosecond timestamp from the wrapper's published_at, receive time if missing"""
+    try:
+        moment = datetime.datetime.strptime(published[:23], '%Y-%m-%dT%H:%M:%S.%f')
+    except (TypeError, ValueError):
+        return int(time.time() * 1000) * 1_000_000
+    seconds = moment.replace(tzinfo=datetime.timezone.utc).timestamp()
+    return int(round(seconds * 1000)) * 1_000_000
+
+
+def field_set(fields):
+    """Line protocol field set; ints, floats, bools and strings keep their type"""
+    parts = []
+    for key, value in fields.items():
+        if isinstance(value, bool):
+            text = 'true' if value else 'false'
+        elif isinstance(value, int):
+            text = f'{value}i'
+        elif isinstance(value, float):
+            text = repr(value)
+        else:
+            text = '"' + str(value).replace('\\', '\\\\').replace('"', '\\"') + '"'
+        parts.append(f'{key.translate(LINE_ESCAPES)}={text}')
+    return ','.join(parts)
+
+
+def typed_line(measurement, fields, ns, **tags):
+    pending_lines.append(f'{tag_prefix(measurement, **tags)}{field_set(fields)} {ns}')
+
+
+def process_doe_result(event_data, device, published):
+    data = json.loads(event_data)
+    config = f"{data['ss']}/{data['rt']}/{data['bt']}/{data['bth']}"
+    fields = {key: int(data[key]) for key in ('ss', 'rt', 'bt', 'bth', 'success', 'fail')}
+    fields['rate'] = float(data['rate'])
+    fields['best'] = bool(data['best'])
+    typed_line('doe_result', fields, event_time(published), config=config, device=device)
+    return f"config {config}: {fields['rate']}% success"
+
+
+def process_doe_phase(event_data, device, published):
+    data = json.loads(event_data)
+    fields = {'count': int(data['count']), 'blocks': int(data.get('blocks', 0))}
+    for key in ('avg_fail', 'best_fail', 'worst_fail', 'std_dev', 'cv',
+                'z_score', 'p_value', 'block_sd', 'f_stat'):
+        if key in data:
+            fields[key] = float(data[key])
+    # OFAT phases name a value, the full factorial phase a configuration
+    if isinstance(data['best_value'], str):
+        fields['best_config'] = data['best_value']
+    else:
+        fields['best_value'] = int(data['best_value'])
+    typed_line('doe_phase', fields, event_time(published), device=device, param=data['param'])
+    return f"phase {data['param']}: best {data['best_value']}"
+
+
+def process_doe_phase_data(event_data, device, published):
+    match = PHASE_DATA_LAYOUT.match(event_data)
+    if not match:
+        raise ValueError('unknown doe/phase_data layout')
+    param, chunk, total, text = match.group(1), int(match.group(2)), int(match.group(3)), match.group(4)
+
+    # Chunk 1 (or a new total) starts a fresh table; stale partial tables are dropped
+    now = time.time()
+    for key in [k for k, v in phase_chunks.items() if now - v[3] > PHASE_DATA_TIMEOUT]:
+        del phase_chunks[key]
+    key = (device, param)
+    table = phase_chunks.get(key)
+    if table is None or chunk == 1 or table[0] != total:
+        table = phase_chunks[key] = [total, event_time(published), {}, now]
+    table[2][chunk] = text
+    if len(table[2]) < total:
+        return f"phase data {param}: chunk {chunk}/{total}"
+    del phase_chunks[key]
+
+    csv = json.loads('"' + ''.join(table[2][i] for i in sorted(table[2])) + '"')
+    rows = [line.split(',') for line in csv.split('\n') if line]
+    columns = FACTORIAL_COLUMNS if param == 'full_factorial' else OFAT_COLUMNS
+    settings = len(columns) - 4
+    for row in rows:
+        fields = {name: int(value) for name, value in zip(columns[:-2], row[:-2])}
+        fields.update({name: float(value) for name, value in zip(columns[-2:], row[-2:])})
+        typed_line('doe_config', fields, table[1], config='/'.join(row[:settings]),
+                   device=device, param=param)
+    return f"phase data {param}: {len(rows)} rows"
+
+
+def process_uptime(event_data, device, published):
+    match = UPTIME_FORMAT.search(event_data)
+    if not match:
+        raise ValueError('unknown system/uptime layout')
+    days, hours, minutes, only_minutes, cloud, free_mem = match.groups()
+    uptime = int(days or 0) * 86400 + int(hours or 0) * 3600 + int(minutes or only_minutes) * 60
+    fields = {'uptime': uptime, 'free_mem': int(free_mem), 'cloud': cloud == 'connected'}
+    typed_line('system_uptime', fields, event_time(published), device=device)
+    return f"up {uptime} s, {free_mem} bytes free"
+
+
+def process_sensor_error(event_data, device, published):
+    typed_line('sensor_error', {'count': 1, 'message': event_data}, event_time(published), device=device)
+    return event_data
+
+
+TYPED_EVENTS = {
+    'doe/result': process_doe_result,
+    'doe/phase_summary': process_doe_phase,
+    'doe/phase_data': process_doe_phase_data,
+    'system/uptime': process_uptime,
+    'sensor/error': process_sensor_error,
+}
+
+
+def dispatch(name, event_data, device=None, published=None):
+    """Route one logical event; readings, captures and typed events are written to InfluxDB"""
+    timestamp = time.strftime('%Y-%m-%d %H:%M:%S')
+    if name == CAPTURE_EVENT:
+        process_capture(event_data, device)
+        return
+    handler = TYPED_EVENTS.get(name)
+    if handler:
+        try:
+            summary = handler(event_data, device or 'unknown', published)
+            if LOG_EVENTS:
+                print(f"[{timestamp}] ✓ {name}: {summary}")
+        except (json.JSONDecodeError, KeyError, TypeError, ValueError) as e:
+            print(f"[{timestamp}] Bad {name} event: {e}")
+        return
+    if FAST_PATH:
+        line = reading_line(event_data)
+        if line:
+            pending_lines.append(line)
+            return
+    elif name == 'sensor/reading':
+        process_event(event_data)
+        return
+    else:
+        try:
+            sensor_data = json.loads(event_data)
+            if isinstance(sensor_data, dict) and 'measurement' in sensor_data and 'fields' in sensor_data:
+                print(f"[{timestamp}] Valid sensor reading found!")
+                process_event(event_data)
+                return
+        except (json.JSONDecodeError, TypeError):
+            pass
+    if LOG_EVENTS:
+        print(f"[{timestamp}] {name or 'event'}: {event_data[:100]}")
+
 
 def process_event(event_data):
     """Process a single event and write to InfluxDB"""
@@ -60,6 +403,8 @@ def process_event(event_data):
             .field('temperature', float(data['fields']['temperature'])) \
             .field('humidity', float(data['fields']['humidity'])) \
             .time(timestamp_ns)
+        if 'latency' in data['fields']:
+            point.field('latency', float(data['fields']['latency']))
 
         print(f"  Writing to bucket: {INFLUX_BUCKET}")
         print(f"  Point: {point.to_line_protocol()}")
@@ -78,100 +423,478 @@ def process_event(event_data):
         import traceback
         traceback.print_exc()
 
+def handle_message(event_name, event_data):
+    """Decode one SSE message (Particle wrapper JSON) and dispatch its event(s)"""
+    timestamp = time.strftime('%Y-%m-%d %H:%M:%S')
+    try:
+        # Parse the Particle event wrapper JSON
+        wrapper = json.loads(event_data)
+
+        # The wrapper doesn't have a 'name' field; envelopes are
+        # recognized by their header, readings by their JSON structure
+        if 'data' in wrapper and wrapper['data'] is not None:
+            if not FAST_PATH:
+                print(f"[{timestamp}] Event received, data: {wrapper['data'][:100]}...")
+
+            messages = None
+            if event_name in (None, ENVELOPE_EVENT):
+                messages = demux_envelope(wrapper['data'], wrapper.get('coreid'))
+            if messages is not None:
+                if not FAST_PATH:
+                    print(f"[{timestamp}] Envelope with {len(messages)} message(s)")
+                for name, data in messages:
+                    dispatch(name, data, wrapper.get('coreid'), wrapper.get('published_at'))
+            else:
+                dispatch(event_name, wrapper['data'], wrapper.get('coreid'), wrapper.get('published_at'))
+        else:
+            print(f"[{timestamp}] Event has no data field")
+
+    except json.JSONDecodeError as e:
+        print(f"[{timestamp}] Failed to parse event wrapper: {e}")
+
+
+class SseFramer:
+    """Split a text stream into SSE messages: (event name, first data line) pairs"""
+
+    def __init__(self):
+        self.buffer = ''
+        self.event_name = None
+        self.data = None
+
+    def feed(self, chunk):
+        """Add received text, return the messages it completed"""
+        lines = (self.buffer + chunk).split('\n')
+        self.buffer = lines.pop()  # Keep incomplete line in buffer
+        messages = []
+        for line in lines:
+            line = line.rstrip('\r')
+            if not line:
+                # SSE messages are separated by blank lines
+                if self.data:
+                    messages.append((self.event_name, self.data))
+                self.event_name = self.data = None
+            elif line.startswith('event: '):
+                self.event_name = line[7:]
+            elif line.startswith('data: ') and self.data is None:
+                self.data = line[6:]
+        return messages
+
+
+def _ring_hash(key):
+    return int.from_bytes(hashlib.md5(key.encode()).digest()[:8], 'big')
+
+
+class HashRing:
+    """Consistent hash of device IDs onto worker shards
+
+    Virtual nodes spread devices evenly; changing the worker count moves only
+    about 1/N of the devices to another worker.
+    """
+
+    def __init__(self, shards, replicas=160):
+        ring = sorted((_ring_hash(f'{shard}:{r}'), shard)
+                      for shard in range(shards) for r in range(replicas))
+        self.keys = [h for h, _ in ring]
+        self.shards = [shard for _, shard in ring]
+        self.cache = {}
+
+    def shard(self, key):
+        shard = self.cache.get(key)
+        if shard is None:
+            i = bisect.bisect(self.keys, _ring_hash(key)) % len(self.keys)
+            shard = self.cache[key] = self.shards[i]
+        return shard
+
+
+# Device ID from the raw wrapper JSON, without decoding it in the reader
+DEVICE_ID_FIELD = re.compile(r'"coreid"\s*:\s*"([^"]*)"')
+
+
+# Event archive: every received SSE message, appended by each worker to an
+# hourly segment "<YYYYMMDDHH>-w<worker>.seg" (UTC), gzipped once the hour is over.
+# Record: received time (float64), event name length (uint16), data length (uint32),
+# then the event name and the Particle wrapper JSON (UTF-8)
+ARCHIVE_RECORD = struct.Struct('<dHI')
+REPLAY_BATCH = 5000  # Points per InfluxDB write during replay
+
+
+class EventArchive:
+    """Append-only hourly segments of the messages one worker received"""
+
+    def __init__(self, directory, worker):
+        self.directory = directory
+        self.suffix = f'-w{worker}.seg'
+        self.hour = None
+        self.file = None
+        os.makedirs(directory, exist_ok=True)
+        self.compress_finished()  # Left over by a restart
+
+    def append(self, received, messages):
+        hour = time.strftime('%Y%m%d%H', time.gmtime(received))
+        if hour != self.hour:
+            self.rotate(hour)
+        records = []
+        for event_name, event_data in messages:
+            name = (event_name or '').encode()
+            data = event_data.encode()
+            records.append(ARCHIVE_RECORD.pack(received, len(name), len(data)) + name + data)
+        self.file.write(b''.join(records))
+        self.file.flush()
+
+    def rotate(self, hour):
+        if self.file:
+            self.file.close()
+        self.hour = hour
+        self.file = open(os.path.join(self.directory, hour + self.suffix), 'ab')
+        self.compress_finished()
+
+    def compress_finished(self):
+        """Gzip this worker's segments of past hours"""
+        for name in os.listdir(self.directory):
+            if name.endswith(self.suffix) and not name.startswith(self.hour or '-'):
+                path = os.path.join(self.directory, name)
+                with open(path, 'rb') as src, gzip.open(path + '.gz', 'ab') as dst:
+                    shutil.copyfileobj(src, dst)
+                os.remove(path)
+
+
+def read_segment(path, start, end):
+    """Yield archived (event name, data) messages received in [start, end)"""
+    opener = gzip.open if path.endswith('.gz') else open
+    with opener(path, 'rb') as f:
+        raw = f.read()
+    pos = 0
+    while pos + ARCHIVE_RECORD.size <= len(raw):
+        received, name_len, data_len = ARCHIVE_RECORD.unpack_from(raw, pos)
+        pos += ARCHIVE_RECORD.size
+        if pos + name_len + data_len > len(raw):
+            break  # Torn last record (bridge stopped mid-write)
+        if start <= received < end:
+            name = raw[pos:pos + name_len].decode() or None
+            yield name, raw[pos + name_len:pos + name_len + data_len].decode()
+        pos += name_len + data_len
+
+
+def handle_safely(event_name, event_data):
+    """handle_message() that logs instead of raising, so one bad event cannot stop a worker"""
+    try:
+        handle_message(event_name, event_data)
+    except Exception as e:
+        timestamp = time.strftime('%Y-%m-%d %H:%M:%S')
+        print(f"[{timestamp}] Error handling event {event_name or 'message'}: {e}")
+        traceback.print_exc()
+
+
+def worker_main(index, queue, setup):
+    """Worker process: decode, dispatch and write the messages of its devices in order"""
+    setup()
+    archive = EventArchive(ARCHIVE_DIR, index) if ARCHIVE_DIR else None
+    while True:
+        batch = queue.get()
+        if batch is None:
+            break
+        # Archived first: a failed InfluxDB write can be replayed later
+        if archive:
+            archive.append(time.time(), batch)
+        for event_name, event_data in batch:
+            handle_safely(event_name, event_data)
+        flush_lines()
+
+
+class ShardedDispatcher:
+    """Pool of worker processes, each owning the devices hashed to it
+
+    One reader feeds every worker through its own FIFO queue, so events of a
+    device are always handled by the same worker, in arrival order. Bounded
+    queues push back on the reader (and the TCP stream) when workers fall behind.
+    """
+
+    QUEUE_DEPTH = 256  # Batches per worker
+    PUT_TIMEOUT = 5  # Seconds to wait on a full queue before checking its worker is alive
+
+    def __init__(self, workers, setup=connect_influx):
+        self.ring = HashRing(workers)
+        self.setup = setup
+        self.queues = [multiprocessing.Queue(self.QUEUE_DEPTH) for _ in range(workers)]
+        self.processes = [self.start_worker(index) for index in range(workers)]
+
+    def start_worker(self, index):
+        process = multiprocessing.Process(target=worker_main, args=(index, self.queues[index], self.setup),
+                                          daemon=True)
+        process.start()
+        return process
+
+    def put(self, shard, batch):
+        """Queue a batch, restarting the shard's worker if it died (its queue is kept)"""
+        while True:
+            process = self.processes[shard]
+            if not process.is_alive():
+                timestamp = time.strftime('%Y-%m-%d %H:%M:%S')
+                print(f"[{timestamp}] Worker {shard} died (exit code {process.exitcode}), restarting")
+                self.processes[shard] = self.start_worker(shard)
+            try:
+                self.queues[shard].put(batch, timeout=self.PUT_TIMEOUT)
+                return
+            except Full:
+                pass  # Worker behind (slow InfluxDB) or dead; checked again above
+
+    def submit(self, messages):
+        """Queue (event name, data) messages, one batch per worker; returns their device ids"""
+        batches = {}
+        devices = []
+        for message in messages:
+            device = DEVICE_ID_FIELD.search(message[1])
+            device = device.group(1) if device else ''
+            devices.append(device)
+            batches.setdefault(self.ring.shard(device), []).append(message)
+        for shard, batch in batches.items():
+            self.put(shard, batch)
+        return devices
+
+    def close(self):
+        """Let workers finish their queued messages and stop"""
+        for shard in range(len(self.queues)):
+            self.put(shard, None)
+        for process in self.processes:
+            process.join()
+
+
+# Stall detection: the stream is dead when no bytes (not even a keep-alive
+# comment) arrive for STALL_SECONDS, or when keep-alives still come but events
+# are STALL_CADENCE fleet intervals overdue (the interval learned from the
+# devices' own reporting cadence)
+STALL_CADENCE = 8
+CADENCE_WEIGHT = 0.2  # EWMA weight of a device's newest reporting interval
+DEVICE_SILENT = 4  # Intervals without an event before a device stops counting
+BACKOFF_BASE = 1  # Seconds, doubled per failed attempt (full jitter)
+BACKOFF_MAX = 60
+
+
+class StreamWatch:
+    """Liveness of the event stream across reconnects"""
+
+    def __init__(self):
+        self.last_byte = self.last_event = time.time()
+        self.devices = {}  # device id -> [last event time, interval EWMA or None]
+        self.lost_since = None  # Last event before the current outage
+        self.interval = None
+        self.interval_at = 0
+        self.connected_at = 0
+
+    def connected(self, now):
+        self.last_byte = self.connected_at = now
+
+    def received(self, devices, now):
+        """Bytes arrived, carrying events of these devices (may be none)"""
+        self.last_byte = now
+        if not devices:
+            return
+        if self.lost_since is not None:
+            self.report_loss(now)
+        self.last_event = now
+        for device in devices:
+            state = self.devices.get(device)
+            if state is None:
+                self.devices[device] = [now, None]
+                continue
+            interval = now - state[0]
+            if interval > 0:
+                state[1] = interval if state[1] is None else \
+                    state[1] + CADENCE_WEIGHT * (interval - state[1])
+            state[0] = now
+
+    def fleet_interval(self):
+        """Expected seconds between events of the devices still reporting, None if unknown"""
+        # Judged at the last event, so an outage does not retire every device
+        rate = sum(1 / interval for last, interval in self.devices.values()
+                   if interval and self.last_event - last < DEVICE_SILENT * interval)
+        return 1 / rate if rate else None
+
+    def stalled(self, now):
+        """Reason the stream looks dead, or None"""
+        if now - self.last_byte > STALL_SECONDS:
+            return f"no data or keep-alive for {now - self.last_byte:.0f}s"
+        if now - self.interval_at > 1:
+            self.interval, self.interval_at = self.fleet_interval(), now
+        interval = self.interval
+        quiet = now - max(self.last_event, self.connected_at)
+        if interval and quiet > max(STALL_SECONDS, STALL_CADENCE * interval):
+            return f"no event for {quiet:.0f}s (fleet interval {interval:.1f}s)"
+        return None
+
+    def disconnected(self):
+        if self.lost_since is None:
+            self.lost_since = self.last_event
+
+    def report_loss(self, now):
+        """Events published while disconnected are not replayed by the cloud"""
+        window = now - self.lost_since
+        interval = self.fleet_interval()
+        expected = f", ~{window / interval:.0f} event(s) missed" if interval else ''
+        timestamp = time.strftime('%Y-%m-%d %H:%M:%S')
+        print(f"[{timestamp}] Data loss window {window:.1f}s{expected}")
+        self.lost_since = None
+
+
+def backoff(attempt):
+    """Jittered delay before reconnect attempt N (0 = reconnect at once)"""
+    if attempt == 0:
+        return 0
+    return random.uniform(0, min(BACKOFF_MAX, BACKOFF_BASE * 2 ** attempt))
+
+
+def read_stream(response, dispatcher, watch=None):
+    """Frame SSE messages from one connection and hand them to the workers
+
+    Returns when the stream ends or stalls. The connection's read timeout
+    (STALL_SECONDS) bounds every wait for data, so a silently dead connection
+    surfaces as a timeout instead of blocking forever.
+    """
+    framer = SseFramer()
+    watch = watch or StreamWatch()
+    watch.connected(time.time())
+    try:
+        # Particle streams chunked; each chunk is handed over as soon as it arrives
+        for chunk in response.iter_content(chunk_size=None, decode_unicode=True):
+            now = time.time()
+            messages = framer.feed(chunk) if chunk else []
+            watch.received(dispatcher.submit(messages) if messages else None, now)
+            reason = watch.stalled(now)
+            if reason:
+                print(f"[{time.strftime('%Y-%m-%d %H:%M:%S')}] Stream stalled: {reason}, reconnecting...")
+                return
+    except (requests.exceptions.RequestException, OSError) as e:
+        print(f"[{time.strftime('%Y-%m-%d %H:%M:%S')}] Stream stalled: read failed ({e}), reconnecting...")
+    finally:
+        watch.disconnected()
+
+
+def parse_time(value, default):
+    """UTC ISO time (2025-01-18T06:00) or Unix seconds"""
+    if not value:
+        return default
+    try:
+        return float(value)
+    except ValueError:
+        moment = datetime.datetime.fromisoformat(value)
+        if moment.tzinfo is None:
+            moment = moment.replace(tzinfo=datetime.timezone.utc)
+        return moment.timestamp()
+
+
+def replay_setup():
+    global FAST_PATH, LOG_EVENTS
+    FAST_PATH = True
+    LOG_EVENTS = False
+    connect_influx()
+
+
+def replay_segment(path, start, end):
+    """Re-ingest one segment, returns (events, points written)"""
+    events = points = 0
+    for event_name, event_data in read_segment(path, start, end):
+        handle_safely(event_name, event_data)
+        events += 1
+        if len(pending_lines) >= REPLAY_BATCH:
+            points += len(pending_lines)
+            flush_lines()
+    points += len(pending_lines)
+    flush_lines()
+    return events, points
+
+
+def replay(argv):
+    """Re-ingest archived events of a time range into InfluxDB, one process per segment"""
+    parser = argparse.ArgumentParser(prog='particle-bridge.py replay',
+                                     description='Re-ingest archived events into InfluxDB')
+    parser.add_argument('--start', help='UTC time, e.g. 2025-01-18T06:00, or Unix seconds (default: oldest)')
+    parser.add_argument('--end', help='UTC time or Unix seconds, exclusive (default: newest)')
+    parser.add_argument('--archive', default=ARCHIVE_DIR or 'archive', help='archive directory')
+    parser.add_argument('--workers', type=int, default=os.cpu_count() or 1)
+    args = parser.parse_args(argv)
+    start = parse_time(args.start, 0)
+    end = parse_time(args.end, float('inf'))
+
+    # Segment names carry their hour; skip those outside the range
+    segments = []
+    for name in sorted(os.listdir(args.archive)):
+        match = re.match(r'(\d{10})-w\d+\.seg(\.gz)?$', name)
+        if not match:
+            continue
+        hour = datetime.datetime.strptime(match.group(1), '%Y%m%d%H').replace(
+            tzinfo=datetime.timezone.utc).timestamp()
+        if hour < end and hour + 3600 > start:
+            segments.append(os.path.join(args.archive, name))
+    print(f"Replaying {len(segments)} segment(s) into bucket {INFLUX_BUCKET} with {args.workers} worker(s)")
+
+    began = time.time()
+    events = points = 0
+    with multiprocessing.Pool(args.workers, initializer=replay_setup) as pool:
+        results = pool.starmap(replay_segment, [(path, start, end) for path in segments], chunksize=1)
+    for segment_events, segment_points in results:
+        events += segment_events
+        points += segment_points
+    elapsed = time.time() - began
+    print(f"Replayed {events} events, {points} points in {elapsed:.1f}s "
+          f"({points / max(elapsed, 1e-9):.0f} points/s)")
+
+
 # Main loop with reconnection logic
 def main():
-    retry_delay = 5
-    max_retry_delay = 60
-    last_event_time = time.time()
-    connection_timeout = 630  # 10.5 minutes - reconnect if no data received
+    print(f"Starting Particle to InfluxDB Bridge")
+    print(f"Device ID: {DEVICE_ID}")
+    print(f"Event Name: {EVENT_NAME}")
+    print(f"InfluxDB URL: {INFLUX_URL}")
+    print(f"InfluxDB Org: {INFLUX_ORG}")
+    print(f"InfluxDB Bucket: {INFLUX_BUCKET}")
+    print(f"Workers: {BRIDGE_WORKERS}")
+    print(f"Archive: {ARCHIVE_DIR or 'off'}")
+
+    # Workers drain their queues on their own, so reconnecting never waits
+    # for InfluxDB writes of events that already arrived
+    dispatcher = ShardedDispatcher(BRIDGE_WORKERS)
+    watch = StreamWatch()
+    attempt = 0
 
     while True:
         try:
+            delay = backoff(attempt)
+            if delay:
+                print(f"Retrying in {delay:.1f} seconds...")
+                time.sleep(delay)
+            attempt += 1
+
             print(f"Connecting to Particle Cloud event stream...")
-            print(f"URL: {url.replace(PARTICLE_TOKEN, 'REDACTED')}")
+            print(f"URL: {url.replace(PARTICLE_TOKEN or '', 'REDACTED')}")
 
-            # Subscribe to Particle event stream via SSE using requests
-            # Set timeout to detect stalled connections
-            response = requests.get(url, stream=True, headers={'Accept': 'text/event-stream'}, timeout=30)
+            # Subscribe to Particle event stream via SSE using requests;
+            # the read timeout turns a silent connection into an error
+            response = requests.get(url, stream=True, headers={'Accept': 'text/event-stream'},
+                                    timeout=(10, STALL_SECONDS))
             response.raise_for_status()
 
             print('✓ Connected! Listening for events...')
-            retry_delay = 5  # Reset retry delay on successful connection
-            last_event_time = time.time()  # Reset event timer
-
-            # Process SSE stream manually
-            buffer = ''
-            for chunk in response.iter_content(chunk_size=1, decode_unicode=True):
-                # Check for connection timeout (no data received for too long)
-                if time.time() - last_event_time > connection_timeout:
-                    timestamp = time.strftime('%Y-%m-%d %H:%M:%S')
-                    print(f"[{timestamp}] No data received for {connection_timeout}s, reconnecting...")
-                    break  # Exit the loop to trigger reconnection
-                if chunk:
-                    last_event_time = time.time()  # Update last activity time
-                    buffer += chunk
-                    if '\n\n' in buffer:
-                        # SSE messages are separated by double newlines
-                        messages = buffer.split('\n\n')
-                        buffer = messages[-1]  # Keep incomplete message in buffer
-
-                        for message in messages[:-1]:
-                            if message.strip():
-                                # Parse SSE message - Particle only sends data: lines, no event: lines
-                                lines = message.split('\n')
-                                event_data = None
-
-                                for line in lines:
-                                    if line.startswith('data: '):
-                                        event_data = line[6:]
-                                        break
-
-                                if event_data:
-                                    timestamp = time.strftime('%Y-%m-%d %H:%M:%S')
-                                    try:
-                                        # Parse the Particle event wrapper JSON
-                                        wrapper = json.loads(event_data)
-
-                                        # The wrapper doesn't have a 'name' field, but we can filter by checking
-                                        # if 'data' field contains our expected JSON structure
-                                        if 'data' in wrapper:
-                                            print(f"[{timestamp}] Event received, data: {wrapper['data'][:100]}...")
-
-                                            # Try to parse the data field as JSON
-                                            try:
-                                                sensor_data = json.loads(wrapper['data'])
-                                                # If it parses as JSON with our expected structure, process it
-                                                if 'measurement' in sensor_data and 'fields' in sensor_data:
-                                                    print(f"[{timestamp}] Valid sensor reading found!")
-                                                    process_event(wrapper['data'])
-                                                else:
-                                                    print(f"[{timestamp}] Event data is not sensor reading format")
-                                            except (json.JSONDecodeError, TypeError):
-                                                # Data field is not JSON or wrong format - skip it
-                                                print(f"[{timestamp}] Event data is not JSON: {wrapper['data']}")
-                                                pass
-                                        else:
-                                            print(f"[{timestamp}] Event has no data field")
-
-                                    except json.JSONDecodeError as e:
-                                        print(f"[{timestamp}] Failed to parse event wrapper: {e}")
-                                        pass
-
-            # If we exit the loop normally (not via exception), it means connection was idle
-            # Close the response to ensure clean disconnect
+            connected = time.time()
+
+            read_stream(response, dispatcher, watch)
             response.close()
 
+            # A connection that lasted reconnects at once, a flapping one backs off
+            if time.time() - connected > STALL_SECONDS:
+                attempt = 0
+
         except KeyboardInterrupt:
             print("\nShutting down...")
+            dispatcher.close()
             break
         except Exception as e:
             timestamp = time.strftime('%Y-%m-%d %H:%M:%S')
             print(f"[{timestamp}] Connection error: {e}")
-            print(f"Retrying in {retry_delay} seconds...")
-            time.sleep(retry_delay)
+            watch.disconnected()
 
-            # Exponential backoff
-            retry_delay = min(retry_delay * 2, max_retry_delay)
 
 if __name__ == '__main__':
-    main()
+    if sys.argv[1:2] == ['replay']:
+        replay(sys.argv[2:])
+    else:
+        main()
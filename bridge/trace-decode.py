@@ -0,0 +1,154 @@
+"""Decode flight recorder dumps from the device into a readable timeline.
+
+Accepts any mix of:
+  - USB serial captures containing "TRACE <hex>" lines (dumpTrace "usb")
+  - diag/trace event payloads or `particle subscribe diag/trace` output
+  - a raw copy of /usr/flightrec.bin
+
+Usage: python trace-decode.py <file> [<file> ...]
+"""
+import json
+import re
+import struct
+import sys
+import time
+
+# Must match TraceRecord in src/FlightRecorder.h
+RECORD = struct.Struct('<IIBBhi')
+
+EVENTS = {
+    1: 'BOOT', 2: 'TIME_SYNC', 3: 'READ_OK', 4: 'READ_FAIL', 5: 'PUBLISH',
+    6: 'CONFIG', 7: 'CLOUD_UP', 8: 'CLOUD_DOWN', 9: 'DOE', 10: 'RECOVERY',
+    11: 'CHANGE_POINT',
+}
+PUBLISHES = {
+    1: 'sensor/reading', 2: 'sensor/short', 3: 'sensor/error', 4: 'sensor/info',
+    5: 'config', 6: 'doe', 7: 'system/uptime', 8: 'env',
+}
+CONFIGS = {
+    1: 'publish_interval', 2: 'short_msg', 3: 'start_signal',
+    4: 'response_timeout', 5: 'bit_timeout', 6: 'bit_threshold', 7: 'timing_profile',
+}
+RESET_REASONS = {
+    0: 'none', 10: 'unknown', 20: 'pin_reset', 30: 'power_management', 40: 'power_down',
+    50: 'brownout', 60: 'watchdog', 70: 'update', 80: 'update_error', 90: 'update_timeout',
+    100: 'factory_reset', 110: 'safe_mode', 120: 'dfu_mode', 130: 'panic', 140: 'user',
+}
+DOE_STATES = {0: 'stopped', 1: 'started', 2: 'complete'}
+
+HEX_RE = re.compile(r'^[0-9a-fA-F]+$')
+
+
+def records_from_bytes(raw):
+    for offset in range(0, len(raw) - RECORD.size + 1, RECORD.size):
+        seq, ms, etype, arg, a, b = RECORD.unpack_from(raw, offset)
+        if etype != 0 and seq not in (0, 0xFFFFFFFF):
+            yield {'seq': seq, 'ms': ms, 'type': etype, 'arg': arg, 'a': a, 'b': b}
+
+
+def hex_payloads(text):
+    """Yield hex strings found in serial captures or event payloads"""
+    for line in text.splitlines():
+        line = line.strip()
+        if line.startswith('TRACE '):
+            yield line[6:].strip()
+            continue
+        try:
+            obj = json.loads(line)
+        except json.JSONDecodeError:
+            continue
+        # `particle subscribe` wraps the payload in a string "data" field
+        if isinstance(obj, dict) and isinstance(obj.get('data'), str) and obj['data'].startswith('{'):
+            try:
+                obj = json.loads(obj['data'])
+            except json.JSONDecodeError:
+                continue
+        data = obj.get('data') if isinstance(obj, dict) else None
+        if isinstance(data, str) and HEX_RE.match(data):
+            yield data
+
+
+def load(path):
+    with open(path, 'rb') as f:
+        raw = f.read()
+    try:
+        text = raw.decode('utf-8')
+    except UnicodeDecodeError:
+        text = None
+
+    payloads = list(hex_payloads(text)) if text is not None else []
+    if not payloads:
+        # Raw flash image
+        return list(records_from_bytes(raw))
+
+    records = []
+    for payload in payloads:
+        records.extend(records_from_bytes(bytes.fromhex(payload)))
+    return records
+
+
+def anchor_wall_clock(records):
+    """Assign Unix times using TIME_SYNC records within each boot segment"""
+    segment = []
+    segments = [segment]
+    for rec in records:
+        if rec['type'] == 1 and segment:
+            segment = []
+            segments.append(segment)
+        segment.append(rec)
+
+    for segment in segments:
+        sync = next((r for r in segment if r['type'] == 2), None)
+        for rec in segment:
+            rec['wall'] = sync['b'] + (rec['ms'] - sync['ms']) / 1000.0 if sync else None
+
+
+def describe(rec):
+    etype, arg, a, b = rec['type'], rec['arg'], rec['a'], rec['b']
+    if etype == 1:
+        return f"reset_reason={RESET_REASONS.get(a, a)} data={b}"
+    if etype == 2:
+        return f"unix={b}"
+    if etype == 3:
+        return f"temp={a / 10.0:.1f}C humidity={b / 10.0:.1f}% attempts={arg}"
+    if etype == 4:
+        return f"attempts={arg}"
+    if etype == 5:
+        return f"{PUBLISHES.get(arg, arg)} {'ok' if a else 'FAILED'}"
+    if etype == 6:
+        return f"{CONFIGS.get(arg, arg)}={b}"
+    if etype == 9:
+        extra = f" success_rate={b / 10.0:.1f}%" if arg == 2 else ''
+        return f"{DOE_STATES.get(arg, arg)}{extra}"
+    if etype == 10:
+        return f"recovered after {b} ms" if arg == 1 else f"power cycle #{b}"
+    if etype == 11:
+        return f"{'rise' if arg == 1 else 'fall'} to {a / 10.0:.1f}C"
+    return ''
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+
+    merged = {}
+    for path in sys.argv[1:]:
+        for rec in load(path):
+            merged[rec['seq']] = rec
+    records = [merged[seq] for seq in sorted(merged)]
+    anchor_wall_clock(records)
+
+    for rec in records:
+        if rec['wall'] is not None:
+            when = time.strftime('%Y-%m-%d %H:%M:%S', time.gmtime(rec['wall']))
+        else:
+            when = f"+{rec['ms'] / 1000.0:12.3f}s"
+        name = EVENTS.get(rec['type'], f"type{rec['type']}")
+        print(f"{rec['seq']:>8}  {when:>19}  {name:<10}  {describe(rec)}")
+
+    print(f"\n{len(records)} records", file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
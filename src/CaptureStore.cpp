@@ -0,0 +1,110 @@
+/*
+ * CaptureStore - Compressed RAM store for on-demand burst captures
+ * Readings change by a few tenths between 2 s samples, so deltas from the
+ * previous sample fit in one varint byte where raw floats would take four
+ */
+
+#include "CaptureStore.h"
+
+#if FEATURE_CAPTURE
+
+static const char BASE64_DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+CaptureStore::CaptureStore() {
+    clear();
+}
+
+void CaptureStore::clear() {
+    _length = 0;
+    _blocks = 0;
+    _samples = 0;
+    _lastTime = 0;
+    _lastTemperature = 0;
+    _lastHumidity = 0;
+}
+
+bool CaptureStore::add(uint32_t time, float temperature, float humidity) {
+    int16_t t = (int16_t)lroundf(temperature * 10);
+    int16_t h = (int16_t)lroundf(humidity * 10);
+
+    if (_length + MAX_SAMPLE_BYTES > CAPACITY) {
+        return false;
+    }
+
+    // New block when the open one is full (or the clock stepped back)
+    if (_blocks == 0 || time < _lastTime ||
+        _length - _blockStart[_blocks - 1] + MAX_SAMPLE_BYTES > BLOCK_BYTES) {
+        if (!startBlock(time, t, h)) {
+            return false;
+        }
+    } else {
+        putVarint(time - _lastTime);
+        int32_t dt = t - _lastTemperature;
+        int32_t dh = h - _lastHumidity;
+        putVarint(((uint32_t)dt << 1) ^ (uint32_t)(dt >> 31));
+        putVarint(((uint32_t)dh << 1) ^ (uint32_t)(dh >> 31));
+    }
+
+    _lastTime = time;
+    _lastTemperature = t;
+    _lastHumidity = h;
+    _blockSamples[_blocks - 1]++;
+    _samples++;
+    return true;
+}
+
+bool CaptureStore::startBlock(uint32_t time, int16_t temperature, int16_t humidity) {
+    if (_blocks == MAX_BLOCKS || _length + HEADER_BYTES > CAPACITY) {
+        return false;
+    }
+    _blockStart[_blocks] = _length;
+    _blockSamples[_blocks] = 0;
+    _blocks++;
+
+    uint8_t* p = _data + _length;
+    p[0] = time;
+    p[1] = time >> 8;
+    p[2] = time >> 16;
+    p[3] = time >> 24;
+    p[4] = (uint16_t)temperature;
+    p[5] = (uint16_t)temperature >> 8;
+    p[6] = (uint16_t)humidity;
+    p[7] = (uint16_t)humidity >> 8;
+    _length += HEADER_BYTES;
+    return true;
+}
+
+void CaptureStore::putVarint(uint32_t value) {
+    while (value >= 0x80) {
+        _data[_length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    _data[_length++] = value;
+}
+
+size_t CaptureStore::encodeBlock(uint8_t index, char* out, size_t size) {
+    if (index >= _blocks) {
+        return 0;
+    }
+    const uint8_t* in = _data + _blockStart[index];
+    uint16_t end = (index + 1 < _blocks) ? _blockStart[index + 1] : _length;
+    uint16_t len = end - _blockStart[index];
+    if (size < (size_t)(len + 2) / 3 * 4 + 1) {
+        return 0;
+    }
+
+    char* p = out;
+    for (uint16_t i = 0; i < len; i += 3) {
+        uint32_t n = (uint32_t)in[i] << 16;
+        if (i + 1 < len) n |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) n |= in[i + 2];
+        *p++ = BASE64_DIGITS[(n >> 18) & 0x3F];
+        *p++ = BASE64_DIGITS[(n >> 12) & 0x3F];
+        *p++ = (i + 1 < len) ? BASE64_DIGITS[(n >> 6) & 0x3F] : '=';
+        *p++ = (i + 2 < len) ? BASE64_DIGITS[n & 0x3F] : '=';
+    }
+    *p = '\0';
+    return p - out;
+}
+
+#endif // FEATURE_CAPTURE
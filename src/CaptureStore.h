@@ -0,0 +1,65 @@
+/*
+ * CaptureStore - Compressed RAM store for on-demand burst captures
+ * Samples are delta-encoded into self-contained blocks, each shipped as one
+ * cloud event; block layout must stay in sync with bridge/particle-bridge.py
+ *
+ * Block (little-endian): time (uint32, Unix), temperature x10 (int16),
+ * humidity x10 (uint16), then for every further sample:
+ *   varint seconds since the previous sample,
+ *   zigzag varint temperature delta, zigzag varint humidity delta (x10)
+ * A steady room at 2 s sampling costs 3 bytes per sample
+ */
+
+#ifndef CAPTURE_STORE_H
+#define CAPTURE_STORE_H
+
+#include "Particle.h"
+#include "Features.h"
+
+#if FEATURE_CAPTURE
+
+class CaptureStore {
+public:
+    static const uint16_t CAPACITY = 6144;       // Bytes (an hour at 2 s with room to spare)
+    static const uint16_t BLOCK_BYTES = 408;     // Block limit: base64 + JSON header fit one event
+    static const uint8_t MAX_BLOCKS = 24;
+
+    CaptureStore();
+
+    // Drop all samples
+    void clear();
+
+    // Append a sample, returns false once the store is full
+    bool add(uint32_t time, float temperature, float humidity);
+
+    // Block as base64 text, returns the length written (0 if index is out of range)
+    size_t encodeBlock(uint8_t index, char* out, size_t size);
+
+    uint16_t getBlockSamples(uint8_t index) { return index < _blocks ? _blockSamples[index] : 0; }
+    uint8_t getBlocks() { return _blocks; }
+    uint16_t getSamples() { return _samples; }
+    uint16_t getBytes() { return _length; }
+
+private:
+    static const uint8_t HEADER_BYTES = 8;
+    static const uint8_t MAX_SAMPLE_BYTES = 9;   // Three varints, wide deltas
+
+    uint8_t _data[CAPACITY];
+    uint16_t _length;
+    uint16_t _blockStart[MAX_BLOCKS];
+    uint16_t _blockSamples[MAX_BLOCKS];
+    uint8_t _blocks;
+    uint16_t _samples;
+
+    // Previous sample of the open block
+    uint32_t _lastTime;
+    int16_t _lastTemperature;
+    int16_t _lastHumidity;
+
+    bool startBlock(uint32_t time, int16_t temperature, int16_t humidity);
+    void putVarint(uint32_t value);
+};
+
+#endif // FEATURE_CAPTURE
+
+#endif // CAPTURE_STORE_H
@@ -0,0 +1,110 @@
+/*
+ * EventEnvelope - Several logical events in one cloud publish
+ * Each publish costs a data operation; coalescing readings with the
+ * config/status chatter around them cuts the count without delaying
+ * anything by more than the coalescing window
+ */
+
+#include "EventEnvelope.h"
+
+#if FEATURE_ENVELOPE
+
+EventEnvelope::EventEnvelope(uint32_t windowMs, uint32_t maxHoldMs)
+    : _windowMs(windowMs), _maxHoldMs(maxHoldMs), _length(0), _count(0),
+      _maxPriority(ENVELOPE_LOW), _firstMs(0), _normalMs(0), _lastAttempt(0),
+      _seq(0), _messages(0), _dropped(0) {
+    _data[0] = '\0';
+}
+
+bool EventEnvelope::post(const char* name, const char* data, EnvelopePriority priority) {
+    const size_t capacity = ENVELOPE_MAX_DATA - HEADER_RESERVE;
+    size_t nameLen = strlen(name);
+    size_t dataLen = strlen(data);
+    size_t lineLen = nameLen + 1 + dataLen;
+
+    // Too large to share an envelope: send queued messages first to keep the order
+    if (lineLen > capacity) {
+        if (!Particle.connected()) {
+            _dropped++;
+            return false;
+        }
+        flush();
+        return Particle.publish(name, data, PRIVATE);
+    }
+
+    if (_length + (_count > 0 ? 1 : 0) + lineLen > capacity && !flush()) {
+        _dropped++;
+        Log.warn("EventEnvelope: full, dropped %s", name);
+        return false;
+    }
+
+    char* p = _data + _length;
+    if (_count > 0) {
+        *p++ = '\n';
+    }
+    memcpy(p, name, nameLen);
+    p += nameLen;
+    *p++ = '\t';
+    for (size_t i = 0; i < dataLen; i++) {
+        char c = data[i];
+        *p++ = (c == '\n' || c == '\r') ? ' ' : c;
+    }
+    *p = '\0';
+    _length = p - _data;
+
+    uint32_t now = millis();
+    if (_count == 0) {
+        _firstMs = now;
+        _maxPriority = ENVELOPE_LOW;
+    }
+    if (priority >= ENVELOPE_NORMAL && _maxPriority < ENVELOPE_NORMAL) {
+        _normalMs = now;
+    }
+    if (priority > _maxPriority) {
+        _maxPriority = priority;
+    }
+    _count++;
+    return true;
+}
+
+bool EventEnvelope::service() {
+    if (_count == 0 || !Particle.connected() || millis() - _lastAttempt < RETRY_MS) {
+        return false;
+    }
+
+    uint32_t now = millis();
+    bool due = _maxPriority == ENVELOPE_URGENT ||
+               (_maxPriority == ENVELOPE_NORMAL && now - _normalMs >= _windowMs) ||
+               now - _firstMs >= _maxHoldMs;
+    return due && flush();
+}
+
+bool EventEnvelope::flush() {
+    if (_count == 0 || !Particle.connected()) {
+        return false;
+    }
+
+    // Header goes in front of the message lines (room was reserved in post)
+    char header[HEADER_RESERVE];
+    int headerLen = snprintf(header, sizeof(header), "%d %lu\n", ENVELOPE_VERSION,
+                             (unsigned long)(_seq + 1));
+    memmove(_data + headerLen, _data, _length + 1);
+    memcpy(_data, header, headerLen);
+
+    _lastAttempt = millis();
+    bool ok = Particle.publish(ENVELOPE_EVENT_NAME, _data, PRIVATE);
+    if (!ok) {
+        memmove(_data, _data + headerLen, _length + 1);
+        Log.warn("EventEnvelope: publish of %d messages refused", _count);
+        return false;
+    }
+
+    _seq++;
+    _messages += _count;
+    _count = 0;
+    _length = 0;
+    _data[0] = '\0';
+    return true;
+}
+
+#endif // FEATURE_ENVELOPE
@@ -0,0 +1,85 @@
+/*
+ * EventEnvelope - Several logical events in one cloud publish
+ * Messages are coalesced for a short window and published together as a
+ * single "env" event; format must stay in sync with bridge/particle-bridge.py
+ *
+ * Event data: header line "<version> <seq>", then one line per message
+ *   "<event name>\t<event data>"
+ * Newlines in message data are replaced by spaces
+ */
+
+#ifndef EVENT_ENVELOPE_H
+#define EVENT_ENVELOPE_H
+
+#include "Particle.h"
+#include "Features.h"
+
+#define ENVELOPE_EVENT_NAME "env"
+#define ENVELOPE_VERSION 1
+#define ENVELOPE_MAX_DATA 622       // Particle event data limit (bytes)
+
+// How long a message may wait for others to share its publish
+enum EnvelopePriority : uint8_t {
+    ENVELOPE_LOW = 0,       // Config/info chatter: rides along with the next flush (up to max hold)
+    ENVELOPE_NORMAL = 1,    // Readings, errors, DOE results: flushed after the coalescing window
+    ENVELOPE_URGENT = 2     // Flushed on the next service() call
+};
+
+#if FEATURE_ENVELOPE
+
+class EventEnvelope {
+public:
+    // windowMs = wait for normal messages, maxHoldMs = wait for low-priority messages
+    EventEnvelope(uint32_t windowMs, uint32_t maxHoldMs);
+
+    // Queue a message. Messages too large for an envelope are published on their own.
+    // Returns false if the message was dropped (envelope full and could not be flushed)
+    bool post(const char* name, const char* data, EnvelopePriority priority = ENVELOPE_NORMAL);
+
+    // Publish the envelope once it is due (call from loop and long-running work)
+    // Returns true if an envelope was published
+    bool service();
+
+    // Publish queued messages now, returns false if nothing was published
+    bool flush();
+
+    uint8_t getPending() { return _count; }       // Messages waiting in the envelope
+    uint32_t getSequence() { return _seq; }       // Envelopes published
+    uint32_t getMessages() { return _messages; }  // Messages delivered in envelopes
+    uint32_t getDropped() { return _dropped; }
+
+private:
+    static const uint32_t RETRY_MS = 1000;      // Back-off after a refused publish (cloud rate limit)
+    static const uint8_t HEADER_RESERVE = 16;   // Room kept for "<version> <seq>\n"
+
+    uint32_t _windowMs;
+    uint32_t _maxHoldMs;
+    char _data[ENVELOPE_MAX_DATA + 1];
+    uint16_t _length;        // Bytes of message lines in _data (header is added on flush)
+    uint8_t _count;
+    uint8_t _maxPriority;    // Highest EnvelopePriority queued
+    uint32_t _firstMs;       // millis() of the oldest queued message
+    uint32_t _normalMs;      // millis() of the oldest normal/urgent message
+    uint32_t _lastAttempt;
+    uint32_t _seq;
+    uint32_t _messages;
+    uint32_t _dropped;
+};
+
+#else
+
+// Envelope left out of the build: every message is its own publish, as before
+class EventEnvelope {
+public:
+    EventEnvelope(uint32_t windowMs, uint32_t maxHoldMs) {}
+    bool post(const char* name, const char* data, EnvelopePriority priority = ENVELOPE_NORMAL) {
+        return Particle.connected() && Particle.publish(name, data, PRIVATE);
+    }
+    bool service() { return false; }
+    bool flush() { return false; }
+    uint8_t getPending() { return 0; }
+};
+
+#endif // FEATURE_ENVELOPE
+
+#endif // EVENT_ENVELOPE_H
@@ -0,0 +1,44 @@
+/*
+ * Build-time feature modules
+ *
+ * Core sampling (DHT22 reads, moving average, timing profiles, sensor
+ * recovery, cloud variables) is always built. The other modules can be left
+ * out of an image by defining the flag as 0, e.g. for a lean field image:
+ *   EXTRA_CFLAGS="-DFEATURE_DOE=0 -DFEATURE_DIAGNOSTICS=0"
+ * or by editing the defaults below. tools/module-size-report.py builds each
+ * combination and reports the flash/RAM cost of every module.
+ */
+
+#ifndef FEATURES_H
+#define FEATURES_H
+
+// Cloud publishing of readings (sensor/reading, sensor/short, enableShort)
+// Without it readings are only available through the cloud variables
+#ifndef FEATURE_PUBLISHING
+#define FEATURE_PUBLISHING 1
+#endif
+
+// Multiplexed event envelope: events are coalesced into one "env" publish and
+// split apart again by bridge/particle-bridge.py. Set to 0 when webhooks or
+// other integrations subscribe to the individual event names
+#ifndef FEATURE_ENVELOPE
+#define FEATURE_ENVELOPE 1
+#endif
+
+// Design of Experiments timing optimization (startDOE, stopDOE, doe* variables)
+#ifndef FEATURE_DOE
+#define FEATURE_DOE 1
+#endif
+
+// On-demand burst capture (capture function, sensor/capture): 2 s samples kept
+// in a compressed 6 KB RAM store and shipped after the capture window
+#ifndef FEATURE_CAPTURE
+#define FEATURE_CAPTURE 1
+#endif
+
+// Flight recorder, crash context reporting and USB lab streaming
+#ifndef FEATURE_DIAGNOSTICS
+#define FEATURE_DIAGNOSTICS 1
+#endif
+
+#endif // FEATURES_H
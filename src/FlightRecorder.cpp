@@ -0,0 +1,105 @@
+/*
+ * FlightRecorder - Binary event trace for post-mortem analysis
+ * Records are staged in RAM and written to flash in batches to keep
+ * the hot path cheap and limit flash wear
+ */
+
+#include "FlightRecorder.h"
+
+#if FEATURE_DIAGNOSTICS
+
+#include <fcntl.h>
+
+FlightRecorder::FlightRecorder(const char* path, uint16_t capacity)
+    : _path(path), _capacity(capacity), _fd(-1), _nextSeq(1), _lastFlush(0), _dropped(0),
+      _pendingHead(0), _pendingCount(0) {
+}
+
+void FlightRecorder::begin() {
+    _fd = open(_path, O_RDWR | O_CREAT, 0644);
+    if (_fd < 0) {
+        Log.error("FlightRecorder: cannot open %s", _path);
+        return;
+    }
+
+    // Scan existing slots for the highest sequence number to resume after it
+    uint32_t maxSeq = 0;
+    TraceRecord rec;
+    lseek(_fd, 0, SEEK_SET);
+    for (uint16_t slot = 0; slot < _capacity; slot++) {
+        if (read(_fd, &rec, sizeof(rec)) != sizeof(rec)) {
+            break;  // File shorter than capacity (not yet wrapped)
+        }
+        if (rec.type != TRACE_NONE && rec.seq != 0xFFFFFFFF && rec.seq > maxSeq) {
+            maxSeq = rec.seq;
+        }
+    }
+    _nextSeq = maxSeq + 1;
+    _lastFlush = millis();
+
+    Log.info("FlightRecorder: %s resumed at seq %lu (%d slots)", _path, _nextSeq, _capacity);
+}
+
+void FlightRecorder::record(uint8_t type, uint8_t arg, int16_t a, int32_t b) {
+    if (_pendingCount == STAGING_SIZE) {
+        // Staging ring full - drop the oldest pending record
+        _pendingHead = (_pendingHead + 1) % STAGING_SIZE;
+        _pendingCount--;
+        _dropped++;
+    }
+
+    TraceRecord& rec = _staging[(_pendingHead + _pendingCount) % STAGING_SIZE];
+    rec.seq = _nextSeq++;
+    rec.ms = millis();
+    rec.type = type;
+    rec.arg = arg;
+    rec.a = a;
+    rec.b = b;
+    _pendingCount++;
+}
+
+void FlightRecorder::flush(bool force) {
+    if (_pendingCount == 0 || _fd < 0) {
+        return;
+    }
+    if (!force && _pendingCount < FLUSH_THRESHOLD && millis() - _lastFlush < FLUSH_INTERVAL_MS) {
+        return;
+    }
+
+    while (_pendingCount > 0) {
+        if (!writeSlot(_staging[_pendingHead])) {
+            break;  // Keep remaining records staged for the next attempt
+        }
+        _pendingHead = (_pendingHead + 1) % STAGING_SIZE;
+        _pendingCount--;
+    }
+    fsync(_fd);
+    _lastFlush = millis();
+}
+
+uint16_t FlightRecorder::readFrom(uint32_t fromSeq, TraceRecord* out, uint16_t maxRecords) {
+    flush(true);
+    if (_fd < 0) {
+        return 0;
+    }
+
+    if (fromSeq < getOldestSequence()) {
+        fromSeq = getOldestSequence();
+    }
+
+    uint16_t count = 0;
+    for (uint32_t seq = fromSeq; seq < _nextSeq && count < maxRecords; seq++) {
+        lseek(_fd, (seq % _capacity) * sizeof(TraceRecord), SEEK_SET);
+        if (read(_fd, &out[count], sizeof(TraceRecord)) == sizeof(TraceRecord) && out[count].seq == seq) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool FlightRecorder::writeSlot(const TraceRecord& rec) {
+    lseek(_fd, (rec.seq % _capacity) * sizeof(TraceRecord), SEEK_SET);
+    return write(_fd, &rec, sizeof(rec)) == sizeof(rec);
+}
+
+#endif // FEATURE_DIAGNOSTICS
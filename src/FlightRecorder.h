@@ -0,0 +1,121 @@
+/*
+ * FlightRecorder - Binary event trace for post-mortem analysis
+ * Appends fixed-size records to a circular file in the flash file system
+ * Record layout must stay in sync with bridge/trace-decode.py
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include "Particle.h"
+#include "Features.h"
+
+// Trace event types
+enum TraceEvent : uint8_t {
+    TRACE_NONE = 0,
+    TRACE_BOOT = 1,         // a = reset reason, b = reset reason data
+    TRACE_TIME_SYNC = 2,    // b = Unix time (anchors millis to wall clock)
+    TRACE_READ_OK = 3,      // arg = attempts, a = temp x10, b = humidity x10
+    TRACE_READ_FAIL = 4,    // arg = attempts
+    TRACE_PUBLISH = 5,      // arg = TracePublish id, a = 1 if accepted
+    TRACE_CONFIG = 6,       // arg = TraceConfig id, b = new value
+    TRACE_CLOUD_UP = 7,
+    TRACE_CLOUD_DOWN = 8,
+    TRACE_DOE = 9,          // arg = 1 start, 0 stop, 2 complete
+    TRACE_RECOVERY = 10,    // arg = 0 power cycle (b = cycles), 1 recovered (b = recovery ms)
+    TRACE_CHANGE_POINT = 11 // arg = 1 rise, 0 fall, a = temp x10
+};
+
+// Publish event ids (TRACE_PUBLISH arg)
+enum TracePublish : uint8_t {
+    TRACE_PUB_READING = 1,
+    TRACE_PUB_SHORT = 2,
+    TRACE_PUB_ERROR = 3,
+    TRACE_PUB_INFO = 4,
+    TRACE_PUB_CONFIG = 5,
+    TRACE_PUB_DOE = 6,
+    TRACE_PUB_SYSTEM = 7,
+    TRACE_PUB_ENVELOPE = 8     // Coalesced "env" publish
+};
+
+// Configuration ids (TRACE_CONFIG arg)
+enum TraceConfig : uint8_t {
+    TRACE_CFG_INTERVAL = 1,
+    TRACE_CFG_SHORT_MSG = 2,
+    TRACE_CFG_START_SIGNAL = 3,
+    TRACE_CFG_RESPONSE_TIMEOUT = 4,
+    TRACE_CFG_BIT_TIMEOUT = 5,
+    TRACE_CFG_BIT_THRESHOLD = 6,
+    TRACE_CFG_PROFILE = 7          // a = temperature bucket, b = profile applied (-1 = base)
+};
+
+// 16-byte trace record (little-endian, packed)
+struct __attribute__((packed)) TraceRecord {
+    uint32_t seq;       // Monotonic sequence number (0 = empty slot)
+    uint32_t ms;        // millis() when recorded
+    uint8_t type;       // TraceEvent
+    uint8_t arg;        // Event-specific small argument
+    int16_t a;          // Event-specific value
+    int32_t b;          // Event-specific value
+};
+
+#if FEATURE_DIAGNOSTICS
+
+class FlightRecorder {
+public:
+    // capacity = number of records kept in flash before wrapping
+    FlightRecorder(const char* path, uint16_t capacity);
+
+    // Open the trace file and locate the write position (call once in setup)
+    void begin();
+
+    // Append a record to the RAM staging ring (hot path: no formatting, no flash I/O)
+    void record(uint8_t type, uint8_t arg = 0, int16_t a = 0, int32_t b = 0);
+
+    // Write staged records to flash when enough are pending or force is set
+    void flush(bool force = false);
+
+    // Copy up to maxRecords records starting at fromSeq (oldest first),
+    // returns count copied (flushes staged records first)
+    uint16_t readFrom(uint32_t fromSeq, TraceRecord* out, uint16_t maxRecords);
+
+    // Oldest sequence number that has not been overwritten
+    uint32_t getOldestSequence() { return (_nextSeq > _capacity) ? _nextSeq - _capacity : 1; }
+
+    uint32_t getSequence() { return _nextSeq; }   // Next sequence number to be assigned
+    uint16_t getPending() { return _pendingCount; }
+    uint32_t getDropped() { return _dropped; }
+
+private:
+    static const uint8_t STAGING_SIZE = 32;    // Records held in RAM between flushes
+    static const uint8_t FLUSH_THRESHOLD = 16; // Flush when this many are pending
+    static const uint32_t FLUSH_INTERVAL_MS = 60000; // ...or at least once per minute
+
+    const char* _path;
+    uint16_t _capacity;
+    int _fd;
+    uint32_t _nextSeq;
+    uint32_t _lastFlush;
+    uint32_t _dropped;
+
+    TraceRecord _staging[STAGING_SIZE];
+    uint8_t _pendingHead;   // Index of oldest pending record
+    uint8_t _pendingCount;
+
+    bool writeSlot(const TraceRecord& rec);
+};
+
+#else
+
+// Diagnostics module left out of the build: hot-path calls compile to nothing
+class FlightRecorder {
+public:
+    FlightRecorder(const char* path, uint16_t capacity) {}
+    void begin() {}
+    void record(uint8_t type, uint8_t arg = 0, int16_t a = 0, int32_t b = 0) {}
+    void flush(bool force = false) {}
+};
+
+#endif // FEATURE_DIAGNOSTICS
+
+#endif // FLIGHT_RECORDER_H
@@ -0,0 +1,114 @@
+/*
+ * LabStream - Framed binary streaming of raw DHT22 frames over USB serial
+ */
+
+#include "LabStream.h"
+
+#if FEATURE_DIAGNOSTICS
+
+// Fixed payload header size (see bridge/lab-stream-reader.py)
+#define LAB_HEADER_SIZE 34
+
+static inline uint8_t* putU16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static inline uint8_t* putU32(uint8_t* p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+LabReadResult LabStream::sendFrame(const DHTFrame& frame, SimpleDHT22& sensor) {
+    uint16_t threshold = sensor.getBitThreshold();
+
+    // Classify the outcome the same way SimpleDHT22::read() does
+    LabReadResult result = LAB_READ_OK;
+    int16_t temp10 = 0;
+    uint16_t hum10 = 0;
+    if (frame.failStep != DHT_STEP_IDLE) {
+        result = LAB_READ_TIMEOUT;
+    } else if ((uint8_t)(frame.data[0] + frame.data[1] + frame.data[2] + frame.data[3]) != frame.data[4]) {
+        result = LAB_READ_CHECKSUM;
+    } else {
+        hum10 = ((uint16_t)frame.data[0] << 8) | frame.data[1];
+        temp10 = ((int16_t)(frame.data[2] & 0x7F) << 8) | frame.data[3];
+        if (frame.data[2] & 0x80) {
+            temp10 = -temp10;
+        }
+        if (hum10 > 1000 || temp10 < -400 || temp10 > 800) {
+            result = LAB_READ_RANGE;
+        }
+    }
+
+    // Quality metrics over the bit high pulses (edge pairs after the 4 preamble edges)
+    uint16_t minMargin = 0xFF;
+    uint16_t maxZeroHigh = 0;
+    uint16_t minOneHigh = 0xFFFF;
+    for (uint8_t e = 4; e + 1 < frame.edgeCount; e += 2) {
+        uint16_t high = frame.edges[e + 1] - frame.edges[e];
+        uint16_t margin = (high > threshold) ? high - threshold : threshold - high;
+        if (margin < minMargin) minMargin = margin;
+        if (high > threshold) {
+            if (high < minOneHigh) minOneHigh = high;
+        } else if (high > maxZeroHigh) {
+            maxZeroHigh = high;
+        }
+    }
+
+    uint8_t buf[6 + LAB_HEADER_SIZE + DHT_FRAME_EDGES * 2 + 2];
+    uint16_t payloadLen = LAB_HEADER_SIZE + frame.edgeCount * 2;
+
+    uint8_t* p = buf;
+    *p++ = 0xD2;
+    *p++ = 0x2D;
+    *p++ = LAB_STREAM_VERSION;
+    *p++ = LAB_FRAME_TYPE_READ;
+    p = putU16(p, payloadLen);
+
+    p = putU32(p, _seq++);
+    p = putU32(p, millis());
+    p = putU16(p, sensor.getStartSignal());
+    p = putU16(p, sensor.getResponseTimeout());
+    p = putU16(p, sensor.getBitTimeout());
+    p = putU16(p, threshold);
+    *p++ = result;
+    *p++ = frame.failStep;
+    *p++ = frame.edgeCount;
+    *p++ = (uint8_t)minMargin;
+    memcpy(p, frame.data, 5);
+    p += 5;
+    *p++ = 0;  // Reserved
+    p = putU16(p, (uint16_t)temp10);
+    p = putU16(p, hum10);
+    p = putU16(p, maxZeroHigh);
+    p = putU16(p, minOneHigh);
+    for (uint8_t e = 0; e < frame.edgeCount; e++) {
+        p = putU16(p, frame.edges[e]);
+    }
+
+    p = putU16(p, crc16(buf + 2, p - buf - 2));
+    Serial.write(buf, p - buf);
+
+    _sent++;
+    if (result == LAB_READ_OK) {
+        _ok++;
+    }
+    return result;
+}
+
+uint16_t LabStream::crc16(const uint8_t* data, size_t len, uint16_t crc) {
+    while (len--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+#endif // FEATURE_DIAGNOSTICS
@@ -0,0 +1,48 @@
+/*
+ * LabStream - Framed binary streaming of raw DHT22 frames over USB serial
+ * For bench characterization; frame layout must stay in sync with
+ * bridge/lab-stream-reader.py
+ *
+ * Frame: sync (0xD2 0x2D), version, type, payload length (uint16),
+ *        payload, CRC-16/CCITT-FALSE over version..payload (uint16)
+ * All multi-byte fields are little-endian
+ */
+
+#ifndef LAB_STREAM_H
+#define LAB_STREAM_H
+
+#include "Particle.h"
+#include "SimpleDHT22.h"
+#include "Features.h"
+
+#define LAB_STREAM_VERSION 1
+#define LAB_FRAME_TYPE_READ 1
+
+// Read outcome reported in each frame
+enum LabReadResult : uint8_t {
+    LAB_READ_OK = 0,
+    LAB_READ_TIMEOUT = 1,
+    LAB_READ_CHECKSUM = 2,
+    LAB_READ_RANGE = 3
+};
+
+class LabStream {
+public:
+    LabStream() : _seq(0), _sent(0), _ok(0) {}
+
+    // Encode one captured frame with its timing parameters and write it to USB serial
+    // Returns the read outcome so callers can keep their own statistics
+    LabReadResult sendFrame(const DHTFrame& frame, SimpleDHT22& sensor);
+
+    uint32_t getSent() { return _sent; }
+    uint32_t getSuccessful() { return _ok; }
+
+private:
+    uint32_t _seq;
+    uint32_t _sent;
+    uint32_t _ok;
+
+    static uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF);
+};
+
+#endif // LAB_STREAM_H
@@ -10,11 +10,46 @@
  */
 
 #include "Particle.h"
+#include "Features.h"
 #include "SimpleDHT22.h"
+#include "FlightRecorder.h"
+#include "SensorRecovery.h"
+#include "LabStream.h"
+#include "SamplePipeline.h"
+#include "EventEnvelope.h"
+#include "SelfBench.h"
+#include "CaptureStore.h"
+#include <fcntl.h>
 
 // DHT22 Configuration
 #define DHTPIN D3
 
+// Co-located DHT22s voted on every measurement (1 = single sensor on DHTPIN)
+// With 2 or more the median of the sensors replaces the jump re-read; with 3 or
+// more, sensors drifting away from the others are reported and left out of the vote
+#define DHT_SENSOR_COUNT 1
+#define DHT_EXTRA_PINS D4, D5           // Data pins of sensors 2..DHT_SENSOR_COUNT (one per sensor)
+
+// DHT22 Power Control - set DHT_POWER_PIN to the GPIO/load switch enable feeding
+// DHT22 VCC (and the pull-up) to enable hung-sensor recovery; PIN_INVALID = always on
+#define DHT_POWER_PIN PIN_INVALID
+#define DHT_POWER_GATING 0              // 1 = power sensor off between samples (battery sites)
+#define DHT_POWER_OFF_MS 2000           // Supply off time during a recovery power cycle
+#define DHT_POWER_SETTLE_MS 2000        // Wait after power-on before reading (datasheet: >1s)
+#define RECOVERY_FAIL_THRESHOLD 5       // Consecutive failed measurements before power cycling
+
+// Reading freshness - a DHT22 read returns the conversion started by the previous
+// read, so without priming every reading is one measurement interval old
+#define FRESHNESS_LEGACY 0              // Stamp readings with the read time (about 10 s stale)
+#define FRESHNESS_PRIME 1               // Throwaway read 2 s before each measurement (data ~2 s old)
+#define FRESHNESS_BACKDATE 2            // Stamp readings with the time their conversion started (PRIME does too)
+#define DHT_FRESHNESS_MODE FRESHNESS_BACKDATE
+#if DHT_FRESHNESS_MODE == FRESHNESS_PRIME
+#define DHT_PRIME_LEAD_MS 2000          // Priming read this long before the measurement (DHT22 minimum)
+#else
+#define DHT_PRIME_LEAD_MS 0
+#endif
+
 // EEPROM Configuration
 #define EEPROM_PUBLISH_INTERVAL_ADDR 0  // Address to store publish interval (4 bytes)
 #define EEPROM_MAGIC_ADDR 4             // Address to store magic number (4 bytes)
@@ -23,34 +58,180 @@
 #define EEPROM_BIT_TIMEOUT_ADDR 12      // Address to store bit timeout (2 bytes)
 #define EEPROM_BIT_THRESHOLD_ADDR 14    // Address to store bit threshold (2 bytes)
 #define EEPROM_MAGIC 0xA5B4C3D2         // Magic number to validate EEPROM data
+#define EEPROM_PROFILE_MAGIC_ADDR 16    // Address to store timing profile table magic (4 bytes)
+#define EEPROM_PROFILE_TABLE_ADDR 20    // Address of the timing profile table (12 bytes per entry)
+#define EEPROM_PROFILE_MAGIC 0x54505246 // "TPRF"
+#define EEPROM_TIMING_OVERRIDE_ADDR 164 // Manual timing override flag (1 byte, 1 = set)
 
 // System mode - Use AUTOMATIC for reliable cloud connection
 SYSTEM_MODE(AUTOMATIC);
 
+// Keep retained variables across panic/watchdog resets
+STARTUP(System.enableFeature(FEATURE_RETAINED_MEMORY));
+
+// Runtime context - updated on the hot path, survives panic/watchdog resets
+#define RUNTIME_CONTEXT_MAGIC 0x52435458  // "RCTX"
+
+enum RuntimeStage : uint8_t {
+    STAGE_BOOT = 0,
+    STAGE_IDLE = 1,
+    STAGE_MEASURE = 2,
+    STAGE_DHT_READ = 3,
+    STAGE_PUBLISH = 4,
+    STAGE_CLOUD_FUNCTION = 5,
+    STAGE_DOE = 6,
+    STAGE_TRACE_FLUSH = 7
+};
+
+struct RuntimeContext {
+    uint32_t magic;
+    uint8_t stage;          // RuntimeStage last entered
+    volatile uint8_t dhtStep; // DHTStep last entered (written by SimpleDHT22)
+    uint16_t pendingEvents; // Messages waiting in the event envelope
+    uint32_t loopCount;     // loop() iterations since boot
+    uint32_t freeMemory;    // Free heap at last measurement
+    uint32_t uptime;        // Seconds since boot at last measurement
+};
+
+retained RuntimeContext runtimeContext;
+#if FEATURE_DIAGNOSTICS
+RuntimeContext crashContext;           // Copy of the previous boot's context
+bool crashContextPending = false;      // Publish crashContext once connected
+#define CRASH_RETRY_MIN_MS 5000         // Retry a refused system/crash publish after this...
+#define CRASH_RETRY_MAX_MS 300000       // ...doubling up to this
+#endif
+
 // DHT sensor object - using custom interrupt-based library
 SimpleDHT22 dht(DHTPIN);
 
+#if DHT_SENSOR_COUNT > 1
+// Extra co-located sensors (share the primary sensor's timing and power pin)
+SimpleDHT22 dhtExtra[] = {DHT_EXTRA_PINS};
+static_assert(sizeof(dhtExtra) / sizeof(dhtExtra[0]) == DHT_SENSOR_COUNT - 1,
+              "DHT_EXTRA_PINS needs one pin per extra sensor");
+#endif
+
+// Hung-sensor recovery (only acts when DHT_POWER_PIN is set)
+SensorRecovery sensorRecovery(RECOVERY_FAIL_THRESHOLD, DHT_POWER_OFF_MS, DHT_POWER_SETTLE_MS);
+
+// Event envelope - events coalesced into one "env" publish (see EventEnvelope.h)
+#define ENVELOPE_WINDOW_MS 1000         // Readings, errors and DOE events wait this long for company
+#define ENVELOPE_MAX_HOLD_MS 300000     // Config/info chatter waits up to 5 minutes for a reading
+EventEnvelope eventEnvelope(ENVELOPE_WINDOW_MS, ENVELOPE_MAX_HOLD_MS);
+
+// Flight recorder - binary event trace in flash (1024 x 16-byte records = 16KB)
+#define TRACE_FILE_PATH "/usr/flightrec.bin"
+#define TRACE_CAPACITY 1024
+#define TRACE_RECORDS_PER_EVENT 18  // 18 records x 32 hex chars fits in one event
+FlightRecorder trace(TRACE_FILE_PATH, TRACE_CAPACITY);
+#if FEATURE_DIAGNOSTICS
+bool traceCloudConnected = false; // Last observed cloud state (for transition records)
+bool traceTimeSynced = false;     // Wall clock anchor recorded
+
+// Trace dump in progress - dumpTrace queues it, loop() sends one chunk at a time
+#define TRACE_DUMP_INTERVAL 1000    // Between diag/trace publishes (cloud rate limit)
+struct TraceDump {
+    bool active;
+    bool toUsb;
+    uint32_t seq;                   // Next record to send
+    uint32_t end;                   // Sequence number the dump stops at
+    int chunk;                      // Chunks sent so far
+    int chunks;
+    int dumped;                     // Records sent so far
+    unsigned long lastChunkMs;
+};
+TraceDump traceDump = {};
+
+// Lab streaming - raw frames over USB serial at the maximum DHT22 rate
+#define LAB_STREAM_INTERVAL 2000    // DHT22 minimum read interval (ms)
+LabStream labStream;
+bool labStreamActive = false;
+unsigned long lastLabFrame = 0;
+#endif
+
+// Temperature-indexed timing profiles
+// DHT22 timing optima drift with ambient temperature; one parameter set per
+// 10 C bucket is selected from the last validated temperature before each read
+#define TIMING_PROFILE_COUNT 12         // -40 C to +80 C (DHT22 range)
+#define TIMING_PROFILE_MIN_TEMP -40     // Lower edge of the first bucket (C)
+#define TIMING_PROFILE_BUCKET 10        // Bucket width (C)
+#define TIMING_PROFILE_HYSTERESIS 1.0   // Stay in a bucket until this far past its edge (C)
+#define TIMING_PROFILE_REACH 1          // Neighbouring buckets searched when a bucket is empty
+
+enum TimingProfileSource : uint8_t {
+    PROFILE_EMPTY = 0,
+    PROFILE_DOE = 1,     // Stored automatically when a DOE completes
+    PROFILE_MANUAL = 2   // Stored with the setProfile function
+};
+
+struct TimingProfile {
+    uint16_t startSignal;
+    uint16_t responseTimeout;
+    uint16_t bitTimeout;
+    uint16_t bitThreshold;
+    uint16_t successRate;   // DOE success rate x10 (0 = unknown)
+    uint8_t source;         // TimingProfileSource
+    uint8_t reserved;
+};
+
+TimingProfile timingProfiles[TIMING_PROFILE_COUNT];
+TimingProfile baseTiming;              // Single EEPROM set, used when no profile is stored
+int activeBucket = -1;                 // Temperature bucket of the last selection
+int activeProfile = -1;                // Profile applied to the sensor (-1 = base timing)
+bool timingProfileDirty = true;        // Re-apply timing before the next read
+bool timingOverride = false;           // Manual timing set since the last DOE, profiles suspended
+uint16_t profileReads[TIMING_PROFILE_COUNT];  // Measurements per bucket since boot
+uint16_t profileFails[TIMING_PROFILE_COUNT];  // Failed measurements per bucket since boot
+String timingProfileSummary = "";      // Cloud variable
+
 // Timing Configuration
 const unsigned long MEASUREMENT_INTERVAL = 10000; // Fixed 10 seconds in milliseconds
 unsigned long publishInterval = 300; // Default 300 seconds (5 minutes), configurable
 unsigned long lastMeasurement = 0;
 unsigned long lastPublishTime = 0; // Track when we last published
 
-// Moving Average Buffer
+// Step-change burst - after a detected step (door open, HVAC failure) sample at the
+// DHT22 maximum rate for a while so the new level is tracked and published quickly
+const unsigned long CHANGE_BURST_INTERVAL = 2000;  // DHT22 minimum read interval (ms)
+const unsigned long CHANGE_BURST_DURATION = 60000; // Burst length after the last detected step (ms)
+bool changeBurstActive = false;
+unsigned long changeBurstStart = 0;
+
+#if FEATURE_CAPTURE
+// Burst capture - on-demand 2 s sampling for investigations (HVAC cycling etc.), kept
+// compressed in RAM and shipped as sensor/capture events once the window closes;
+// the regular 10 s measurements, averaging and publishes carry on in between
+#define CAPTURE_INTERVAL 2000           // DHT22 minimum read interval (ms)
+#define CAPTURE_MIN_DURATION 10         // Shortest capture window (s)
+#define CAPTURE_MAX_DURATION 3600       // Longest capture window (s, ~1800 samples)
+#define CAPTURE_SHIP_GAP_MS 1000        // Spacing between sensor/capture events (cloud rate limit)
+enum CaptureState : uint8_t {
+    CAPTURE_IDLE = 0,
+    CAPTURE_SAMPLING = 1,
+    CAPTURE_SHIPPING = 2
+};
+CaptureStore captureStore;
+CaptureState captureState = CAPTURE_IDLE;
+unsigned long captureStart = 0;     // millis() the capture window opened
+unsigned long captureDuration = 0;  // Capture window length (ms)
+uint32_t captureId = 0;             // Unix time the capture started (groups its events)
+uint8_t captureShipped = 0;         // Blocks published so far
+unsigned long lastCaptureShip = 0;
+#endif
+
+// Moving Average Buffer (MovingAverage stage of the measurement pipeline)
 #define MAX_BUFFER_SIZE 360 // Maximum buffer size (3600s / 10s = 360 readings max)
-float tempBuffer[MAX_BUFFER_SIZE];
-float humidityBuffer[MAX_BUFFER_SIZE];
 int bufferSize = 30; // Default buffer size (300s / 10s = 30 readings)
-int bufferIndex = 0;
-int bufferCount = 0; // Number of valid readings in buffer
 
 // Sensor State
 float lastValidatedTemp = 0.0; // Last temperature that passed validation
 float lastValidatedHumidity = 0.0; // Last humidity that passed validation
-float lastPublishedTemp = 0.0; // Last temperature we published
-float lastPublishedHumidity = 0.0; // Last humidity we published
 bool hasValidLastReading = false; // Track if we have a valid previous reading
 bool firstRun = true;
+unsigned long lastTriggerMs = 0; // millis() of the last primary sensor read (starts a conversion, 0 = unknown)
+unsigned long dataTriggerMs = 0; // millis() the conversion returned by the last read started
+bool sensorPrimed = false; // Priming read done for the next measurement
+time_t readingTimestamp = 0; // Timestamp published with the reading (see DHT_FRESHNESS_MODE)
 
 // Cloud variables (read-only from cloud)
 String lastReading = "{}";
@@ -60,22 +241,28 @@ unsigned long shortMsgStartTime = 0; // Track when short messages started (0 = n
 double cloudTemperature = 0.0; // Cloud-accessible temperature value (moving average)
 double cloudHumidity = 0.0; // Cloud-accessible humidity value (moving average)
 int readingAge = 0; // Age of last publish in seconds
+int dataLatency = 0; // Age of the newest reading's data when it was accepted (ms)
 int bufferFillPercent = 0; // Percentage of buffer filled (for monitoring)
 String resetReason = "unknown"; // Last device reset reason
 
+#if FEATURE_DOE
 // DOE (Design of Experiments) State
 bool doeActive = false; // DOE experiment is running
 String doeStatus = "idle"; // Current DOE status
 int doeProgress = 0; // Progress percentage (0-100)
 unsigned long doeStartTime = 0; // When DOE started
+float doeTemperatureSum = 0.0; // Successful DOE reads, for the timing profile bucket
+int doeTemperatureCount = 0;
 
 // DOE Phase Results (stored as cloud-accessible JSON strings)
 String doePhase1Summary = "{}"; // Start signal phase summary
 String doePhase2Summary = "{}"; // Response timeout phase summary
 String doePhase3Summary = "{}"; // Bit timeout phase summary
 String doePhase4Summary = "{}"; // Bit threshold phase summary
+#endif
 
-// DOE Configuration
+// DOE Configuration (the parameter ranges double as the valid timing limits,
+// so this is built even without the DOE module)
 struct DOEConfig {
     // Parameter ranges for testing (in microseconds)
     uint16_t startSignalMin = 800;
@@ -99,6 +286,7 @@ struct DOEConfig {
 
 DOEConfig doeConfig;
 
+#if FEATURE_DOE
 // DOE Results
 struct DOEResult {
     uint16_t startSignal;
@@ -113,18 +301,76 @@ struct DOEResult {
 // Best result tracking (initialized with default timing parameters)
 DOEResult bestResult = {1100, 200, 100, 50, 0, 0, 0.0};
 
+// DOE Plan (compiled from the startDOE parameter)
+enum DOEFactor {
+    DOE_START_SIGNAL = 0,
+    DOE_RESPONSE_TIMEOUT = 1,
+    DOE_BIT_TIMEOUT = 2,
+    DOE_BIT_THRESHOLD = 3,
+    DOE_FACTOR_COUNT = 4
+};
+
+const char* const DOE_FACTOR_KEYS[DOE_FACTOR_COUNT] = {"ss", "rt", "bt", "bth"};
+const char* const DOE_FACTOR_NAMES[DOE_FACTOR_COUNT] = {"start_signal", "response_timeout",
+                                                        "bit_timeout", "bit_threshold"};
+
+enum DOEDesign {
+    DOE_DESIGN_OFAT = 0, // One factor at a time, each phase keeps the best value so far
+    DOE_DESIGN_FULL = 1  // Full factorial over every swept factor
+};
+
+enum DOEOrder {
+    DOE_ORDER_SEQUENTIAL = 0, // Ascending parameter order
+    DOE_ORDER_RANDOM = 1      // Shuffled within every block
+};
+
+struct DOEFactorRange {
+    uint16_t min;
+    uint16_t max;
+    uint16_t step;
+    bool swept; // false = held, at min if fixed or else at its current value
+    bool fixed; // Held at a value given in the plan
+};
+
+struct DOEPlan {
+    DOEFactorRange factors[DOE_FACTOR_COUNT];
+    DOEDesign design;
+    int readsPerConfig;
+    int stopFailures; // Abandon a configuration after this many failures (0 = never)
+    DOEOrder order;
+    int blocks;       // Rounds per phase; each round runs a short burst of every configuration
+};
+
+#define DOE_MAX_CONFIGS 48 // Configurations per phase (one shared result array)
+#define DOE_MAX_BLOCKS 10
+
+DOEPlan doePlan;
+DOEResult doeResults[DOE_MAX_CONFIGS];
+uint8_t doeBlockReads[DOE_MAX_CONFIGS][DOE_MAX_BLOCKS]; // Reads per configuration per block
+uint8_t doeBlockFails[DOE_MAX_CONFIGS][DOE_MAX_BLOCKS]; // Failures per configuration per block
+String doePlanSummary = "default"; // Compiled plan, exposed as the doePlan variable
+#endif
+
 // Function prototypes
 void takeMeasurement();
-void addToMovingAverage(float temperature, float humidity);
-float calculateMovingAverage(float* buffer, int count);
-bool shouldPublish(float avgTemp, float avgHumidity);
-void publishReading(float temperature, float humidity);
+void publishReading(float temperature, float humidity, EnvelopePriority priority);
 String createJsonPayload(float temperature, float humidity);
 String createShortPayload(float temperature, float humidity);
 void loadPublishIntervalFromEEPROM();
 void savePublishIntervalToEEPROM(int intervalSeconds);
 void loadTimingParametersFromEEPROM();
 void saveTimingParametersToEEPROM();
+void rememberBaseTiming();
+void setTimingOverride(bool active);
+void beginManualTiming();
+String baseTimingString();
+String appliedTimingString();
+void loadTimingProfilesFromEEPROM();
+bool storeTimingProfile(float temperature, TimingProfileSource source, uint16_t successRate);
+void selectTimingProfile(float temperature);
+int getProfileBucket(float temperature);
+void updateTimingProfileSummary();
+int setTimingProfile(String command);
 void updateBufferSize();
 String getResetReasonString();
 int setPublishInterval(String command);
@@ -135,16 +381,262 @@ int setResponseTimeoutTiming(String command);
 int setBitTimeoutTiming(String command);
 int setBitThresholdTiming(String command);
 int publishUptime(String command);
-
+void serviceSensorPower();
+void reportSensorHealth(bool success);
+void serviceEventEnvelope();
+#if DHT_SENSOR_COUNT > 1
+void reportSensorVote(const Sample& sample);
+#endif
+unsigned long getMeasurementInterval();
+void primeSensors();
+
+#if FEATURE_CAPTURE
+int startCapture(String command);
+void serviceCapture();
+void finishCapture();
+#endif
+
+#if FEATURE_DIAGNOSTICS
+int dumpTrace(String command);
+void serviceTraceDump();
+void updateTraceState();
+void captureCrashContext();
+void publishCrashContext();
+int setLabStream(String command);
+int runSelfBench(String command);
+void serviceLabStream();
+#endif
+
+#if FEATURE_DOE
 // DOE function prototypes
 int startDOE(String command);
 int stopDOE(String command);
 void runDOEExperiment();
 DOEResult testParameterSet(uint16_t startSignal, uint16_t responseTimeout,
-                           uint16_t bitTimeout, uint16_t bitThreshold);
+                           uint16_t bitTimeout, uint16_t bitThreshold,
+                           int reads, int stopFailures);
 void publishDOEStatus(String status);
 void publishDOEResult(DOEResult result, bool isBest);
-void publishPhaseSummary(String paramName, DOEResult* results, int resultCount);
+void publishPhaseSummary(int factor, DOEResult* results, int resultCount);
+bool compileDOEPlan(String spec, DOEPlan& plan);
+int countFactorSteps(const DOEFactorRange& range);
+int buildPhaseConfigs(const DOEPlan& plan, int phaseFactor, const DOEResult& base, DOEResult* out);
+uint16_t getFactorValue(const DOEResult& result, int factor);
+void setFactorValue(DOEResult& result, int factor, uint16_t value);
+float getBlockFailRate(DOEResult* results, int config, int block);
+#endif
+
+// Measurement pipeline (stages in SamplePipeline.h, run in order for every measurement)
+// Sites can add stages such as MedianFilter<5> (outliers), EmaSmoothing<30>,
+// DewPoint, Deadband<10> (compression) or Batch<6>; stages left out cost nothing
+struct DhtReader {
+    static bool read(float& temperature, float& humidity) {
+        runtimeContext.stage = STAGE_DHT_READ;
+        unsigned long previousTrigger = lastTriggerMs;
+        bool success = dht.read(temperature, humidity);
+        lastTriggerMs = millis();
+        dataTriggerMs = previousTrigger ? previousTrigger : lastTriggerMs;
+        Log.info("Raw values - Temp: %.2f°C, Humidity: %.2f%%, Success: %s",
+                 temperature, humidity, success ? "YES" : "NO");
+        if (!success) {
+            Log.warn("DHT22 read failed");
+        }
+        return success;
+    }
+
+    static void wait(uint32_t ms) {
+        // Wait between reads (DHT22 requirement: 2 seconds)
+        delay(ms);
+    }
+};
+
+#if DHT_SENSOR_COUNT > 1
+// Sensor i of the co-located set (0 = dht)
+struct VoteReader {
+    static bool read(uint8_t sensor, float& temperature, float& humidity) {
+        if (sensor == 0) {
+            return DhtReader::read(temperature, humidity);
+        }
+
+        // Timing profiles and DOE tune the primary sensor; the others follow it
+        SimpleDHT22& extra = dhtExtra[sensor - 1];
+        extra.setStartSignal(dht.getStartSignal());
+        extra.setResponseTimeout(dht.getResponseTimeout());
+        extra.setBitTimeout(dht.getBitTimeout());
+        extra.setBitThreshold(dht.getBitThreshold());
+
+        runtimeContext.stage = STAGE_DHT_READ;
+        bool success = extra.read(temperature, humidity);
+        Log.info("Sensor %d raw values - Temp: %.2f°C, Humidity: %.2f%%, Success: %s",
+                 sensor + 1, temperature, humidity, success ? "YES" : "NO");
+        return success;
+    }
+};
+#endif
+
+#if FEATURE_CAPTURE
+// Sample taken during a capture window (capture reads and regular measurements)
+struct CaptureSink {
+    static bool emit(const Sample& sample) {
+        // Same backdating as the published readings (see DHT_FRESHNESS_MODE)
+        time_t timestamp = Time.now();
+        if (DHT_FRESHNESS_MODE != FRESHNESS_LEGACY) {
+            timestamp -= (millis() - dataTriggerMs + 500) / 1000;
+        }
+        if (!captureStore.add(timestamp, sample.temperature, sample.humidity)) {
+            Log.warn("Capture store full, ending capture early");
+            finishCapture();
+            return false;
+        }
+        return true;
+    }
+};
+#endif
+
+// Reading passed validation
+struct AcceptedReading {
+    static void observe(const Sample& sample) {
+        runtimeContext.stage = STAGE_MEASURE;
+
+        if (sample.attempts > 1) {
+            Log.info("Retry read succeeded!");
+        }
+        if (sample.flags & SAMPLE_JUMP) {
+            Log.warn("Temperature jump detected from %.2f°C, re-read once", lastValidatedTemp);
+            if (sample.flags & SAMPLE_REREAD_FAILED) {
+                Log.warn("Retry read failed, accepting original reading");
+            } else if (sample.flags & SAMPLE_JUMP_PERSISTED) {
+                Log.warn("Retry still shows large jump (%.2f°C), accepting anyway", sample.temperature);
+            } else {
+                Log.info("Retry reading is valid, using it");
+            }
+        }
+
+        trace.record(TRACE_READ_OK, sample.attempts, (int16_t)(sample.temperature * 10), (int32_t)(sample.humidity * 10));
+        reportSensorHealth(true);
+
+        // Step change: restart the burst window (extends an active burst)
+        if (sample.flags & SAMPLE_CHANGE) {
+            bool rise = sample.flags & SAMPLE_CHANGE_UP;
+            Log.warn("Step change detected (%s to %.2f°C), sampling every %lu s",
+                     rise ? "rise" : "fall", sample.temperature, CHANGE_BURST_INTERVAL / 1000);
+            trace.record(TRACE_CHANGE_POINT, rise ? 1 : 0, (int16_t)(sample.temperature * 10));
+            changeBurstActive = true;
+            changeBurstStart = millis();
+        }
+
+        // The data was converted when the previous read triggered the sensor
+        dataLatency = millis() - dataTriggerMs;
+        readingTimestamp = Time.now();
+        if (DHT_FRESHNESS_MODE != FRESHNESS_LEGACY) {
+            readingTimestamp -= (dataLatency + 500) / 1000;
+        }
+
+#if FEATURE_CAPTURE
+        if (captureState == CAPTURE_SAMPLING) {
+            CaptureSink::emit(sample);
+        }
+#endif
+
+        // Store validated reading
+        hasValidLastReading = true;
+        lastValidatedTemp = sample.temperature;
+        lastValidatedHumidity = sample.humidity;
+    }
+};
+
+// Moving average updated
+struct AveragedReading {
+    static void observe(const Sample& sample) {
+        // Update cloud variables with moving averages
+        cloudTemperature = sample.avgTemperature;
+        cloudHumidity = sample.avgHumidity;
+
+        // Log measurement results
+        Log.info("Reading successful!");
+        Log.info("  Temperature: %.2f°C (%.2f°F)", sample.temperature, sample.temperature * 9.0 / 5.0 + 32.0);
+        Log.info("  Humidity: %.2f%%", sample.humidity);
+        Log.info("  Moving avg temp: %.2f°C, humidity: %.2f%%", sample.avgTemperature, sample.avgHumidity);
+    }
+};
+
+#if FEATURE_PUBLISHING
+// Sample passed the publish gate
+struct ReadingPublisher {
+    static bool emit(const Sample& sample) {
+        switch (sample.publishReason) {
+            case PUBLISH_FIRST:
+                Log.info("Publishing first reading");
+                break;
+            case PUBLISH_INTERVAL:
+                Log.info("Publishing: 60 minutes elapsed");
+                break;
+            case PUBLISH_CHANGE_POINT:
+                Log.info("Publishing: step change to %.2f°C", sample.avgTemperature);
+                break;
+            default:
+                Log.info("Publishing: temp changed to %.2f°C (>= 0.5°C)", sample.avgTemperature);
+                break;
+        }
+
+        // Update last reading JSON
+        lastReading = createJsonPayload(sample.avgTemperature, sample.avgHumidity);
+
+        // Check if short message should be disabled (after 1 hour)
+        if (shortMsgEnabled && shortMsgStartTime > 0) {
+            unsigned long elapsed = Time.now() - shortMsgStartTime;
+            if (elapsed >= 3600) {  // 3600 seconds = 1 hour
+                shortMsgEnabled = false;
+                Log.info("Short message disabled after 1 hour");
+                if (Particle.connected()) {
+                    bool ok = eventEnvelope.post("sensor/info", "Short messages disabled", ENVELOPE_LOW);
+                    trace.record(TRACE_PUBLISH, TRACE_PUB_INFO, ok);
+                }
+            }
+        }
+
+        runtimeContext.stage = STAGE_PUBLISH;
+        publishReading(sample.avgTemperature, sample.avgHumidity,
+                       sample.publishReason == PUBLISH_CHANGE_POINT ? ENVELOPE_URGENT : ENVELOPE_NORMAL);
+        lastPublishTime = sample.time;
+        return true;
+    }
+};
+#endif
+
+#if DHT_SENSOR_COUNT > 1
+typedef SensorVote<VoteReader, DHT_SENSOR_COUNT, 0, 5> SensorVoting;  // Median, 0.5°C drift limit
+#endif
+
+typedef SamplePipeline<
+#if DHT_SENSOR_COUNT > 1
+    SensorVoting,                       // Median of the co-located sensors (no re-reads)
+#else
+    RetryAcquire<DhtReader, 1, 2000>,   // One retry, 2 s apart (DHT22 requirement)
+    JumpCheck<DhtReader, 10, 2000>,     // Re-read once on a > 1.0°C jump
+#endif
+    ChangeDetector<15, 10, 5>,          // Step changes: 0.15°C slack, 1.0°C CUSUM threshold
+    Tap<AcceptedReading>,
+    MovingAverage<MAX_BUFFER_SIZE>,
+    Tap<AveragedReading>
+#if FEATURE_PUBLISHING
+    , PublishGate<50, 3600>             // First reading, >= 0.5°C change, or 60 minutes
+    , Emit<ReadingPublisher>
+#endif
+> MeasurementPipeline;
+
+MeasurementPipeline measurementPipeline;
+
+#if FEATURE_CAPTURE
+// Capture reads between measurements: primary sensor, single attempt, range check only
+typedef SamplePipeline<
+    RetryAcquire<DhtReader, 0, 0>,
+    RangeCheck,
+    Emit<CaptureSink>
+> CapturePipeline;
+
+CapturePipeline capturePipeline;
+#endif
 
 // Get human-readable reset reason string
 String getResetReasonString() {
@@ -196,39 +688,79 @@ void setup() {
     // Register cloud functions (must be done in setup before cloud connects)
     Particle.function("setInterval", setPublishInterval);
     Particle.function("forceReading", forceReading);
+#if FEATURE_PUBLISHING
     Particle.function("enableShort", enableShortMsg);
+#endif
+#if FEATURE_DOE
     Particle.function("startDOE", startDOE);
     Particle.function("stopDOE", stopDOE);
+#endif
     Particle.function("setStartSig", setStartSignalTiming);
     Particle.function("setRespTO", setResponseTimeoutTiming);
     Particle.function("setBitTO", setBitTimeoutTiming);
     Particle.function("setBitThr", setBitThresholdTiming);
     Particle.function("uptime", publishUptime);
+#if FEATURE_CAPTURE
+    Particle.function("capture", startCapture);
+#endif
+#if FEATURE_DIAGNOSTICS
+    Particle.function("dumpTrace", dumpTrace);
+    Particle.function("labStream", setLabStream);
+    Particle.function("selfbench", runSelfBench);
+#endif
+    Particle.function("setProfile", setTimingProfile);
 
     // Register cloud variables
     Particle.variable("lastReading", lastReading);
     Particle.variable("publishSec", currentPublishInterval);
+#if FEATURE_PUBLISHING
     Particle.variable("shortMsg", shortMsgEnabled);
+#endif
     Particle.variable("temperature", cloudTemperature);
     Particle.variable("humidity", cloudHumidity);
     Particle.variable("readingAge", readingAge);
+    Particle.variable("dataLatency", dataLatency);
     Particle.variable("bufferFill", bufferFillPercent);
     Particle.variable("resetReason", resetReason);
+#if FEATURE_DOE
     Particle.variable("doeStatus", doeStatus);
     Particle.variable("doeProgress", doeProgress);
     Particle.variable("doePhase1", doePhase1Summary);
     Particle.variable("doePhase2", doePhase2Summary);
     Particle.variable("doePhase3", doePhase3Summary);
     Particle.variable("doePhase4", doePhase4Summary);
+    Particle.variable("doePlan", doePlanSummary);
+#endif
+    Particle.variable("timingProfiles", timingProfileSummary);
+    Particle.variable("timing", baseTimingString);
+    Particle.variable("appliedTiming", appliedTimingString);
 
     // Read and store the last reset reason
     resetReason = getResetReasonString();
 
-    // Initialize DHT sensor
+#if FEATURE_DIAGNOSTICS
+    // Preserve the previous boot's runtime context if it ended in a panic or watchdog reset
+    captureCrashContext();
+#endif
+
+    // Start flight recorder and log the reset that brought us here
+    trace.begin();
+    trace.record(TRACE_BOOT, 0, (int16_t)System.resetReason(), (int32_t)System.resetReasonData());
+
+    // Initialize DHT sensor (protocol steps land in retained memory)
+    dht.setStepTracker(&runtimeContext.dhtStep);
+    dht.setPowerPin(DHT_POWER_PIN);
     dht.begin();
+#if DHT_SENSOR_COUNT > 1
+    for (SimpleDHT22& extra : dhtExtra) {
+        extra.begin();
+    }
+#endif
 
     // Load saved timing parameters from EEPROM
     loadTimingParametersFromEEPROM();
+    rememberBaseTiming();
+    loadTimingProfilesFromEEPROM();
 
     // Wait for sensor to stabilize
     delay(2000);
@@ -252,6 +784,11 @@ void setup() {
         Log.warn("Cloud not connected");
     }
 
+#if FEATURE_DIAGNOSTICS
+    // Report why the last boot ended (retried from loop if not connected)
+    publishCrashContext();
+#endif
+
     // Initialize publish timer
     lastPublishTime = Time.now();
 
@@ -260,162 +797,215 @@ void setup() {
 }
 
 void loop() {
+    runtimeContext.loopCount++;
+
+#if FEATURE_DIAGNOSTICS
+    if (crashContextPending) {
+        publishCrashContext();
+    }
+
+    // Send the next chunk of a queued trace dump
+    serviceTraceDump();
+#endif
+
+    // Publish coalesced events once their window has passed
+    serviceEventEnvelope();
+
+#if FEATURE_DOE
     // If DOE experiment is active, run it instead of normal measurements
     if (doeActive) {
+        runtimeContext.stage = STAGE_DOE;
         runDOEExperiment();
         // DOE will set doeActive to false when complete
         return;
     }
+#endif
+
+#if FEATURE_DIAGNOSTICS
+    // Lab streaming replaces normal measurements while active
+    serviceLabStream();
+    if (labStreamActive) {
+        delay(10);
+        return;
+    }
+#endif
 
-    // Check if it's time for a measurement (every 10 seconds)
-    if (millis() - lastMeasurement >= MEASUREMENT_INTERVAL || firstRun) {
+    // Advance sensor recovery and power gating
+    serviceSensorPower();
+
+    // Priming read ahead of the measurement (not needed during a burst: reads are 2 s apart)
+    if (DHT_FRESHNESS_MODE == FRESHNESS_PRIME && !sensorPrimed && !changeBurstActive &&
+        sensorRecovery.readAllowed() && dht.isPowered() &&
+        millis() - lastMeasurement + DHT_PRIME_LEAD_MS >= getMeasurementInterval()) {
+        primeSensors();
+    }
+
+    // Check if it's time for a measurement (every 10 seconds, 2 seconds during a step-change burst)
+    if (sensorRecovery.readAllowed() &&
+        (millis() - lastMeasurement >= getMeasurementInterval() || firstRun)) {
         takeMeasurement();
         lastMeasurement = millis();
         firstRun = false;
+        sensorPrimed = false;
     }
 
+#if FEATURE_CAPTURE
+    // Capture reads between measurements, then ship the capture
+    serviceCapture();
+#endif
+
     // Update reading age (time since last publish)
     if (lastPublishTime > 0) {
         readingAge = Time.now() - lastPublishTime;
     }
 
+#if FEATURE_DIAGNOSTICS
+    // Record connectivity transitions and write staged trace records
+    runtimeContext.stage = STAGE_TRACE_FLUSH;
+    updateTraceState();
+#endif
+
     // Allow system to process cloud events
+    runtimeContext.stage = STAGE_IDLE;
     delay(100);
 }
 
-void takeMeasurement() {
-    Log.info("--- Taking Measurement ---");
-
-    float temperature = 0;
-    float humidity = 0;
-
-    // Read from DHT sensor using custom library
-    bool success = dht.read(temperature, humidity);
-
-    // Debug output
-    Log.info("Raw values - Temp: %.2f°C, Humidity: %.2f%%, Success: %s",
-                    temperature, humidity, success ? "YES" : "NO");
+#if DHT_SENSOR_COUNT > 1
+// Report sensors that start or stop drifting away from the others
+void reportSensorVote(const Sample& sample) {
+    static uint8_t lastSuspect = 0;
 
-    // Check if reading was successful - retry once if failed
-    if (!success) {
-        Log.warn("Initial DHT22 read failed, retrying once...");
-
-        // Wait 2 seconds before retry (DHT22 requirement)
-        delay(2000);
-
-        // Retry reading
-        success = dht.read(temperature, humidity);
-        Log.info("Retry values - Temp: %.2f°C, Humidity: %.2f%%, Success: %s",
-                        temperature, humidity, success ? "YES" : "NO");
+    Log.info("  Vote: %d/%d sensors answered", sample.sensors, DHT_SENSOR_COUNT);
+    uint8_t changed = sample.suspectSensors ^ lastSuspect;
+    lastSuspect = sample.suspectSensors;
+    if (!changed) {
+        return;
+    }
 
-        if (!success) {
-            Log.error("DHT22 read failed after retry!");
-            Log.info("Troubleshooting:");
-            Log.info("  - Add 10kΩ resistor between DATA (D3) and 3V3");
-            Log.info("  - Check wiring: DHT22 DATA -> D3");
-            Log.info("  - Verify DHT22 has power (3.3V)");
-            Log.info("  - Verify DHT22 GND is connected");
-            Log.info("  - Ensure proper DHT22 sensor (not DHT11)");
-            Log.info("  - Try different pin (D2, D4, D5)");
-
-            // Publish error status (only if connected)
-            if (Particle.connected()) {
-                Particle.publish("sensor/error", "DHT22 read failed", PRIVATE);
-            }
-            return;
+    SensorVoting& vote = measurementPipeline.stage<SensorVoting>();
+    for (uint8_t i = 0; i < DHT_SENSOR_COUNT; i++) {
+        if (!(changed & (1 << i))) {
+            continue;
+        }
+        bool suspect = sample.suspectSensors & (1 << i);
+        char msg[96];
+        snprintf(msg, sizeof(msg), "{\"sensor\":%d,\"residual\":%.2f,\"excluded\":%s}",
+                 i + 1, vote.residual[i], suspect ? "true" : "false");
+        if (suspect) {
+            Log.warn("Sensor %d drifting (%.2f°C from consensus), left out of the vote", i + 1, vote.residual[i]);
         } else {
-            Log.info("Retry read succeeded!");
+            Log.info("Sensor %d back within limits, voting again", i + 1);
         }
+        eventEnvelope.post("sensor/drift", msg);
+    }
+}
+#endif
+
+// Throwaway read that starts a fresh conversion for the next measurement to return
+void primeSensors() {
+    runtimeContext.stage = STAGE_DHT_READ;
+    float temperature, humidity;
+    dht.read(temperature, humidity);
+    lastTriggerMs = millis();
+#if DHT_SENSOR_COUNT > 1
+    for (SimpleDHT22& extra : dhtExtra) {
+        extra.read(temperature, humidity);
     }
+#endif
+    sensorPrimed = true;
+    runtimeContext.stage = STAGE_IDLE;
+}
 
-    // Validate temperature jump (only if we have a previous reading)
-    if (hasValidLastReading) {
-        float tempDiff = abs(temperature - lastValidatedTemp);
-        if (tempDiff > 1.0) {
-            Log.warn("Temperature jump detected: %.2f°C -> %.2f°C (diff: %.2f°C)",
-                     lastValidatedTemp, temperature, tempDiff);
-            Log.warn("Discarding and re-reading once...");
-
-            // Wait 2 seconds (DHT22 requirement)
-            delay(2000);
-
-            // Retry reading once
-            float retryTemp = 0;
-            float retryHumidity = 0;
-            bool retrySuccess = dht.read(retryTemp, retryHumidity);
-
-            if (retrySuccess) {
-                float retryDiff = abs(retryTemp - lastValidatedTemp);
-                Log.info("Retry read: %.2f°C (diff from last: %.2f°C)", retryTemp, retryDiff);
-
-                if (retryDiff <= 1.0) {
-                    // Retry reading is valid, use it
-                    Log.info("Retry reading is valid, using it");
-                    temperature = retryTemp;
-                    humidity = retryHumidity;
-                } else {
-                    // Both readings show large jump, accept the retry value
-                    Log.warn("Retry still shows large jump (%.2f°C), accepting anyway", retryDiff);
-                    temperature = retryTemp;
-                    humidity = retryHumidity;
-                }
-            } else {
-                // Retry failed, accept original reading
-                Log.warn("Retry read failed, accepting original reading");
-            }
-        }
+// Sampling interval: burst rate for a while after a detected step change
+unsigned long getMeasurementInterval() {
+    if (changeBurstActive && millis() - changeBurstStart >= CHANGE_BURST_DURATION) {
+        changeBurstActive = false;
+        Log.info("Step-change burst ended, back to %lu s sampling", MEASUREMENT_INTERVAL / 1000);
     }
+    return changeBurstActive ? CHANGE_BURST_INTERVAL : MEASUREMENT_INTERVAL;
+}
 
-    // Store validated reading
-    hasValidLastReading = true;
-    lastValidatedTemp = temperature;
-    lastValidatedHumidity = humidity;
+// Publish the event envelope when due and keep its depth in the runtime context
+void serviceEventEnvelope() {
+    if (eventEnvelope.service()) {
+        trace.record(TRACE_PUBLISH, TRACE_PUB_ENVELOPE, 1);
+    }
+    runtimeContext.pendingEvents = eventEnvelope.getPending();
+}
 
-    // Add to moving average buffer
-    addToMovingAverage(temperature, humidity);
+void takeMeasurement() {
+    Log.info("--- Taking Measurement ---");
+    runtimeContext.stage = STAGE_MEASURE;
+    runtimeContext.freeMemory = System.freeMemory();
+    runtimeContext.uptime = System.uptime();
+
+    // Sensor may be gated off (e.g. forced reading between samples)
+    if (!dht.isPowered()) {
+        dht.powerOn();
+        delay(DHT_POWER_SETTLE_MS);
+    }
 
-    // Calculate moving averages
-    float avgTemp = calculateMovingAverage(tempBuffer, bufferCount);
-    float avgHumidity = calculateMovingAverage(humidityBuffer, bufferCount);
+    // Timing for the current temperature (base timing until the first reading)
+    if (hasValidLastReading) {
+        selectTimingProfile(lastValidatedTemp);
+    } else if (timingProfileDirty) {
+        selectTimingProfile(NAN);
+    }
+    if (activeBucket >= 0) {
+        profileReads[activeBucket]++;
+    }
 
-    // Update cloud variables with moving averages
-    cloudTemperature = avgTemp;
-    cloudHumidity = avgHumidity;
+    // Acquire, validate, aggregate and publish (see MeasurementPipeline)
+    Sample sample;
+    sample.time = Time.now();
+    measurementPipeline.process(sample);
+    runtimeContext.stage = STAGE_MEASURE;
+
+    if (!sample.valid) {
+        Log.error("DHT22 read failed after retry!");
+        Log.info("Troubleshooting:");
+        Log.info("  - Add 10kΩ resistor between DATA (D3) and 3V3");
+        Log.info("  - Check wiring: DHT22 DATA -> D3");
+        Log.info("  - Verify DHT22 has power (3.3V)");
+        Log.info("  - Verify DHT22 GND is connected");
+        Log.info("  - Ensure proper DHT22 sensor (not DHT11)");
+        Log.info("  - Try different pin (D2, D4, D5)");
+
+        trace.record(TRACE_READ_FAIL, sample.attempts);
+        reportSensorHealth(false);
+        if (activeBucket >= 0) {
+            profileFails[activeBucket]++;
+        }
 
-    // Log measurement results
-    Log.info("Reading successful!");
-    Log.info("  Temperature: %.2f°C (%.2f°F)", temperature, temperature * 9.0 / 5.0 + 32.0);
-    Log.info("  Humidity: %.2f%%", humidity);
-    Log.info("  Moving avg temp: %.2f°C, humidity: %.2f%%", avgTemp, avgHumidity);
-    Log.info("  Buffer: %d/%d readings (%.0f%% full)", bufferCount, bufferSize, bufferFillPercent);
+        // Publish error status (only if connected)
+        if (Particle.connected()) {
+            bool ok = eventEnvelope.post("sensor/error", "DHT22 read failed");
+            trace.record(TRACE_PUBLISH, TRACE_PUB_ERROR, ok);
+        }
+        trace.flush(true);  // Failures are what post-mortems look for
+        return;
+    }
 
-    // Check if we should publish
-    if (shouldPublish(avgTemp, avgHumidity)) {
-        // Update last reading JSON
-        lastReading = createJsonPayload(avgTemp, avgHumidity);
+#if DHT_SENSOR_COUNT > 1
+    reportSensorVote(sample);
+#endif
 
-        // Check if short message should be disabled (after 1 hour)
-        if (shortMsgEnabled && shortMsgStartTime > 0) {
-            unsigned long elapsed = Time.now() - shortMsgStartTime;
-            if (elapsed >= 3600) {  // 3600 seconds = 1 hour
-                shortMsgEnabled = false;
-                Log.info("Short message disabled after 1 hour");
-                if (Particle.connected()) {
-                    Particle.publish("sensor/info", "Short messages disabled", PRIVATE);
-                }
-            }
-        }
+    MovingAverage<MAX_BUFFER_SIZE>& average = measurementPipeline.stage<MovingAverage<MAX_BUFFER_SIZE>>();
+    bufferFillPercent = (average.getCount() * 100) / average.getSize();
+    Log.info("  Buffer: %d/%d readings (%d%% full)", (int)average.getCount(), (int)average.getSize(), bufferFillPercent);
 
-        publishReading(avgTemp, avgHumidity);
-        lastPublishedTemp = avgTemp;
-        lastPublishedHumidity = avgHumidity;
-        lastPublishTime = Time.now();
-    } else {
+#if FEATURE_PUBLISHING
+    if (sample.publishReason == PUBLISH_NONE) {
         Log.info("Skipping publish (no significant change)");
     }
+#else
+    // Publishing module not built: readings are pulled through the cloud variables
+    lastReading = createJsonPayload(sample.avgTemperature, sample.avgHumidity);
+#endif
 }
 
-void publishReading(float temperature, float humidity) {
+#if FEATURE_PUBLISHING
+void publishReading(float temperature, float humidity, EnvelopePriority priority) {
     // Check cloud connection before publishing
     if (!Particle.connected()) {
         Log.warn("Not connected to cloud, skipping publish");
@@ -424,7 +1014,8 @@ void publishReading(float temperature, float humidity) {
 
     // Always publish JSON format for InfluxDB/Grafana
     String jsonData = createJsonPayload(temperature, humidity);
-    bool jsonSuccess = Particle.publish("sensor/reading", jsonData, PRIVATE);
+    bool jsonSuccess = eventEnvelope.post("sensor/reading", jsonData.c_str(), priority);
+    trace.record(TRACE_PUBLISH, TRACE_PUB_READING, jsonSuccess);
 
     if (jsonSuccess) {
         Log.info("JSON reading published successfully");
@@ -435,7 +1026,8 @@ void publishReading(float temperature, float humidity) {
     // Additionally publish short message if enabled (within 1 hour)
     if (shortMsgEnabled) {
         String shortData = createShortPayload(temperature, humidity);
-        bool shortSuccess = Particle.publish("sensor/short", shortData, PRIVATE);
+        bool shortSuccess = eventEnvelope.post("sensor/short", shortData.c_str(), priority);
+        trace.record(TRACE_PUBLISH, TRACE_PUB_SHORT, shortSuccess);
 
         if (shortSuccess) {
             Log.info("Short message published: %s", shortData.c_str());
@@ -444,10 +1036,11 @@ void publishReading(float temperature, float humidity) {
         }
     }
 }
+#endif
 
 String createJsonPayload(float temperature, float humidity) {
     // Create InfluxDB-compatible JSON format using JSONBufferWriter
-    // Format: {"measurement":"environment","tags":{"location":"default","device":"boron"},"fields":{"temperature":23.5,"humidity":45.2},"timestamp":1234567890}
+    // Format: {"measurement":"environment","tags":{"location":"default","device":"boron"},"fields":{"temperature":23.5,"humidity":45.2,"latency":2.0},"timestamp":1234567890}
 
     char buffer[256];
     memset(buffer, 0, sizeof(buffer));  // Zero out buffer first
@@ -464,9 +1057,10 @@ String createJsonPayload(float temperature, float humidity) {
         writer.name("fields").beginObject();
             writer.name("temperature").value(temperature, 2);
             writer.name("humidity").value(humidity, 2);
+            writer.name("latency").value(dataLatency / 1000.0, 1);
         writer.endObject();
 
-        writer.name("timestamp").value(Time.now());
+        writer.name("timestamp").value(readingTimestamp ? readingTimestamp : Time.now());
     writer.endObject();
 
     // Ensure null termination
@@ -475,6 +1069,7 @@ String createJsonPayload(float temperature, float humidity) {
     return String(writer.buffer());
 }
 
+#if FEATURE_PUBLISHING
 String createShortPayload(float temperature, float humidity) {
     // Create short human-readable format (20 characters or less)
     // Format: "23.5C 45.6%" (max 13 chars for this format)
@@ -482,64 +1077,7 @@ String createShortPayload(float temperature, float humidity) {
     snprintf(shortBuffer, sizeof(shortBuffer), "%.1fC %.1f%%", temperature, humidity);
     return String(shortBuffer);
 }
-
-// Add reading to moving average buffer
-void addToMovingAverage(float temperature, float humidity) {
-    // Add to circular buffer
-    tempBuffer[bufferIndex] = temperature;
-    humidityBuffer[bufferIndex] = humidity;
-
-    // Update index (circular buffer)
-    bufferIndex = (bufferIndex + 1) % bufferSize;
-
-    // Update count (up to bufferSize)
-    if (bufferCount < bufferSize) {
-        bufferCount++;
-    }
-
-    // Update buffer fill percentage
-    bufferFillPercent = (bufferCount * 100) / bufferSize;
-}
-
-// Calculate moving average from buffer
-float calculateMovingAverage(float* buffer, int count) {
-    if (count == 0) return 0.0;
-
-    float sum = 0.0;
-    for (int i = 0; i < count; i++) {
-        sum += buffer[i];
-    }
-    return sum / count;
-}
-
-// Determine if we should publish based on temperature change or time elapsed
-bool shouldPublish(float avgTemp, float avgHumidity) {
-    // Always publish the first reading
-    if (lastPublishTime == 0) {
-        Log.info("Publishing first reading");
-        return true;
-    }
-
-    // Calculate time since last publish
-    unsigned long timeSincePublish = Time.now() - lastPublishTime;
-
-    // Check if 60 minutes has elapsed (force publish)
-    if (timeSincePublish >= 3600) {
-        Log.info("Publishing: 60 minutes elapsed (%lu >= 3600 seconds)",
-                 timeSincePublish);
-        return true;
-    }
-
-    // Check if temperature changed by >= 0.5°C
-    float tempChange = abs(avgTemp - lastPublishedTemp);
-    if (tempChange >= 0.5) {
-        Log.info("Publishing: temp changed %.2f°C (>= 0.5°C)", tempChange);
-        return true;
-    }
-
-    // No significant change
-    return false;
-}
+#endif
 
 // Load publish interval from EEPROM
 void loadPublishIntervalFromEEPROM() {
@@ -589,7 +1127,9 @@ void updateBufferSize() {
     if (newBufferSize > MAX_BUFFER_SIZE) newBufferSize = MAX_BUFFER_SIZE;
 
     bufferSize = newBufferSize;
-    bufferFillPercent = (bufferCount * 100) / bufferSize;
+    MovingAverage<MAX_BUFFER_SIZE>& average = measurementPipeline.stage<MovingAverage<MAX_BUFFER_SIZE>>();
+    average.setSize(bufferSize);
+    bufferFillPercent = (average.getCount() * 100) / bufferSize;
 
     Log.info("Buffer size updated to %d readings", bufferSize);
 }
@@ -614,7 +1154,8 @@ int setPublishInterval(String command) {
     savePublishIntervalToEEPROM(newInterval);
 
     Log.info("Publish interval updated to %d seconds", newInterval);
-    Particle.publish("config/interval", String(newInterval), PRIVATE);
+    trace.record(TRACE_CONFIG, TRACE_CFG_INTERVAL, 0, newInterval);
+    eventEnvelope.post("config/interval", String(newInterval).c_str(), ENVELOPE_LOW);
 
     return newInterval;
 }
@@ -622,10 +1163,121 @@ int setPublishInterval(String command) {
 // Cloud function to force an immediate reading
 int forceReading(String command) {
     Log.info("Force reading requested from cloud");
+    runtimeContext.stage = STAGE_CLOUD_FUNCTION;
     takeMeasurement();
     return 1;
 }
 
+#if FEATURE_CAPTURE
+// ====================================================================
+// Burst Capture Functions
+// ====================================================================
+
+// Cloud function to capture 2 s samples for a while ("<seconds>", 10-3600)
+// "stop" ends the window early; the samples are shipped as sensor/capture events either way
+// Returns the window length in seconds (samples captured for "stop"), -1 on error
+int startCapture(String command) {
+    runtimeContext.stage = STAGE_CLOUD_FUNCTION;
+
+    if (command == "stop") {
+        if (captureState != CAPTURE_SAMPLING) {
+            return -1;
+        }
+        finishCapture();
+        return captureStore.getSamples();
+    }
+
+    int seconds = command.toInt();
+    if (seconds < CAPTURE_MIN_DURATION || seconds > CAPTURE_MAX_DURATION) {
+        Log.warn("Invalid capture duration: %d (must be %d-%d seconds)",
+                 seconds, CAPTURE_MIN_DURATION, CAPTURE_MAX_DURATION);
+        return -1;
+    }
+    if (captureState == CAPTURE_SHIPPING) {
+        Log.warn("Previous capture still being published");
+        return -1;
+    }
+#if FEATURE_DOE
+    if (doeActive) {
+        Log.warn("Cannot capture while DOE is running");
+        return -1;
+    }
+#endif
+#if FEATURE_DIAGNOSTICS
+    if (labStreamActive) {
+        Log.warn("Cannot capture while lab streaming");
+        return -1;
+    }
+#endif
+
+    // A running capture keeps its samples and gets a new window from now
+    if (captureState == CAPTURE_IDLE) {
+        captureStore.clear();
+        captureId = Time.now();
+        captureState = CAPTURE_SAMPLING;
+    }
+    captureStart = millis();
+    captureDuration = seconds * 1000UL;
+
+    if (!dht.isPowered() && sensorRecovery.readAllowed()) {
+        dht.powerOn();
+        delay(DHT_POWER_SETTLE_MS);
+    }
+
+    Log.info("Capture %lu: sampling every %d s for %d s", (unsigned long)captureId,
+             CAPTURE_INTERVAL / 1000, seconds);
+    return seconds;
+}
+
+// Capture read when the sensor is free until the next measurement, publish blocks afterwards
+void serviceCapture() {
+    if (captureState == CAPTURE_SAMPLING) {
+        if (millis() - captureStart >= captureDuration) {
+            finishCapture();
+        } else if (sensorRecovery.readAllowed() && dht.isPowered() &&
+                   millis() - lastTriggerMs >= CAPTURE_INTERVAL &&
+                   millis() - lastMeasurement + CAPTURE_INTERVAL <= getMeasurementInterval()) {
+            Sample sample;
+            sample.time = Time.now();
+            capturePipeline.process(sample);
+            sensorPrimed = true;  // The read started a fresh conversion for the next measurement
+        }
+        return;
+    }
+
+    if (captureState != CAPTURE_SHIPPING || !Particle.connected() ||
+        millis() - lastCaptureShip < CAPTURE_SHIP_GAP_MS) {
+        return;
+    }
+    lastCaptureShip = millis();
+
+    char block[(CaptureStore::BLOCK_BYTES + 2) / 3 * 4 + 1];
+    char msg[ENVELOPE_MAX_DATA + 1];
+    captureStore.encodeBlock(captureShipped, block, sizeof(block));
+    snprintf(msg, sizeof(msg), "{\"id\":%lu,\"part\":%d,\"parts\":%d,\"n\":%u,\"d\":\"%s\"}",
+             (unsigned long)captureId, captureShipped + 1, captureStore.getBlocks(),
+             captureStore.getBlockSamples(captureShipped), block);
+    if (!eventEnvelope.post("sensor/capture", msg, ENVELOPE_URGENT)) {
+        return;  // Retried after the gap
+    }
+
+    captureShipped++;
+    if (captureShipped >= captureStore.getBlocks()) {
+        Log.info("Capture %lu published", (unsigned long)captureId);
+        captureState = CAPTURE_IDLE;
+    }
+}
+
+// Close the capture window and queue its blocks for publishing
+void finishCapture() {
+    Log.info("Capture %lu complete: %u samples in %u bytes, %u event(s)", (unsigned long)captureId,
+             captureStore.getSamples(), captureStore.getBytes(), captureStore.getBlocks());
+    captureShipped = 0;
+    captureState = captureStore.getBlocks() > 0 ? CAPTURE_SHIPPING : CAPTURE_IDLE;
+}
+#endif
+
+#if FEATURE_PUBLISHING
 // Cloud function to enable/disable short messages
 int enableShortMsg(String command) {
     // Parse command: empty, "1", or no input = enable, "0" = disable
@@ -641,19 +1293,24 @@ int enableShortMsg(String command) {
         shortMsgEnabled = true;
         shortMsgStartTime = Time.now();
         Log.info("Short messages enabled");
-        Particle.publish("config/shortmsg", "enabled", PRIVATE);
+        trace.record(TRACE_CONFIG, TRACE_CFG_SHORT_MSG, 0, 1);
+        eventEnvelope.post("config/shortmsg", "enabled", ENVELOPE_LOW);
         return 1;
     } else {
         // Disable short messages
         shortMsgEnabled = false;
         Log.info("Short messages disabled");
-        Particle.publish("config/shortmsg", "disabled", PRIVATE);
+        trace.record(TRACE_CONFIG, TRACE_CFG_SHORT_MSG, 0, 0);
+        eventEnvelope.post("config/shortmsg", "disabled", ENVELOPE_LOW);
         return 0;
     }
 }
+#endif
 
 // Cloud function to publish system uptime
 int publishUptime(String command) {
+    runtimeContext.stage = STAGE_CLOUD_FUNCTION;
+
     // Get system uptime in seconds
     system_tick_t uptimeSeconds = System.uptime();
 
@@ -663,45 +1320,432 @@ int publishUptime(String command) {
     uint32_t minutes = (uptimeSeconds % 3600) / 60;
     uint32_t seconds = uptimeSeconds % 60;
 
-    // Get current time
-    String currentTime = Time.format(Time.now(), "%H:%M:%S");
+    // Get current time
+    String currentTime = Time.format(Time.now(), "%H:%M:%S");
+
+    // Get free memory
+    uint32_t freeMem = System.freeMemory();
+
+    // Get cloud connection status
+    String cloudStatus = Particle.connected() ? "connected" : "disconnected";
+
+    // Format uptime string similar to Linux uptime command
+    // Example: "10:15:23 up 5 days, 3:42, cloud: connected, free mem: 45632 bytes"
+    char uptimeMsg[256];
+
+    if (days > 0) {
+        snprintf(uptimeMsg, sizeof(uptimeMsg),
+                 "%s up %lu day%s, %lu:%02lu, cloud: %s, free mem: %lu bytes",
+                 currentTime.c_str(), days, (days == 1 ? "" : "s"),
+                 hours, minutes, cloudStatus.c_str(), freeMem);
+    } else if (hours > 0) {
+        snprintf(uptimeMsg, sizeof(uptimeMsg),
+                 "%s up %lu:%02lu, cloud: %s, free mem: %lu bytes",
+                 currentTime.c_str(), hours, minutes, cloudStatus.c_str(), freeMem);
+    } else {
+        snprintf(uptimeMsg, sizeof(uptimeMsg),
+                 "%s up %lu min, cloud: %s, free mem: %lu bytes",
+                 currentTime.c_str(), minutes, cloudStatus.c_str(), freeMem);
+    }
+
+    // Publish to cloud
+    if (Particle.connected()) {
+        bool ok = eventEnvelope.post("system/uptime", uptimeMsg);
+        trace.record(TRACE_PUBLISH, TRACE_PUB_SYSTEM, ok);
+    }
+
+    // Log locally
+    Log.info("Uptime: %s", uptimeMsg);
+
+    return 1;
+}
+
+#if FEATURE_DIAGNOSTICS
+// ====================================================================
+// Flight Recorder Functions
+// ====================================================================
+
+// Record cloud connectivity transitions and flush staged trace records (called every loop)
+void updateTraceState() {
+    bool connected = Particle.connected();
+    if (connected != traceCloudConnected) {
+        trace.record(connected ? TRACE_CLOUD_UP : TRACE_CLOUD_DOWN);
+        traceCloudConnected = connected;
+    }
+
+    // Anchor millis() to wall clock once time is synced
+    if (!traceTimeSynced && Time.isValid()) {
+        trace.record(TRACE_TIME_SYNC, 0, 0, (int32_t)Time.now());
+        traceTimeSynced = true;
+    }
+
+    trace.flush();
+}
+
+// Cloud function to dump the flight recorder
+// Parameter: "<count>" publishes the last count records as diag/trace events (default 64),
+//            "usb" or "usb:<count>" writes hex lines to USB serial instead (default all)
+int dumpTrace(String command) {
+    runtimeContext.stage = STAGE_CLOUD_FUNCTION;
+    bool toUsb = command.startsWith("usb");
+    int colon = command.indexOf(':');
+    String countArg = toUsb ? (colon >= 0 ? command.substring(colon + 1) : String("")) : command;
+    int count = countArg.length() > 0 ? countArg.toInt() : (toUsb ? TRACE_CAPACITY : 64);
+
+    if (count <= 0 || count > TRACE_CAPACITY) {
+        Log.error("Invalid trace count %d (must be 1-%d)", count, TRACE_CAPACITY);
+        return -1;
+    }
+    if (!toUsb && !Particle.connected()) {
+        return -1;
+    }
+
+    // Queue the dump; loop() sends it one chunk at a time so this handler
+    // returns at once (a full cloud dump takes about a minute)
+    uint32_t next = trace.getSequence();
+    traceDump.toUsb = toUsb;
+    traceDump.seq = (next > (uint32_t)count) ? next - count : 1;
+    traceDump.end = next;
+    traceDump.chunk = 0;
+    traceDump.chunks = (count + TRACE_RECORDS_PER_EVENT - 1) / TRACE_RECORDS_PER_EVENT;
+    traceDump.dumped = 0;
+    traceDump.lastChunkMs = millis() - TRACE_DUMP_INTERVAL;
+    traceDump.active = true;
+
+    Log.info("Dumping up to %d trace records to %s", count, toUsb ? "USB serial" : "cloud");
+    return (int)(traceDump.end - traceDump.seq);
+}
+
+// Send the next chunk of a queued trace dump (called every loop)
+void serviceTraceDump() {
+    if (!traceDump.active) {
+        return;
+    }
+    if (!traceDump.toUsb && (!Particle.connected() || millis() - traceDump.lastChunkMs < TRACE_DUMP_INTERVAL)) {
+        return;
+    }
+
+    TraceRecord records[TRACE_RECORDS_PER_EVENT];
+    uint16_t n = 0;
+    if (traceDump.chunk < traceDump.chunks && traceDump.seq < traceDump.end) {
+        n = trace.readFrom(traceDump.seq, records, TRACE_RECORDS_PER_EVENT);
+    }
+    if (n == 0) {
+        traceDump.active = false;
+        Log.info("Dumped %d trace records to %s", traceDump.dumped, traceDump.toUsb ? "USB serial" : "cloud");
+        return;
+    }
+
+    // Hex-encode raw records (decoded on the host by bridge/trace-decode.py)
+    char hex[TRACE_RECORDS_PER_EVENT * sizeof(TraceRecord) * 2 + 1];
+    static const char digits[] = "0123456789abcdef";
+    const uint8_t* raw = (const uint8_t*)records;
+    size_t len = n * sizeof(TraceRecord);
+    for (size_t i = 0; i < len; i++) {
+        hex[i * 2] = digits[raw[i] >> 4];
+        hex[i * 2 + 1] = digits[raw[i] & 0x0F];
+    }
+    hex[len * 2] = '\0';
+
+    if (traceDump.toUsb) {
+        Serial.printlnf("TRACE %s", hex);
+    } else {
+        char msg[650];
+        snprintf(msg, sizeof(msg), "{\"chunk\":%d,\"total\":%d,\"data\":\"%s\"}",
+                 traceDump.chunk + 1, traceDump.chunks, hex);
+        traceDump.lastChunkMs = millis();
+        if (!Particle.publish("diag/trace", msg, PRIVATE)) {
+            return;  // Same chunk again after the interval
+        }
+    }
+    traceDump.seq = records[n - 1].seq + 1;
+    traceDump.chunk++;
+    traceDump.dumped += n;
+}
+
+#endif
+
+// ====================================================================
+// Sensor Power and Recovery Functions
+// ====================================================================
+
+// Apply recovery power actions and gate sensor power between samples (called every loop)
+void serviceSensorPower() {
+    if (!dht.hasPowerControl()) {
+        return;
+    }
+
+    switch (sensorRecovery.update(millis())) {
+        case SensorRecovery::ACTION_POWER_OFF:
+            Log.warn("DHT22 unresponsive, power cycling sensor (cycle %lu)",
+                     sensorRecovery.getPowerCycles());
+            dht.powerOff();
+            lastTriggerMs = 0;
+            break;
+        case SensorRecovery::ACTION_POWER_ON:
+            Log.info("DHT22 power restored, settling");
+            dht.powerOn();
+            break;
+        default:
+            break;
+    }
+
+    // Power up ahead of the next sample (and its priming read) so the sensor has settled by read time
+    if (DHT_POWER_GATING && !dht.isPowered() && sensorRecovery.readAllowed() &&
+        millis() - lastMeasurement + DHT_POWER_SETTLE_MS + DHT_PRIME_LEAD_MS >= getMeasurementInterval()) {
+        dht.powerOn();
+    }
+}
+
+// Feed a measurement outcome to the recovery state machine and report transitions
+void reportSensorHealth(bool success) {
+    if (!dht.hasPowerControl()) {
+        return;
+    }
+
+    uint32_t cyclesBefore = sensorRecovery.getPowerCycles();
+    uint32_t recoveriesBefore = sensorRecovery.getRecoveries();
+    sensorRecovery.onReadResult(success, millis());
+
+    char msg[128];
+    if (sensorRecovery.getPowerCycles() != cyclesBefore) {
+        trace.record(TRACE_RECOVERY, 0, 0, (int32_t)sensorRecovery.getPowerCycles());
+        snprintf(msg, sizeof(msg), "{\"action\":\"power_cycle\",\"cycles\":%lu}",
+                 (unsigned long)sensorRecovery.getPowerCycles());
+        if (Particle.connected()) {
+            eventEnvelope.post("sensor/recovery", msg);
+        }
+    } else if (sensorRecovery.getRecoveries() != recoveriesBefore) {
+        trace.record(TRACE_RECOVERY, 1, 0, (int32_t)sensorRecovery.getLastRecoveryMs());
+        snprintf(msg, sizeof(msg),
+                 "{\"action\":\"recovered\",\"recovery_ms\":%lu,\"cycles\":%lu,\"recoveries\":%lu}",
+                 (unsigned long)sensorRecovery.getLastRecoveryMs(),
+                 (unsigned long)sensorRecovery.getPowerCycles(),
+                 (unsigned long)sensorRecovery.getRecoveries());
+        Log.info("DHT22 recovered after %lu ms", (unsigned long)sensorRecovery.getLastRecoveryMs());
+        if (Particle.connected()) {
+            eventEnvelope.post("sensor/recovery", msg);
+        }
+    }
+
+    // Gate power off until shortly before the next sample (stays on during a burst or capture)
+    bool fastSampling = changeBurstActive;
+#if FEATURE_CAPTURE
+    fastSampling = fastSampling || captureState == CAPTURE_SAMPLING;
+#endif
+    if (DHT_POWER_GATING && success && !fastSampling) {
+        dht.powerOff();
+        lastTriggerMs = 0;  // Pending conversion lost with the supply
+    }
+}
+
+#if FEATURE_DIAGNOSTICS
+// ====================================================================
+// Lab Streaming Functions
+// ====================================================================
+
+// Cloud function to start/stop lab streaming ("1" = start, "0" = stop)
+// Streaming can also be toggled from the USB host by sending 'S' (start) or 'X' (stop)
+int setLabStream(String command) {
+    bool enable = command.length() == 0 || command.toInt() != 0;
+
+#if FEATURE_DOE
+    if (enable && doeActive) {
+        Log.warn("Cannot stream while DOE is running");
+        return -1;
+    }
+#endif
+
+    if (enable && !labStreamActive) {
+        Serial.begin(115200);
+        if (!dht.isPowered()) {
+            dht.powerOn();
+            delay(DHT_POWER_SETTLE_MS);
+        }
+        Log.info("Lab streaming started");
+    } else if (!enable && labStreamActive) {
+        Log.info("Lab streaming stopped: %lu frames, %lu ok",
+                 labStream.getSent(), labStream.getSuccessful());
+    }
+
+    labStreamActive = enable;
+    return enable ? 1 : 0;
+}
+
+// Handle USB commands and stream one frame per DHT22 read interval
+void serviceLabStream() {
+    while (Serial.available() > 0) {
+        int c = Serial.read();
+        if (c == 'S') {
+            setLabStream("1");
+        } else if (c == 'X') {
+            setLabStream("0");
+        }
+    }
+
+    if (!labStreamActive || millis() - lastLabFrame < LAB_STREAM_INTERVAL) {
+        return;
+    }
+    lastLabFrame = millis();
+
+    DHTFrame frame;
+    runtimeContext.stage = STAGE_DHT_READ;
+    dht.readFrame(frame);
+    labStream.sendFrame(frame, dht);
+    runtimeContext.stage = STAGE_IDLE;
+}
+
+// ====================================================================
+// Crash Context Functions
+// ====================================================================
+
+// Copy the retained context from the previous boot and start a fresh one
+void captureCrashContext() {
+    int reason = System.resetReason();
+    bool abnormal = (reason == RESET_REASON_PANIC || reason == RESET_REASON_WATCHDOG);
+
+    if (abnormal && runtimeContext.magic == RUNTIME_CONTEXT_MAGIC) {
+        crashContext = runtimeContext;
+        crashContextPending = true;
+    }
 
-    // Get free memory
-    uint32_t freeMem = System.freeMemory();
+    memset(&runtimeContext, 0, sizeof(runtimeContext));
+    runtimeContext.magic = RUNTIME_CONTEXT_MAGIC;
+    runtimeContext.stage = STAGE_BOOT;
+}
 
-    // Get cloud connection status
-    String cloudStatus = Particle.connected() ? "connected" : "disconnected";
+// Publish the context captured before a panic/watchdog reset (once per boot)
+void publishCrashContext() {
+    static unsigned long lastAttemptMs = 0;
+    static unsigned long retryMs = 0;   // 0 = no attempt yet
 
-    // Format uptime string similar to Linux uptime command
-    // Example: "10:15:23 up 5 days, 3:42, cloud: connected, free mem: 45632 bytes"
-    char uptimeMsg[256];
+    if (!crashContextPending || !Particle.connected()) {
+        return;
+    }
+    if (retryMs && millis() - lastAttemptMs < retryMs) {
+        return;
+    }
 
-    if (days > 0) {
-        snprintf(uptimeMsg, sizeof(uptimeMsg),
-                 "%s up %lu day%s, %lu:%02lu, cloud: %s, free mem: %lu bytes",
-                 currentTime.c_str(), days, (days == 1 ? "" : "s"),
-                 hours, minutes, cloudStatus.c_str(), freeMem);
-    } else if (hours > 0) {
-        snprintf(uptimeMsg, sizeof(uptimeMsg),
-                 "%s up %lu:%02lu, cloud: %s, free mem: %lu bytes",
-                 currentTime.c_str(), hours, minutes, cloudStatus.c_str(), freeMem);
+    static const char* stageNames[] = {"boot", "idle", "measure", "dht_read", "publish",
+                                       "cloud_function", "doe", "trace_flush"};
+    const char* stage = crashContext.stage < sizeof(stageNames) / sizeof(stageNames[0])
+                        ? stageNames[crashContext.stage] : "unknown";
+
+    char msg[256];
+    snprintf(msg, sizeof(msg),
+             "{\"reason\":\"%s\",\"data\":%lu,\"stage\":\"%s\",\"dht_step\":%u,\"dht_bit\":%d,"
+             "\"loops\":%lu,\"free_mem\":%lu,\"uptime\":%lu,\"pending_events\":%u}",
+             resetReason.c_str(), (unsigned long)System.resetReasonData(), stage,
+             (crashContext.dhtStep & DHT_STEP_READ_BITS) ? DHT_STEP_READ_BITS : crashContext.dhtStep,
+             (crashContext.dhtStep & DHT_STEP_READ_BITS) ? (crashContext.dhtStep & 0x3F) : -1,
+             (unsigned long)crashContext.loopCount, (unsigned long)crashContext.freeMemory,
+             (unsigned long)crashContext.uptime, crashContext.pendingEvents);
+
+    bool ok = Particle.publish("system/crash", msg, PRIVATE);
+    lastAttemptMs = millis();
+
+    // Trace the outcome once: the success, or the first refusal
+    if (ok || !retryMs) {
+        trace.record(TRACE_PUBLISH, TRACE_PUB_SYSTEM, ok);
+        Log.warn("Previous boot ended in %s: %s", resetReason.c_str(), msg);
+    }
+
+    if (ok) {
+        crashContextPending = false;
     } else {
-        snprintf(uptimeMsg, sizeof(uptimeMsg),
-                 "%s up %lu min, cloud: %s, free mem: %lu bytes",
-                 currentTime.c_str(), minutes, cloudStatus.c_str(), freeMem);
+        retryMs = retryMs ? min(retryMs * 2, (unsigned long)CRASH_RETRY_MAX_MS) : CRASH_RETRY_MIN_MS;
+        Log.warn("system/crash publish refused, retrying in %lu s", retryMs / 1000);
     }
+}
 
-    // Publish to cloud
-    if (Particle.connected()) {
-        Particle.publish("system/uptime", uptimeMsg, PRIVATE);
+// ====================================================================
+// Self-Benchmark Functions
+// ====================================================================
+
+// Cloud function to time the firmware's hot kernels on this device
+// Publishes cycles per call as diag/selfbench, returns the number of kernels timed
+int runSelfBench(String command) {
+    Log.info("Self-benchmark requested from cloud");
+    runtimeContext.stage = STAGE_CLOUD_FUNCTION;
+    unsigned long startMs = millis();
+    SelfBench bench;
+
+    // Canned frame: 65.2% / 23.0°C, 26 us zero and 70 us one high pulses, 50 us lows
+    static const uint8_t frameBytes[5] = {0x02, 0x8C, 0x00, 0xE6, 0x74};
+    DHTFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    uint16_t t = 0;
+    frame.edges[frame.edgeCount++] = t;
+    frame.edges[frame.edgeCount++] = t += 30;
+    frame.edges[frame.edgeCount++] = t += 80;
+    frame.edges[frame.edgeCount++] = t += 80;
+    for (uint8_t i = 0; i < 40; i++) {
+        bool one = frameBytes[i / 8] & (1 << (7 - (i % 8)));
+        frame.edges[frame.edgeCount++] = t += 50;
+        frame.edges[frame.edgeCount++] = t += one ? 70 : 26;
+    }
+    uint8_t decoded[5];
+    bench.run("decode", 100, [&]() { SimpleDHT22::decodeFrame(frame, dht.getBitThreshold(), decoded); });
+    if (memcmp(decoded, frameBytes, sizeof(frameBytes)) != 0) {
+        Log.error("Selfbench: canned frame decoded incorrectly");
     }
 
-    // Log locally
-    Log.info("Uptime: %s", uptimeMsg);
+    // Averaging and detection kernels on private stage instances
+    Sample sample;
+    sample.temperature = 21.5f;
+    sample.humidity = 45.0f;
+    MovingAverage<MAX_BUFFER_SIZE>* average = new MovingAverage<MAX_BUFFER_SIZE>();
+    if (average) {
+        for (int i = 0; i < MAX_BUFFER_SIZE; i++) {
+            average->process(sample);
+        }
+        bench.run("avg360", 20, [&]() { average->process(sample); });
+        average->setSize(30);
+        bench.run("avg30", 100, [&]() { average->process(sample); });
+        delete average;
+    }
+    ChangeDetector<15, 10, 5> detector;
+    bench.run("cusum", 100, [&]() { detector.process(sample); });
 
-    return 1;
+    // Payload formatting
+    bench.run("json", 10, [&]() { createJsonPayload(21.5f, 45.0f); });
+
+    // Queues: trace staging ring and event envelope (private instances, never flushed)
+    FlightRecorder* ring = new FlightRecorder("/usr/selfbench.bin", 16);
+    if (ring) {
+        bench.run("trace", 32, [&]() { ring->record(TRACE_NONE); });
+        delete ring;
+    }
+#if FEATURE_ENVELOPE
+    EventEnvelope* queue = new EventEnvelope(ENVELOPE_WINDOW_MS, ENVELOPE_MAX_HOLD_MS);
+    if (queue) {
+        bench.run("envpost", 4, [&]() { queue->post("sensor/info", "selfbench", ENVELOPE_LOW); });
+        delete queue;
+    }
+#endif
+
+    // Persistent storage: EEPROM word read into RAM (no flash wear from repeated
+    // runs) and 16-byte appends to a scratch file
+    uint32_t scratch = 0;
+    bench.run("eeprom", 4, [&]() { EEPROM.get(EEPROM_MAGIC_ADDR, scratch); });
+    int fd = open("/usr/selfbench.tmp", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        uint8_t record[sizeof(TraceRecord)] = {0};
+        bench.run("flash16", 8, [&]() { write(fd, record, sizeof(record)); });
+        bench.run("fsync", 1, [&]() { fsync(fd); });
+        close(fd);
+        unlink("/usr/selfbench.tmp");
+    }
+
+    char msg[256];
+    bench.format(msg, sizeof(msg));
+    eventEnvelope.post("diag/selfbench", msg);
+    Log.info("Selfbench (%lu ms): %s", millis() - startMs, msg);
+    return bench.getCount();
 }
 
+#endif // FEATURE_DIAGNOSTICS
+
 // ====================================================================
 // Timing Parameter Configuration Functions
 // ====================================================================
@@ -778,6 +1822,281 @@ void saveTimingParametersToEEPROM() {
     Log.info("  Response Timeout: %d us", responseTimeout);
     Log.info("  Bit Timeout: %d us", bitTimeout);
     Log.info("  Bit Threshold: %d us", bitThreshold);
+
+    rememberBaseTiming();
+}
+
+// ====================================================================
+// Temperature-Indexed Timing Profiles
+// ====================================================================
+
+// Record the current sensor timing as the base set (used where no profile applies)
+void rememberBaseTiming() {
+    baseTiming.startSignal = dht.getStartSignal();
+    baseTiming.responseTimeout = dht.getResponseTimeout();
+    baseTiming.bitTimeout = dht.getBitTimeout();
+    baseTiming.bitThreshold = dht.getBitThreshold();
+    baseTiming.successRate = 0;
+    baseTiming.source = PROFILE_EMPTY;
+    baseTiming.reserved = 0;
+    timingProfileDirty = true;
+}
+
+// Configured (base) timing as "startSignal,responseTimeout,bitTimeout,bitThreshold",
+// for the timing cloud variable; a temperature profile may override it per read
+String baseTimingString() {
+    return String::format("%u,%u,%u,%u", baseTiming.startSignal, baseTiming.responseTimeout,
+                          baseTiming.bitTimeout, baseTiming.bitThreshold);
+}
+
+// Timing the sensor is reading with, as "startSignal,responseTimeout,bitTimeout,bitThreshold,source"
+// source: base, manual (profiles suspended), the applied profile's bucket (e.g. 10C) or doe
+String appliedTimingString() {
+    String source = timingOverride ? "manual" : "base";
+    if (activeProfile >= 0) {
+        source = String(TIMING_PROFILE_MIN_TEMP + activeProfile * TIMING_PROFILE_BUCKET) + "C";
+    }
+#if FEATURE_DOE
+    if (doeActive) {
+        source = "doe";
+    }
+#endif
+    return String::format("%u,%u,%u,%u,%s", dht.getStartSignal(), dht.getResponseTimeout(),
+                          dht.getBitTimeout(), dht.getBitThreshold(), source.c_str());
+}
+
+// Bucket index for a temperature, clamped to the table
+int getProfileBucket(float temperature) {
+    int bucket = (int)floor((temperature - TIMING_PROFILE_MIN_TEMP) / TIMING_PROFILE_BUCKET);
+    if (bucket < 0) return 0;
+    if (bucket >= TIMING_PROFILE_COUNT) return TIMING_PROFILE_COUNT - 1;
+    return bucket;
+}
+
+// Load the profile table, discarding entries outside the DOE limits
+void loadTimingProfilesFromEEPROM() {
+    uint32_t magic;
+    EEPROM.get(EEPROM_PROFILE_MAGIC_ADDR, magic);
+
+    int loaded = 0;
+    for (int i = 0; i < TIMING_PROFILE_COUNT; i++) {
+        TimingProfile& profile = timingProfiles[i];
+        if (magic == EEPROM_PROFILE_MAGIC) {
+            EEPROM.get(EEPROM_PROFILE_TABLE_ADDR + i * sizeof(TimingProfile), profile);
+        } else {
+            memset(&profile, 0, sizeof(profile));
+        }
+
+        if (profile.source != PROFILE_EMPTY &&
+            (profile.startSignal < doeConfig.startSignalMin || profile.startSignal > doeConfig.startSignalMax ||
+             profile.responseTimeout < doeConfig.responseTimeoutMin || profile.responseTimeout > doeConfig.responseTimeoutMax ||
+             profile.bitTimeout < doeConfig.bitTimeoutMin || profile.bitTimeout > doeConfig.bitTimeoutMax ||
+             profile.bitThreshold < doeConfig.bitThresholdMin || profile.bitThreshold > doeConfig.bitThresholdMax)) {
+            Log.warn("Timing profile %d C out of range, ignoring", TIMING_PROFILE_MIN_TEMP + i * TIMING_PROFILE_BUCKET);
+            profile.source = PROFILE_EMPTY;
+        }
+        if (profile.source != PROFILE_EMPTY) {
+            loaded++;
+        }
+    }
+
+    if (magic != EEPROM_PROFILE_MAGIC) {
+        // Initialize an empty table
+        for (int i = 0; i < TIMING_PROFILE_COUNT; i++) {
+            EEPROM.put(EEPROM_PROFILE_TABLE_ADDR + i * sizeof(TimingProfile), timingProfiles[i]);
+        }
+        magic = EEPROM_PROFILE_MAGIC;
+        EEPROM.put(EEPROM_PROFILE_MAGIC_ADDR, magic);
+    }
+
+    uint8_t override;
+    EEPROM.get(EEPROM_TIMING_OVERRIDE_ADDR, override);
+    timingOverride = (override == 1);
+
+    Log.info("Loaded %d temperature timing profiles%s", loaded, timingOverride ? " (suspended by manual timing)" : "");
+    updateTimingProfileSummary();
+}
+
+// Store the sensor's current timing as the profile for a temperature bucket
+bool storeTimingProfile(float temperature, TimingProfileSource source, uint16_t successRate) {
+    if (isnan(temperature)) {
+        return false;
+    }
+
+    int bucket = getProfileBucket(temperature);
+    TimingProfile& profile = timingProfiles[bucket];
+    profile.startSignal = dht.getStartSignal();
+    profile.responseTimeout = dht.getResponseTimeout();
+    profile.bitTimeout = dht.getBitTimeout();
+    profile.bitThreshold = dht.getBitThreshold();
+    profile.successRate = successRate;
+    profile.source = source;
+    profile.reserved = 0;
+    EEPROM.put(EEPROM_PROFILE_TABLE_ADDR + bucket * sizeof(TimingProfile), profile);
+
+    Log.info("Stored timing profile for %d C: SS=%d RT=%d BT=%d BTh=%d",
+             TIMING_PROFILE_MIN_TEMP + bucket * TIMING_PROFILE_BUCKET,
+             profile.startSignal, profile.responseTimeout, profile.bitTimeout, profile.bitThreshold);
+
+    timingProfileDirty = true;
+    updateTimingProfileSummary();
+    return true;
+}
+
+// Suspend (or resume) the profiles in favour of the manually set base timing
+void setTimingOverride(bool active) {
+    if (active == timingOverride) {
+        return;
+    }
+    timingOverride = active;
+    EEPROM.put(EEPROM_TIMING_OVERRIDE_ADDR, (uint8_t)(active ? 1 : 0));
+    Log.info("Timing profiles %s", active ? "suspended by manual timing" : "resumed");
+    timingProfileDirty = true;
+    updateTimingProfileSummary();
+}
+
+// A manual timing change starts from the base set rather than whatever profile
+// is applied, and takes precedence over the profiles until the next DOE
+void beginManualTiming() {
+    dht.setStartSignal(baseTiming.startSignal);
+    dht.setResponseTimeout(baseTiming.responseTimeout);
+    dht.setBitTimeout(baseTiming.bitTimeout);
+    dht.setBitThreshold(baseTiming.bitThreshold);
+    activeProfile = -1;  // No profile is applied from here on (appliedTiming)
+    setTimingOverride(true);
+}
+
+// Apply the timing profile for a temperature (NAN = base timing)
+// Uses a neighbouring bucket's profile when the temperature's own bucket is
+// empty; base timing while a manual override is active
+void selectTimingProfile(float temperature) {
+    int bucket = -1;
+    int profile = -1;
+
+    if (!isnan(temperature)) {
+        bucket = getProfileBucket(temperature);
+
+        // Hysteresis: stay in the current bucket until clearly outside it
+        if (activeBucket >= 0 && bucket != activeBucket) {
+            float low = TIMING_PROFILE_MIN_TEMP + activeBucket * TIMING_PROFILE_BUCKET - TIMING_PROFILE_HYSTERESIS;
+            float high = low + TIMING_PROFILE_BUCKET + 2 * TIMING_PROFILE_HYSTERESIS;
+            if (temperature >= low && temperature < high) {
+                bucket = activeBucket;
+            }
+        }
+
+        for (int d = 0; d <= TIMING_PROFILE_REACH && profile < 0 && !timingOverride; d++) {
+            if (bucket - d >= 0 && timingProfiles[bucket - d].source != PROFILE_EMPTY) {
+                profile = bucket - d;
+            } else if (bucket + d < TIMING_PROFILE_COUNT && timingProfiles[bucket + d].source != PROFILE_EMPTY) {
+                profile = bucket + d;
+            }
+        }
+    }
+
+    if (bucket == activeBucket && profile == activeProfile && !timingProfileDirty) {
+        return;
+    }
+
+    const TimingProfile& timing = (profile >= 0) ? timingProfiles[profile] : baseTiming;
+    dht.setStartSignal(timing.startSignal);
+    dht.setResponseTimeout(timing.responseTimeout);
+    dht.setBitTimeout(timing.bitTimeout);
+    dht.setBitThreshold(timing.bitThreshold);
+
+    if (profile != activeProfile) {
+        if (profile >= 0) {
+            Log.info("Timing profile %d C applied (%.1f C): SS=%d RT=%d BT=%d BTh=%d",
+                     TIMING_PROFILE_MIN_TEMP + profile * TIMING_PROFILE_BUCKET, temperature,
+                     timing.startSignal, timing.responseTimeout, timing.bitTimeout, timing.bitThreshold);
+        } else {
+            Log.info("Base timing applied");
+        }
+        trace.record(TRACE_CONFIG, TRACE_CFG_PROFILE, (int16_t)bucket, profile);
+    }
+
+    activeBucket = bucket;
+    activeProfile = profile;
+    timingProfileDirty = false;
+    updateTimingProfileSummary();
+}
+
+// Cloud variable: active bucket/profile, then every stored profile with its read statistics
+// Format: "active=10C profile=10C; 10C:1100/200/100/50 doe 98.5% reads=40 fails=1; ..."
+void updateTimingProfileSummary() {
+    String summary = "active=";
+    summary += (activeBucket >= 0) ? String(TIMING_PROFILE_MIN_TEMP + activeBucket * TIMING_PROFILE_BUCKET) + "C" : "none";
+    summary += " profile=";
+    if (activeProfile >= 0) {
+        summary += String(TIMING_PROFILE_MIN_TEMP + activeProfile * TIMING_PROFILE_BUCKET) + "C";
+    } else {
+        summary += timingOverride ? "manual" : "base";
+    }
+
+    for (int i = 0; i < TIMING_PROFILE_COUNT; i++) {
+        const TimingProfile& profile = timingProfiles[i];
+        if (profile.source == PROFILE_EMPTY && profileReads[i] == 0) {
+            continue;
+        }
+        summary += String::format("; %dC:", TIMING_PROFILE_MIN_TEMP + i * TIMING_PROFILE_BUCKET);
+        if (profile.source != PROFILE_EMPTY) {
+            summary += String::format("%u/%u/%u/%u %s", profile.startSignal, profile.responseTimeout,
+                                      profile.bitTimeout, profile.bitThreshold,
+                                      profile.source == PROFILE_DOE ? "doe" : "manual");
+            if (profile.successRate > 0) {
+                summary += String::format(" %.1f%%", profile.successRate / 10.0);
+            }
+        } else {
+            summary += "none";
+        }
+        summary += String::format(" reads=%u fails=%u", profileReads[i], profileFails[i]);
+    }
+
+    timingProfileSummary = summary;
+}
+
+// Cloud function to manage timing profiles
+// "save" = store current timing for the last measured temperature, "save:<temp>" = for
+// the bucket containing <temp>, "clear:<temp>" = remove one profile, "clear" = remove all
+// Returns the bucket index, the number of cleared profiles, or -1 on error
+int setTimingProfile(String command) {
+    command.trim();
+    int colon = command.indexOf(':');
+    String action = (colon >= 0) ? command.substring(0, colon) : command;
+    bool hasTemp = colon >= 0;
+    float temperature = hasTemp ? command.substring(colon + 1).toFloat() : lastValidatedTemp;
+
+    if (action.equalsIgnoreCase("save")) {
+        if (!hasTemp && !hasValidLastReading) {
+            Log.error("No temperature reading yet, use save:<temp>");
+            return -1;
+        }
+        if (!storeTimingProfile(temperature, PROFILE_MANUAL, 0)) {
+            return -1;
+        }
+        setTimingOverride(false);  // Saving a profile puts the profiles back in charge
+        return getProfileBucket(temperature);
+    }
+
+    if (action.equalsIgnoreCase("clear")) {
+        int first = hasTemp ? getProfileBucket(temperature) : 0;
+        int last = hasTemp ? first : TIMING_PROFILE_COUNT - 1;
+        int cleared = 0;
+        for (int i = first; i <= last; i++) {
+            if (timingProfiles[i].source != PROFILE_EMPTY) {
+                cleared++;
+            }
+            memset(&timingProfiles[i], 0, sizeof(TimingProfile));
+            EEPROM.put(EEPROM_PROFILE_TABLE_ADDR + i * sizeof(TimingProfile), timingProfiles[i]);
+        }
+        Log.info("Cleared %d timing profiles", cleared);
+        timingProfileDirty = true;
+        updateTimingProfileSummary();
+        return cleared;
+    }
+
+    Log.error("Invalid profile command: %s (use save, save:<temp>, clear, clear:<temp>)", command.c_str());
+    return -1;
 }
 
 // Cloud function to set start signal timing
@@ -791,14 +2110,16 @@ int setStartSignalTiming(String command) {
         return -1;
     }
 
-    // Apply new value
+    // Apply new value on top of the base timing
+    beginManualTiming();
     dht.setStartSignal((uint16_t)value);
 
     // Save to EEPROM
     saveTimingParametersToEEPROM();
 
     Log.info("Start signal timing updated to %d us", value);
-    Particle.publish("config/timing", String::format("start_signal=%d", value), PRIVATE);
+    trace.record(TRACE_CONFIG, TRACE_CFG_START_SIGNAL, 0, value);
+    eventEnvelope.post("config/timing", String::format("start_signal=%d", value).c_str(), ENVELOPE_LOW);
 
     return value;
 }
@@ -814,14 +2135,16 @@ int setResponseTimeoutTiming(String command) {
         return -1;
     }
 
-    // Apply new value
+    // Apply new value on top of the base timing
+    beginManualTiming();
     dht.setResponseTimeout((uint16_t)value);
 
     // Save to EEPROM
     saveTimingParametersToEEPROM();
 
     Log.info("Response timeout updated to %d us", value);
-    Particle.publish("config/timing", String::format("response_timeout=%d", value), PRIVATE);
+    trace.record(TRACE_CONFIG, TRACE_CFG_RESPONSE_TIMEOUT, 0, value);
+    eventEnvelope.post("config/timing", String::format("response_timeout=%d", value).c_str(), ENVELOPE_LOW);
 
     return value;
 }
@@ -837,14 +2160,16 @@ int setBitTimeoutTiming(String command) {
         return -1;
     }
 
-    // Apply new value
+    // Apply new value on top of the base timing
+    beginManualTiming();
     dht.setBitTimeout((uint16_t)value);
 
     // Save to EEPROM
     saveTimingParametersToEEPROM();
 
     Log.info("Bit timeout updated to %d us", value);
-    Particle.publish("config/timing", String::format("bit_timeout=%d", value), PRIVATE);
+    trace.record(TRACE_CONFIG, TRACE_CFG_BIT_TIMEOUT, 0, value);
+    eventEnvelope.post("config/timing", String::format("bit_timeout=%d", value).c_str(), ENVELOPE_LOW);
 
     return value;
 }
@@ -860,34 +2185,55 @@ int setBitThresholdTiming(String command) {
         return -1;
     }
 
-    // Apply new value
+    // Apply new value on top of the base timing
+    beginManualTiming();
     dht.setBitThreshold((uint16_t)value);
 
     // Save to EEPROM
     saveTimingParametersToEEPROM();
 
     Log.info("Bit threshold updated to %d us", value);
-    Particle.publish("config/timing", String::format("bit_threshold=%d", value), PRIVATE);
+    trace.record(TRACE_CONFIG, TRACE_CFG_BIT_THRESHOLD, 0, value);
+    eventEnvelope.post("config/timing", String::format("bit_threshold=%d", value).c_str(), ENVELOPE_LOW);
 
     return value;
 }
 
+#if FEATURE_DOE
 // ====================================================================
 // DOE (Design of Experiments) Functions
 // ====================================================================
 
 // Cloud function to start DOE experiment
+// Parameter: empty = default plan, or a compact plan specification, e.g.
+//   "bth=42:54:2;n=20;stop=5"   sweep bit threshold only, 20 reads/config, early stop
+//   "ss=1400:1800:200;rt=200:260:30;d=full"   full factorial over two factors
 int startDOE(String command) {
     if (doeActive) {
         Log.warn("DOE already running");
         return -1;
     }
+#if FEATURE_DIAGNOSTICS
+    if (labStreamActive) {
+        Log.warn("Stop lab streaming before starting DOE");
+        return -1;
+    }
+#endif
+
+    DOEPlan plan;
+    if (!compileDOEPlan(command, plan)) {
+        Log.error("Invalid DOE plan: %s", command.c_str());
+        return -2;
+    }
+    doePlan = plan;
 
     Log.info("Starting DOE experiment for 1-wire timing optimization");
     doeActive = true;
     doeStatus = "starting";
     doeProgress = 0;
     doeStartTime = Time.now();
+    doeTemperatureSum = 0.0;
+    doeTemperatureCount = 0;
 
     // Reset best result tracking
     bestResult.successCount = 0;
@@ -900,7 +2246,8 @@ int startDOE(String command) {
     doePhase3Summary = "{}";
     doePhase4Summary = "{}";
 
-    publishDOEStatus("DOE experiment started");
+    trace.record(TRACE_DOE, 1);
+    publishDOEStatus("DOE experiment started: " + doePlanSummary);
 
     return 1;
 }
@@ -918,239 +2265,392 @@ int stopDOE(String command) {
 
     // Restore default timing parameters
     dht.resetTimingDefaults();
+    timingProfileDirty = true; // Profile timing returns with the next measurement
 
+    trace.record(TRACE_DOE, 0);
     publishDOEStatus("DOE experiment stopped by user");
 
     return 1;
 }
 
-// Main DOE experiment - runs through all parameter combinations
-void runDOEExperiment() {
-    Log.info("=== DOE Experiment Running ===");
-    doeStatus = "running";
-
-    // Calculate total number of tests
-    int startSignalSteps = (doeConfig.startSignalMax - doeConfig.startSignalMin) / doeConfig.startSignalStep + 1;
-    int responseTimeoutSteps = (doeConfig.responseTimeoutMax - doeConfig.responseTimeoutMin) / doeConfig.responseTimeoutStep + 1;
-    int bitTimeoutSteps = (doeConfig.bitTimeoutMax - doeConfig.bitTimeoutMin) / doeConfig.bitTimeoutStep + 1;
-    int bitThresholdSteps = (doeConfig.bitThresholdMax - doeConfig.bitThresholdMin) / doeConfig.bitThresholdStep + 1;
-
-    int totalTests = startSignalSteps * responseTimeoutSteps * bitTimeoutSteps * bitThresholdSteps;
-    int testsCompleted = 0;
-
-    Log.info("DOE Configuration:");
-    Log.info("  Start Signal: %d-%d us (step %d) = %d tests",
-             doeConfig.startSignalMin, doeConfig.startSignalMax, doeConfig.startSignalStep, startSignalSteps);
-    Log.info("  Response Timeout: %d-%d us (step %d) = %d tests",
-             doeConfig.responseTimeoutMin, doeConfig.responseTimeoutMax, doeConfig.responseTimeoutStep, responseTimeoutSteps);
-    Log.info("  Bit Timeout: %d-%d us (step %d) = %d tests",
-             doeConfig.bitTimeoutMin, doeConfig.bitTimeoutMax, doeConfig.bitTimeoutStep, bitTimeoutSteps);
-    Log.info("  Bit Threshold: %d-%d us (step %d) = %d tests",
-             doeConfig.bitThresholdMin, doeConfig.bitThresholdMax, doeConfig.bitThresholdStep, bitThresholdSteps);
-    Log.info("  Tests per config: %d", doeConfig.testsPerConfig);
-    Log.info("  Total configurations: %d", totalTests);
-
-    // Test each parameter independently (one-factor-at-a-time design)
-    // This is more manageable than full factorial design
-
-    // Phase 1: Test Start Signal parameter
-    doeStatus = "testing_start_signal";
-    Log.info("--- Phase 1: Testing Start Signal Parameter ---");
-    publishDOEStatus("Phase 1/4: Testing start signal timing");
-
-    uint16_t bestStartSignal = 1100; // Default value
-    float bestStartSignalRate = 0.0;
-
-    // Collect all results for this phase
-    DOEResult startSignalResults[20]; // Max 20 results (generous for 800-2000 step 100)
-    int startSignalResultCount = 0;
-
-    for (uint16_t startSignal = doeConfig.startSignalMin;
-         startSignal <= doeConfig.startSignalMax;
-         startSignal += doeConfig.startSignalStep) {
-
-        DOEResult result = testParameterSet(startSignal, 200, 100, 50);
+// Compile a plan specification into a DOEPlan (empty spec = default plan)
+// Tokens separated by ';':
+//   ss|rt|bt|bth=min:max:step   sweep a factor (within the doeConfig limits)
+//   ss|rt|bt|bth=value          hold a factor at a fixed value
+//   n=reads                     reads per configuration (1-100)
+//   d=ofat|full                 design type
+//   stop=failures               abandon a configuration after this many failures
+//   order=seq|random            run order of the configurations within each block
+//   blocks=B                    split each configuration's reads into B interleaved rounds
+// Factors not named are held at their current values, unless no factor is
+// named at all, in which case all four default ranges are swept. Fixed
+// factors are not swept; their value replaces the current one in every
+// configuration
+bool compileDOEPlan(String spec, DOEPlan& plan) {
+    const uint16_t limitMin[DOE_FACTOR_COUNT] = {doeConfig.startSignalMin, doeConfig.responseTimeoutMin,
+                                                 doeConfig.bitTimeoutMin, doeConfig.bitThresholdMin};
+    const uint16_t limitMax[DOE_FACTOR_COUNT] = {doeConfig.startSignalMax, doeConfig.responseTimeoutMax,
+                                                 doeConfig.bitTimeoutMax, doeConfig.bitThresholdMax};
+    const uint16_t defaultStep[DOE_FACTOR_COUNT] = {doeConfig.startSignalStep, doeConfig.responseTimeoutStep,
+                                                    doeConfig.bitTimeoutStep, doeConfig.bitThresholdStep};
+
+    // Defaults: full OFAT sweep over every factor
+    for (int f = 0; f < DOE_FACTOR_COUNT; f++) {
+        plan.factors[f] = {limitMin[f], limitMax[f], defaultStep[f], true, false};
+    }
+    plan.design = DOE_DESIGN_OFAT;
+    plan.readsPerConfig = doeConfig.testsPerConfig;
+    plan.stopFailures = 0;
+    plan.order = DOE_ORDER_SEQUENTIAL;
+    plan.blocks = 1;
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", spec.c_str());
+
+    bool anyFactor = false;
+    char* save = nullptr;
+    for (char* token = strtok_r(buf, ";, ", &save); token; token = strtok_r(nullptr, ";, ", &save)) {
+        char* value = strchr(token, '=');
+        if (!value) {
+            return false;
+        }
+        *value++ = '\0';
 
-        // Store result for summary
-        if (startSignalResultCount < 20) {
-            startSignalResults[startSignalResultCount++] = result;
+        int factor = -1;
+        for (int f = 0; f < DOE_FACTOR_COUNT; f++) {
+            if (strcmp(token, DOE_FACTOR_KEYS[f]) == 0) {
+                factor = f;
+            }
         }
 
-        if (result.successRate > bestStartSignalRate) {
-            bestStartSignalRate = result.successRate;
-            bestStartSignal = result.startSignal;
-            bestResult = result;
-            publishDOEResult(result, true);
+        if (factor >= 0) {
+            if (!anyFactor) {
+                // First named factor: everything not named is held
+                for (int f = 0; f < DOE_FACTOR_COUNT; f++) {
+                    plan.factors[f].swept = false;
+                }
+                anyFactor = true;
+            }
+            unsigned int lo = 0, hi = 0, step = 0;
+            int fields = sscanf(value, "%u:%u:%u", &lo, &hi, &step);
+            if (fields == 1) {
+                hi = lo;
+            } else if (fields != 3 || step == 0) {
+                return false;
+            }
+            if (lo < limitMin[factor] || hi > limitMax[factor] || lo > hi) {
+                return false;
+            }
+            if (fields == 1) {
+                plan.factors[factor] = {(uint16_t)lo, (uint16_t)lo, 0, false, true};
+            } else {
+                plan.factors[factor] = {(uint16_t)lo, (uint16_t)hi, (uint16_t)step, true, false};
+            }
+        } else if (strcmp(token, "n") == 0) {
+            plan.readsPerConfig = atoi(value);
+            if (plan.readsPerConfig < 1 || plan.readsPerConfig > 100) {
+                return false;
+            }
+        } else if (strcmp(token, "d") == 0) {
+            if (strcmp(value, "ofat") == 0) {
+                plan.design = DOE_DESIGN_OFAT;
+            } else if (strcmp(value, "full") == 0) {
+                plan.design = DOE_DESIGN_FULL;
+            } else {
+                return false;
+            }
+        } else if (strcmp(token, "stop") == 0) {
+            plan.stopFailures = atoi(value);
+            if (plan.stopFailures < 0) {
+                return false;
+            }
+        } else if (strcmp(token, "order") == 0) {
+            if (strcmp(value, "seq") == 0) {
+                plan.order = DOE_ORDER_SEQUENTIAL;
+            } else if (strcmp(value, "random") == 0) {
+                plan.order = DOE_ORDER_RANDOM;
+            } else {
+                return false;
+            }
+        } else if (strcmp(token, "blocks") == 0) {
+            plan.blocks = atoi(value);
+            if (plan.blocks < 1 || plan.blocks > DOE_MAX_BLOCKS) {
+                return false;
+            }
         } else {
-            publishDOEResult(result, false);
+            return false;
         }
+    }
 
-        testsCompleted++;
-        doeProgress = (testsCompleted * 100) / (startSignalSteps + responseTimeoutSteps + bitTimeoutSteps + bitThresholdSteps);
-
-        // Allow cloud communication
-        Particle.process();
-        delay(100);
-
-        // Check if stopped
-        if (!doeActive) {
-            Log.info("DOE stopped during start signal testing");
-            return;
+    // Check the schedule fits the shared result array
+    int totalConfigs = (plan.design == DOE_DESIGN_FULL) ? 1 : 0;
+    for (int f = 0; f < DOE_FACTOR_COUNT; f++) {
+        if (!plan.factors[f].swept) {
+            continue;
+        }
+        int steps = countFactorSteps(plan.factors[f]);
+        if (plan.design == DOE_DESIGN_FULL) {
+            totalConfigs *= steps;
+        } else {
+            totalConfigs += steps;
+        }
+        if (steps > DOE_MAX_CONFIGS || totalConfigs > (plan.design == DOE_DESIGN_FULL ? DOE_MAX_CONFIGS : 4 * DOE_MAX_CONFIGS)) {
+            return false;
         }
     }
+    if (totalConfigs == 0 || plan.blocks > plan.readsPerConfig) {
+        return false;
+    }
 
-    Log.info("Best start signal: %d us (%.1f%% success)", bestStartSignal, bestStartSignalRate);
-
-    // Publish phase 1 summary statistics
-    publishPhaseSummary("start_signal", startSignalResults, startSignalResultCount);
-
-    // Phase 2: Test Response Timeout parameter (using best start signal)
-    doeStatus = "testing_response_timeout";
-    Log.info("--- Phase 2: Testing Response Timeout Parameter ---");
-    publishDOEStatus("Phase 2/4: Testing response timeout");
+    // Human-readable summary for the doePlan variable and status events
+    String summary = (plan.design == DOE_DESIGN_FULL) ? "full" : "ofat";
+    for (int f = 0; f < DOE_FACTOR_COUNT; f++) {
+        if (plan.factors[f].swept) {
+            summary += String::format(" %s=%u:%u:%u", DOE_FACTOR_KEYS[f], plan.factors[f].min,
+                                      plan.factors[f].max, plan.factors[f].step);
+        } else if (plan.factors[f].fixed) {
+            summary += String::format(" %s=%u", DOE_FACTOR_KEYS[f], plan.factors[f].min);
+        }
+    }
+    summary += String::format(" n=%d", plan.readsPerConfig);
+    if (plan.stopFailures > 0) {
+        summary += String::format(" stop=%d", plan.stopFailures);
+    }
+    if (plan.order == DOE_ORDER_RANDOM) {
+        summary += " order=random";
+    }
+    if (plan.blocks > 1) {
+        summary += String::format(" blocks=%d", plan.blocks);
+    }
+    // Every read takes 2 s; every burst (one per configuration and block) adds
+    // ~100 ms of cloud servicing
+    int estSec = (totalConfigs * (plan.readsPerConfig * 2000 + plan.blocks * 100) + 999) / 1000;
+    summary += String::format(" configs=%d est=%dmin", totalConfigs, (estSec + 59) / 60);
+    doePlanSummary = summary;
+
+    Log.info("DOE plan: %s", doePlanSummary.c_str());
+    return true;
+}
 
-    uint16_t bestResponseTimeout = 200;
-    float bestResponseTimeoutRate = 0.0;
+// Number of values a factor range produces
+int countFactorSteps(const DOEFactorRange& range) {
+    return (range.max - range.min) / range.step + 1;
+}
 
-    // Collect all results for this phase
-    DOEResult responseTimeoutResults[20]; // Max 20 results
-    int responseTimeoutResultCount = 0;
+// Fail percentage of one configuration in one block of the current phase
+float getBlockFailRate(DOEResult* results, int config, int block) {
+    if (doeBlockReads[config][block] == 0) {
+        return 100.0 - results[config].successRate;
+    }
+    return (doeBlockFails[config][block] * 100.0) / doeBlockReads[config][block];
+}
 
-    for (uint16_t responseTimeout = doeConfig.responseTimeoutMin;
-         responseTimeout <= doeConfig.responseTimeoutMax;
-         responseTimeout += doeConfig.responseTimeoutStep) {
+uint16_t getFactorValue(const DOEResult& result, int factor) {
+    switch (factor) {
+        case DOE_START_SIGNAL: return result.startSignal;
+        case DOE_RESPONSE_TIMEOUT: return result.responseTimeout;
+        case DOE_BIT_TIMEOUT: return result.bitTimeout;
+        default: return result.bitThreshold;
+    }
+}
 
-        DOEResult result = testParameterSet(bestStartSignal, responseTimeout, 100, 50);
+void setFactorValue(DOEResult& result, int factor, uint16_t value) {
+    switch (factor) {
+        case DOE_START_SIGNAL: result.startSignal = value; break;
+        case DOE_RESPONSE_TIMEOUT: result.responseTimeout = value; break;
+        case DOE_BIT_TIMEOUT: result.bitTimeout = value; break;
+        default: result.bitThreshold = value; break;
+    }
+}
 
-        // Store result for summary
-        if (responseTimeoutResultCount < 20) {
-            responseTimeoutResults[responseTimeoutResultCount++] = result;
+// Fill out[] with the configurations of one phase, returns the count
+// phaseFactor = factor swept in an OFAT phase, or -1 for the full factorial phase
+int buildPhaseConfigs(const DOEPlan& plan, int phaseFactor, const DOEResult& base, DOEResult* out) {
+    int count = 0;
+
+    if (phaseFactor >= 0) {
+        const DOEFactorRange& range = plan.factors[phaseFactor];
+        for (uint32_t v = range.min; v <= range.max && count < DOE_MAX_CONFIGS; v += range.step) {
+            out[count] = base;
+            setFactorValue(out[count], phaseFactor, (uint16_t)v);
+            count++;
         }
-
-        if (result.successRate > bestResponseTimeoutRate) {
-            bestResponseTimeoutRate = result.successRate;
-            bestResponseTimeout = result.responseTimeout;
-            bestResult = result;
-            publishDOEResult(result, true);
-        } else {
-            publishDOEResult(result, false);
+    } else {
+        // Odometer over every swept factor; unswept factors keep base values
+        uint16_t value[DOE_FACTOR_COUNT];
+        for (int f = 0; f < DOE_FACTOR_COUNT; f++) {
+            value[f] = plan.factors[f].swept ? plan.factors[f].min : getFactorValue(base, f);
         }
+        while (count < DOE_MAX_CONFIGS) {
+            out[count] = base;
+            for (int f = 0; f < DOE_FACTOR_COUNT; f++) {
+                setFactorValue(out[count], f, value[f]);
+            }
+            count++;
 
-        testsCompleted++;
-        doeProgress = (testsCompleted * 100) / (startSignalSteps + responseTimeoutSteps + bitTimeoutSteps + bitThresholdSteps);
-
-        Particle.process();
-        delay(100);
-
-        if (!doeActive) {
-            Log.info("DOE stopped during response timeout testing");
-            return;
+            int f = 0;
+            for (; f < DOE_FACTOR_COUNT; f++) {
+                if (!plan.factors[f].swept) {
+                    continue;
+                }
+                if (value[f] + plan.factors[f].step <= plan.factors[f].max) {
+                    value[f] += plan.factors[f].step;
+                    break;
+                }
+                value[f] = plan.factors[f].min;
+            }
+            if (f == DOE_FACTOR_COUNT) {
+                break;  // All combinations produced
+            }
         }
     }
 
-    Log.info("Best response timeout: %d us (%.1f%% success)", bestResponseTimeout, bestResponseTimeoutRate);
-
-    // Publish phase 2 summary statistics
-    publishPhaseSummary("response_timeout", responseTimeoutResults, responseTimeoutResultCount);
-
-    // Phase 3: Test Bit Timeout parameter
-    doeStatus = "testing_bit_timeout";
-    Log.info("--- Phase 3: Testing Bit Timeout Parameter ---");
-    publishDOEStatus("Phase 3/4: Testing bit timeout");
-
-    uint16_t bestBitTimeout = 100;
-    float bestBitTimeoutRate = 0.0;
-
-    // Collect all results for this phase
-    DOEResult bitTimeoutResults[20]; // Max 20 results
-    int bitTimeoutResultCount = 0;
+    for (int i = 0; i < count; i++) {
+        out[i].successCount = 0;
+        out[i].failCount = 0;
+        out[i].successRate = 0.0;
+    }
+    return count;
+}
 
-    for (uint16_t bitTimeout = doeConfig.bitTimeoutMin;
-         bitTimeout <= doeConfig.bitTimeoutMax;
-         bitTimeout += doeConfig.bitTimeoutStep) {
+// Main DOE experiment - runs the compiled plan phase by phase
+void runDOEExperiment() {
+    Log.info("=== DOE Experiment Running ===");
+    doeStatus = "running";
 
-        DOEResult result = testParameterSet(bestStartSignal, bestResponseTimeout, bitTimeout, 50);
+    // DOE reads continuously - keep a power-gated sensor on for the whole run
+    if (!dht.isPowered()) {
+        dht.powerOn();
+        delay(DHT_POWER_SETTLE_MS);
+    }
 
-        // Store result for summary
-        if (bitTimeoutResultCount < 20) {
-            bitTimeoutResults[bitTimeoutResultCount++] = result;
+    // Phases: one per swept factor (OFAT) or a single full factorial phase
+    int phases[DOE_FACTOR_COUNT];
+    int phaseCount = 0;
+    int totalTests = 0;
+    if (doePlan.design == DOE_DESIGN_FULL) {
+        phases[phaseCount++] = -1;
+        totalTests = 1;
+        for (int f = 0; f < DOE_FACTOR_COUNT; f++) {
+            if (doePlan.factors[f].swept) {
+                totalTests *= countFactorSteps(doePlan.factors[f]);
+            }
         }
-
-        if (result.successRate > bestBitTimeoutRate) {
-            bestBitTimeoutRate = result.successRate;
-            bestBitTimeout = result.bitTimeout;
-            bestResult = result;
-            publishDOEResult(result, true);
-        } else {
-            publishDOEResult(result, false);
+    } else {
+        for (int f = 0; f < DOE_FACTOR_COUNT; f++) {
+            if (doePlan.factors[f].swept) {
+                phases[phaseCount++] = f;
+                totalTests += countFactorSteps(doePlan.factors[f]);
+            }
         }
+    }
+    // Progress counts bursts: every configuration runs once per block
+    totalTests *= doePlan.blocks;
+    int testsCompleted = 0;
 
-        testsCompleted++;
-        doeProgress = (testsCompleted * 100) / (startSignalSteps + responseTimeoutSteps + bitTimeoutSteps + bitThresholdSteps);
-
-        Particle.process();
-        delay(100);
+    Log.info("DOE Plan: %s", doePlanSummary.c_str());
+    Log.info("  Total configurations: %d", totalTests);
 
-        if (!doeActive) {
-            Log.info("DOE stopped during bit timeout testing");
-            return;
+    // Held factors start from the parameters in use when the DOE started,
+    // or the value the plan fixed them at
+    DOEResult base = {dht.getStartSignal(), dht.getResponseTimeout(),
+                      dht.getBitTimeout(), dht.getBitThreshold(), 0, 0, 0.0};
+    for (int f = 0; f < DOE_FACTOR_COUNT; f++) {
+        if (doePlan.factors[f].fixed) {
+            setFactorValue(base, f, doePlan.factors[f].min);
         }
     }
 
-    Log.info("Best bit timeout: %d us (%.1f%% success)", bestBitTimeout, bestBitTimeoutRate);
-
-    // Publish phase 3 summary statistics
-    publishPhaseSummary("bit_timeout", bitTimeoutResults, bitTimeoutResultCount);
-
-    // Phase 4: Test Bit Threshold parameter
-    doeStatus = "testing_bit_threshold";
-    Log.info("--- Phase 4: Testing Bit Threshold Parameter ---");
-    publishDOEStatus("Phase 4/4: Testing bit threshold");
+    for (int p = 0; p < phaseCount; p++) {
+        int factor = phases[p];
+        const char* phaseName = (factor >= 0) ? DOE_FACTOR_NAMES[factor] : "full_factorial";
+
+        doeStatus = String("testing_") + phaseName;
+        Log.info("--- Phase %d/%d: Testing %s ---", p + 1, phaseCount, phaseName);
+        publishDOEStatus(String::format("Phase %d/%d: Testing %s", p + 1, phaseCount, phaseName));
+
+        int resultCount = buildPhaseConfigs(doePlan, factor, base, doeResults);
+        float bestPhaseRate = -1.0;
+        memset(doeBlockReads, 0, sizeof(doeBlockReads));
+        memset(doeBlockFails, 0, sizeof(doeBlockFails));
+
+        // Each block runs a short burst of every configuration, so slow drift in
+        // ambient conditions is spread over all configurations instead of
+        // following the sweep
+        int order[DOE_MAX_CONFIGS];
+        for (int block = 0; block < doePlan.blocks; block++) {
+            for (int i = 0; i < resultCount; i++) {
+                order[i] = i;
+            }
+            if (doePlan.order == DOE_ORDER_RANDOM) {
+                for (int i = resultCount - 1; i > 0; i--) {
+                    int j = random(i + 1);
+                    int swap = order[i];
+                    order[i] = order[j];
+                    order[j] = swap;
+                }
+            }
 
-    uint16_t bestBitThreshold = 50;
-    float bestBitThresholdRate = 0.0;
+            // Spread the reads evenly, earlier blocks take the remainder
+            int reads = doePlan.readsPerConfig / doePlan.blocks;
+            if (block < doePlan.readsPerConfig % doePlan.blocks) {
+                reads++;
+            }
 
-    // Collect all results for this phase
-    DOEResult bitThresholdResults[20]; // Max 20 results
-    int bitThresholdResultCount = 0;
+            for (int k = 0; k < resultCount; k++) {
+                DOEResult& result = doeResults[order[k]];
+                testsCompleted++;
+                doeProgress = (testsCompleted * 100) / totalTests;
 
-    for (uint16_t bitThreshold = doeConfig.bitThresholdMin;
-         bitThreshold <= doeConfig.bitThresholdMax;
-         bitThreshold += doeConfig.bitThresholdStep) {
+                // Configuration already abandoned by the early-stop rule
+                if (doePlan.stopFailures > 0 && result.failCount >= doePlan.stopFailures) {
+                    continue;
+                }
 
-        DOEResult result = testParameterSet(bestStartSignal, bestResponseTimeout, bestBitTimeout, bitThreshold);
+                int stopFailures = (doePlan.stopFailures > 0) ? doePlan.stopFailures - result.failCount : 0;
+                DOEResult burst = testParameterSet(result.startSignal, result.responseTimeout,
+                                                   result.bitTimeout, result.bitThreshold,
+                                                   reads, stopFailures);
+                result.successCount += burst.successCount;
+                result.failCount += burst.failCount;
+                result.successRate = (result.successCount * 100.0) / (result.successCount + result.failCount);
+                doeBlockReads[order[k]][block] = burst.successCount + burst.failCount;
+                doeBlockFails[order[k]][block] = burst.failCount;
+
+                // Report each configuration once, when its last burst is done
+                bool stopped = doePlan.stopFailures > 0 && result.failCount >= doePlan.stopFailures;
+                if (block == doePlan.blocks - 1 || stopped) {
+                    if (result.successRate > bestPhaseRate) {
+                        bestPhaseRate = result.successRate;
+                        base = result;
+                        bestResult = result;
+                        publishDOEResult(result, true);
+                    } else {
+                        publishDOEResult(result, false);
+                    }
+                }
 
-        // Store result for summary
-        if (bitThresholdResultCount < 20) {
-            bitThresholdResults[bitThresholdResultCount++] = result;
-        }
+                // Allow cloud communication
+                serviceEventEnvelope();
+                Particle.process();
+                delay(100);
 
-        if (result.successRate > bestBitThresholdRate) {
-            bestBitThresholdRate = result.successRate;
-            bestBitThreshold = result.bitThreshold;
-            bestResult = result;
-            publishDOEResult(result, true);
-        } else {
-            publishDOEResult(result, false);
+                // Check if stopped
+                if (!doeActive) {
+                    Log.info("DOE stopped during %s testing", phaseName);
+                    return;
+                }
+            }
         }
 
-        testsCompleted++;
-        doeProgress = (testsCompleted * 100) / (startSignalSteps + responseTimeoutSteps + bitTimeoutSteps + bitThresholdSteps);
+        Log.info("Best %s: SS=%d RT=%d BT=%d BTh=%d (%.1f%% success)", phaseName,
+                 base.startSignal, base.responseTimeout, base.bitTimeout, base.bitThreshold,
+                 bestPhaseRate);
 
-        Particle.process();
-        delay(100);
-
-        if (!doeActive) {
-            Log.info("DOE stopped during bit threshold testing");
-            return;
-        }
+        // Publish phase summary statistics
+        publishPhaseSummary(factor, doeResults, resultCount);
     }
 
-    Log.info("Best bit threshold: %d us (%.1f%% success)", bestBitThreshold, bestBitThresholdRate);
-
-    // Publish phase 4 summary statistics
-    publishPhaseSummary("bit_threshold", bitThresholdResults, bitThresholdResultCount);
-
     // DOE Complete!
     doeStatus = "complete";
     doeProgress = 100;
@@ -1175,6 +2675,14 @@ void runDOEExperiment() {
     // Save optimal parameters to EEPROM for persistence
     saveTimingParametersToEEPROM();
 
+    // The result also becomes the timing profile for the temperature it was found at
+    if (doeTemperatureCount > 0) {
+        storeTimingProfile(doeTemperatureSum / doeTemperatureCount, PROFILE_DOE,
+                           (uint16_t)(bestResult.successRate * 10));
+    }
+    setTimingOverride(false);
+    trace.record(TRACE_DOE, 2, 0, (int32_t)(bestResult.successRate * 10));
+
     // Publish final results
     char finalMsg[256];
     snprintf(finalMsg, sizeof(finalMsg),
@@ -1189,8 +2697,10 @@ void runDOEExperiment() {
 }
 
 // Test a specific parameter set
+// Stops early once stopFailures reads have failed (0 = always perform all reads)
 DOEResult testParameterSet(uint16_t startSignal, uint16_t responseTimeout,
-                           uint16_t bitTimeout, uint16_t bitThreshold) {
+                           uint16_t bitTimeout, uint16_t bitThreshold,
+                           int reads, int stopFailures) {
 
     DOEResult result;
     result.startSignal = startSignal;
@@ -1210,18 +2720,25 @@ DOEResult testParameterSet(uint16_t startSignal, uint16_t responseTimeout,
              startSignal, responseTimeout, bitTimeout, bitThreshold);
 
     // Perform multiple reads
-    for (int i = 0; i < doeConfig.testsPerConfig; i++) {
+    for (int i = 0; i < reads; i++) {
         float temp, humidity;
         bool success = dht.read(temp, humidity);
 
         if (success) {
             result.successCount++;
+            doeTemperatureSum += temp;
+            doeTemperatureCount++;
         } else {
             result.failCount++;
         }
 
         // Wait 2 seconds between reads (DHT22 requirement)
         delay(2000);
+
+        if (stopFailures > 0 && result.failCount >= stopFailures) {
+            Log.info("Early stop after %d failures", result.failCount);
+            break;
+        }
     }
 
     result.successRate = (result.successCount * 100.0) / (result.successCount + result.failCount);
@@ -1243,7 +2760,7 @@ void publishDOEStatus(String status) {
     snprintf(msg, sizeof(msg), "{\"status\":\"%s\",\"progress\":%d,\"elapsed\":%lu}",
              status.c_str(), doeProgress, Time.now() - doeStartTime);
 
-    Particle.publish("doe/status", msg, PRIVATE);
+    eventEnvelope.post("doe/status", msg);
     Log.info("DOE Status: %s", msg);
 }
 
@@ -1260,7 +2777,7 @@ void publishDOEResult(DOEResult result, bool isBest) {
              result.successCount, result.failCount, result.successRate,
              isBest ? "true" : "false");
 
-    Particle.publish("doe/result", msg, PRIVATE);
+    eventEnvelope.post("doe/result", msg);
 
     if (isBest) {
         Log.info("NEW BEST: %s", msg);
@@ -1268,16 +2785,19 @@ void publishDOEResult(DOEResult result, bool isBest) {
 }
 
 // Publish phase summary with statistics (for spreadsheet export)
-void publishPhaseSummary(String paramName, DOEResult* results, int resultCount) {
+// factor = factor swept in an OFAT phase, or -1 for a full factorial phase
+void publishPhaseSummary(int factor, DOEResult* results, int resultCount) {
     if (!Particle.connected() || resultCount == 0) {
         return;
     }
 
+    const char* paramName = (factor >= 0) ? DOE_FACTOR_NAMES[factor] : "full_factorial";
+
     // Calculate statistics
     float sumFailRate = 0.0;
     float minFailRate = 100.0;
     float maxFailRate = 0.0;
-    uint16_t bestValue = 0;
+    int bestIndex = 0;
 
     // First pass: sum and find min/max
     for (int i = 0; i < resultCount; i++) {
@@ -1286,16 +2806,7 @@ void publishPhaseSummary(String paramName, DOEResult* results, int resultCount)
 
         if (failRate < minFailRate) {
             minFailRate = failRate;
-            // Determine which parameter value this result represents
-            if (paramName == "start_signal") {
-                bestValue = results[i].startSignal;
-            } else if (paramName == "response_timeout") {
-                bestValue = results[i].responseTimeout;
-            } else if (paramName == "bit_timeout") {
-                bestValue = results[i].bitTimeout;
-            } else if (paramName == "bit_threshold") {
-                bestValue = results[i].bitThreshold;
-            }
+            bestIndex = i;
         }
 
         if (failRate > maxFailRate) {
@@ -1319,16 +2830,71 @@ void publishPhaseSummary(String paramName, DOEResult* results, int resultCount)
     // Measures relative variability; lower CV = more consistent results
     float cv = (avgFailRate > 0.001) ? (stdDev / avgFailRate) * 100.0 : 0.0;
 
+    // Block analysis (randomized complete block design)
+    // Fail rates are modelled as configuration effect + block effect + error;
+    // removing the block effect takes ambient drift out of the error term
+    int blocks = doePlan.blocks;
+    float blockStdDev = 0.0;
+    float fStat = 0.0;
+    float residualMeanSquare = 0.0;
+
+    if (blocks > 1 && resultCount > 1) {
+        float blockMean[DOE_MAX_BLOCKS] = {0};
+        float configMean[DOE_MAX_CONFIGS];
+        float grandMean = 0.0;
+
+        // Configurations abandoned early have no reads in later blocks;
+        // those cells take the configuration's overall fail rate
+        for (int i = 0; i < resultCount; i++) {
+            configMean[i] = 0.0;
+            for (int b = 0; b < blocks; b++) {
+                configMean[i] += getBlockFailRate(results, i, b);
+            }
+            configMean[i] /= blocks;
+            grandMean += configMean[i];
+        }
+        grandMean /= resultCount;
+
+        for (int b = 0; b < blocks; b++) {
+            for (int i = 0; i < resultCount; i++) {
+                blockMean[b] += getBlockFailRate(results, i, b);
+            }
+            blockMean[b] /= resultCount;
+            blockStdDev += (blockMean[b] - grandMean) * (blockMean[b] - grandMean);
+        }
+        blockStdDev = sqrt(blockStdDev / blocks);
+
+        float ssConfig = 0.0;
+        float ssResidual = 0.0;
+        for (int i = 0; i < resultCount; i++) {
+            ssConfig += blocks * (configMean[i] - grandMean) * (configMean[i] - grandMean);
+            for (int b = 0; b < blocks; b++) {
+                float residual = getBlockFailRate(results, i, b) - configMean[i] - blockMean[b] + grandMean;
+                ssResidual += residual * residual;
+            }
+        }
+        residualMeanSquare = ssResidual / ((resultCount - 1) * (blocks - 1));
+        if (residualMeanSquare > 0.0001) {
+            fStat = (ssConfig / (resultCount - 1)) / residualMeanSquare;
+        }
+    }
+
     // Calculate statistical significance (p-value approximation)
     // Using z-score: z = (best - mean) / (stdDev / sqrt(n))
     // This tests if the best result is significantly different from the mean
+    // With blocks the standard error comes from the block-adjusted residuals
     float zScore = 0.0;
     float pValue = 1.0;
+    float sem = 0.0;
 
-    if (stdDev > 0.001 && resultCount > 1) {
+    if (blocks > 1 && resultCount > 1) {
+        sem = sqrt(residualMeanSquare / blocks);
+    } else if (stdDev > 0.001 && resultCount > 1) {
         // Standard error of the mean
-        float sem = stdDev / sqrt(resultCount);
+        sem = stdDev / sqrt(resultCount);
+    }
 
+    if (sem > 0.001) {
         // Z-score for best result vs. average
         zScore = (avgFailRate - minFailRate) / sem;
 
@@ -1355,62 +2921,72 @@ void publishPhaseSummary(String paramName, DOEResult* results, int resultCount)
     }
 
     // Build CSV-style data for spreadsheet export
-    // Format: value,success,fail,success_rate,fail_rate (one line per test)
+    // OFAT format: value,success,fail,success_rate,fail_rate (one line per test)
+    // Full factorial format: ss,rt,bt,bth,success,fail,success_rate,fail_rate
     String csvData = "";
 
     for (int i = 0; i < resultCount; i++) {
-        uint16_t value;
-        if (paramName == "start_signal") {
-            value = results[i].startSignal;
-        } else if (paramName == "response_timeout") {
-            value = results[i].responseTimeout;
-        } else if (paramName == "bit_timeout") {
-            value = results[i].bitTimeout;
-        } else {
-            value = results[i].bitThreshold;
-        }
-
         float failRate = 100.0 - results[i].successRate;
 
         char line[80];
-        snprintf(line, sizeof(line), "%d,%d,%d,%.1f,%.1f\\n",
-                 value, results[i].successCount, results[i].failCount,
-                 results[i].successRate, failRate);
+        if (factor >= 0) {
+            snprintf(line, sizeof(line), "%d,%d,%d,%.1f,%.1f\\n",
+                     getFactorValue(results[i], factor), results[i].successCount, results[i].failCount,
+                     results[i].successRate, failRate);
+        } else {
+            snprintf(line, sizeof(line), "%d,%d,%d,%d,%d,%d,%.1f,%.1f\\n",
+                     results[i].startSignal, results[i].responseTimeout,
+                     results[i].bitTimeout, results[i].bitThreshold,
+                     results[i].successCount, results[i].failCount,
+                     results[i].successRate, failRate);
+        }
         csvData += line;
+    }
 
-        // Particle publish has size limits, so we'll publish in chunks if needed
-        // or just send summary statistics in a separate message
+    // Best value: the swept parameter (OFAT) or the whole configuration (full factorial)
+    char bestValue[32];
+    if (factor >= 0) {
+        snprintf(bestValue, sizeof(bestValue), "%d", getFactorValue(results[bestIndex], factor));
+    } else {
+        snprintf(bestValue, sizeof(bestValue), "\"%d/%d/%d/%d\"",
+                 results[bestIndex].startSignal, results[bestIndex].responseTimeout,
+                 results[bestIndex].bitTimeout, results[bestIndex].bitThreshold);
     }
 
     // Publish summary statistics
     char summaryMsg[622];
     snprintf(summaryMsg, sizeof(summaryMsg),
              "{\"param\":\"%s\",\"count\":%d,\"avg_fail\":%.2f,\"best_fail\":%.2f,\"worst_fail\":%.2f,"
-             "\"std_dev\":%.2f,\"cv\":%.2f,\"z_score\":%.2f,\"p_value\":%.4f,\"best_value\":%d}",
-             paramName.c_str(), resultCount, avgFailRate, minFailRate, maxFailRate,
-             stdDev, cv, zScore, pValue, bestValue);
+             "\"std_dev\":%.2f,\"cv\":%.2f,\"z_score\":%.2f,\"p_value\":%.4f,\"best_value\":%s,"
+             "\"blocks\":%d,\"block_sd\":%.2f,\"f_stat\":%.2f}",
+             paramName, resultCount, avgFailRate, minFailRate, maxFailRate,
+             stdDev, cv, zScore, pValue, bestValue, blocks, blockStdDev, fStat);
 
-    Particle.publish("doe/phase_summary", summaryMsg, PRIVATE);
+    eventEnvelope.post("doe/phase_summary", summaryMsg);
 
     // Store summary in appropriate cloud variable for later retrieval
-    if (paramName == "start_signal") {
+    if (factor == DOE_START_SIGNAL || factor < 0) {
         doePhase1Summary = String(summaryMsg);
-    } else if (paramName == "response_timeout") {
+    } else if (factor == DOE_RESPONSE_TIMEOUT) {
         doePhase2Summary = String(summaryMsg);
-    } else if (paramName == "bit_timeout") {
+    } else if (factor == DOE_BIT_TIMEOUT) {
         doePhase3Summary = String(summaryMsg);
-    } else if (paramName == "bit_threshold") {
+    } else if (factor == DOE_BIT_THRESHOLD) {
         doePhase4Summary = String(summaryMsg);
     }
 
-    Log.info("Phase Summary [%s]:", paramName.c_str());
+    Log.info("Phase Summary [%s]:", paramName);
     Log.info("  Avg Fail: %.2f%%  Best: %.2f%%  Worst: %.2f%%", avgFailRate, minFailRate, maxFailRate);
     Log.info("  StdDev: %.2f%%  CV: %.2f%%", stdDev, cv);
-    Log.info("  Z-Score: %.2f  P-Value: %.4f  Best Value: %d", zScore, pValue, bestValue);
+    Log.info("  Z-Score: %.2f  P-Value: %.4f  Best Value: %s", zScore, pValue, bestValue);
+    if (blocks > 1) {
+        Log.info("  Blocks: %d  Block StdDev: %.2f%%  F: %.2f", blocks, blockStdDev, fStat);
+    }
 
     // Publish detailed CSV data (may be split into multiple events if needed)
     // Due to Particle event size limits (622 bytes for data), we publish in chunks
-    const int MAX_CSV_SIZE = 600;
+    // small enough to leave room for the JSON wrapper around them
+    const int MAX_CSV_SIZE = 560;
     int csvLength = csvData.length();
     int chunks = (csvLength + MAX_CSV_SIZE - 1) / MAX_CSV_SIZE;
 
@@ -1421,9 +2997,9 @@ void publishPhaseSummary(String paramName, DOEResult* results, int resultCount)
 
         char csvMsg[650];
         snprintf(csvMsg, sizeof(csvMsg), "{\"param\":\"%s\",\"chunk\":%d,\"total\":%d,\"data\":\"%s\"}",
-                 paramName.c_str(), chunk + 1, chunks, csvChunk.c_str());
+                 paramName, chunk + 1, chunks, csvChunk.c_str());
 
-        Particle.publish("doe/phase_data", csvMsg, PRIVATE);
+        eventEnvelope.post("doe/phase_data", csvMsg);
 
         // Small delay between chunks to avoid rate limiting
         if (chunk < chunks - 1) {
@@ -1431,3 +3007,5 @@ void publishPhaseSummary(String paramName, DOEResult* results, int resultCount)
         }
     }
 }
+
+#endif // FEATURE_DOE
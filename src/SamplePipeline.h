@@ -0,0 +1,514 @@
+/*
+ * SamplePipeline - Statically composed measurement pipeline
+ * acquire -> validate -> filter -> aggregate -> emit
+ *
+ * A pipeline is a list of stage types fixed at compile time:
+ *   SamplePipeline<RetryAcquire<Reader>, JumpCheck<Reader>, MovingAverage<360>, ...>
+ * Each stage has an inline bool process(Sample&); the sample stops at the first
+ * stage that returns false. There is no virtual dispatch and stages that are
+ * not listed are not compiled in, so unused stages cost nothing.
+ *
+ * No Particle dependencies: sensor access goes through the Reader/Sink/Hook
+ * types supplied by the application, so the header also builds on a host
+ * (see tools/pipeline-bench.cpp)
+ */
+
+#ifndef SAMPLE_PIPELINE_H
+#define SAMPLE_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <tuple>
+
+// Sample flags (set by validation stages)
+enum SampleFlags : uint8_t {
+    SAMPLE_JUMP = 0x01,            // Temperature jump detected, sensor re-read
+    SAMPLE_JUMP_PERSISTED = 0x02,  // Re-read still showed the jump (accepted anyway)
+    SAMPLE_REREAD_FAILED = 0x04,   // Re-read failed, original reading kept
+    SAMPLE_CHANGE_UP = 0x08,       // Step change detected (rise)
+    SAMPLE_CHANGE_DOWN = 0x10,     // Step change detected (fall)
+    SAMPLE_CHANGE = SAMPLE_CHANGE_UP | SAMPLE_CHANGE_DOWN
+};
+
+// Why PublishGate let a sample through
+enum PublishReason : uint8_t {
+    PUBLISH_NONE = 0,
+    PUBLISH_FIRST = 1,
+    PUBLISH_INTERVAL = 2,
+    PUBLISH_CHANGE = 3,
+    PUBLISH_CHANGE_POINT = 4
+};
+
+struct Sample {
+    uint32_t time = 0;            // Unix time of the measurement (set by the caller)
+    float temperature = 0;        // Latest reading, after filter stages (C)
+    float humidity = 0;           // Latest reading, after filter stages (%)
+    float avgTemperature = 0;     // Aggregate stage output
+    float avgHumidity = 0;
+    float dewPoint = NAN;         // Derived metric (NAN unless DewPoint ran)
+    uint8_t attempts = 0;         // Sensor reads used by the acquire stage
+    uint8_t flags = 0;            // SampleFlags
+    uint8_t publishReason = PUBLISH_NONE;
+    uint8_t batchCount = 0;       // Samples collected in the current batch
+    uint8_t sensors = 1;          // Sensors that answered (SensorVote)
+    uint8_t suspectSensors = 0;   // Bit per sensor left out of the vote for drifting (SensorVote)
+    uint8_t stage = 0;            // Index of the stage that stopped the sample (stage count = ran through)
+    bool valid = false;           // Acquisition produced a reading
+};
+
+template <typename... Stages>
+class SamplePipeline {
+public:
+    static constexpr size_t STAGE_COUNT = sizeof...(Stages);
+
+    // Run the sample through the stages in order, returns true if every stage passed it on
+    inline bool process(Sample& sample) { return run<0>(sample); }
+
+    // Access a stage for configuration or state (by position or by type)
+    template <size_t I>
+    inline typename std::tuple_element<I, std::tuple<Stages...>>::type& stage() { return std::get<I>(_stages); }
+
+    template <typename S>
+    inline S& stage() { return std::get<S>(_stages); }
+
+private:
+    std::tuple<Stages...> _stages;
+
+    template <size_t I>
+    inline bool run(Sample& sample) {
+        if constexpr (I == STAGE_COUNT) {
+            sample.stage = I;
+            return true;
+        } else {
+            if (!std::get<I>(_stages).process(sample)) {
+                sample.stage = I;
+                return false;
+            }
+            return run<I + 1>(sample);
+        }
+    }
+};
+
+// ====================================================================
+// Acquire
+// ====================================================================
+
+// Read the sensor, retrying after RetryDelayMs on failure
+// Reader: static bool read(float& temperature, float& humidity); static void wait(uint32_t ms)
+template <typename Reader, uint8_t Retries = 1, uint32_t RetryDelayMs = 2000>
+struct RetryAcquire {
+    inline bool process(Sample& sample) {
+        for (uint8_t attempt = 0; attempt <= Retries; attempt++) {
+            if (attempt > 0) {
+                Reader::wait(RetryDelayMs);
+            }
+            sample.attempts = attempt + 1;
+            if (Reader::read(sample.temperature, sample.humidity)) {
+                sample.valid = true;
+                return true;
+            }
+        }
+        sample.valid = false;
+        return false;
+    }
+};
+
+// Read N co-located sensors and vote: the reading is the median of the sensors
+// that answered, or with Trim > 0 the mean after dropping the Trim lowest and
+// highest. Each sensor's temperature residual from the consensus is tracked (EMA); a sensor
+// whose mean residual exceeds DriftTenths/10 C is marked suspect and left out of
+// the vote until it comes back within half of that. A single bad read is outvoted,
+// so no re-read is needed
+// Reader: static bool read(uint8_t sensor, float& temperature, float& humidity)
+template <typename Reader, uint8_t N, uint8_t Trim = 0, uint16_t DriftTenths = 5>
+struct SensorVote {
+    static_assert(N >= 1 && N <= 8, "SensorVote supports 1-8 sensors");
+
+    float residual[N] = {};       // EMA of temperature - consensus (C)
+    uint8_t suspect = 0;          // Bit per sensor
+
+    inline bool process(Sample& sample) {
+        float temps[N];
+        float hums[N];
+        bool answered[N];
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < N; i++) {
+            answered[i] = Reader::read(i, temps[i], hums[i]);
+            count += answered[i];
+        }
+        sample.attempts = 1;
+        sample.sensors = count;
+        if (count == 0) {
+            sample.valid = false;
+            return false;
+        }
+
+        // Vote among trusted sensors; fall back to all answers if none of them answered
+        bool trustedAnswered = false;
+        for (uint8_t i = 0; i < N; i++) {
+            trustedAnswered |= answered[i] && !(suspect & (1 << i));
+        }
+        float voteTemps[N];
+        float voteHums[N];
+        uint8_t votes = 0;
+        for (uint8_t i = 0; i < N; i++) {
+            if (answered[i] && (!trustedAnswered || !(suspect & (1 << i)))) {
+                voteTemps[votes] = temps[i];
+                voteHums[votes] = hums[i];
+                votes++;
+            }
+        }
+        sample.temperature = consensus(voteTemps, votes);
+        sample.humidity = consensus(voteHums, votes);
+
+        // Residuals need a majority to be meaningful
+        if (count >= 3) {
+            const float weight = 0.1f;
+            const float drift = DriftTenths / 10.0f;
+            for (uint8_t i = 0; i < N; i++) {
+                if (!answered[i]) {
+                    continue;
+                }
+                // Clipped so one wild read cannot mark a sensor on its own
+                float error = fmaxf(-2 * drift, fminf(2 * drift, temps[i] - sample.temperature));
+                residual[i] += weight * (error - residual[i]);
+                float r = fabsf(residual[i]);
+                if (r > drift) {
+                    suspect |= (1 << i);
+                } else if (r < drift / 2) {
+                    suspect &= ~(1 << i);
+                }
+            }
+        }
+        sample.suspectSensors = suspect;
+        sample.valid = true;
+        return true;
+    }
+
+    // Median (Trim = 0) or trimmed mean of count values (sorted in place)
+    static inline float consensus(float* values, uint8_t count) {
+        for (uint8_t i = 1; i < count; i++) {
+            float v = values[i];
+            uint8_t j = i;
+            for (; j > 0 && values[j - 1] > v; j--) {
+                values[j] = values[j - 1];
+            }
+            values[j] = v;
+        }
+        if (Trim > 0 && count > 2 * Trim) {
+            float sum = 0.0f;
+            for (uint8_t i = Trim; i < count - Trim; i++) {
+                sum += values[i];
+            }
+            return sum / (count - 2 * Trim);
+        }
+        return (count & 1) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2.0f;
+    }
+};
+
+// ====================================================================
+// Validate
+// ====================================================================
+
+// Drop readings outside the DHT22 specification
+struct RangeCheck {
+    inline bool process(Sample& sample) {
+        return sample.temperature >= -40.0f && sample.temperature <= 80.0f &&
+               sample.humidity >= 0.0f && sample.humidity <= 100.0f;
+    }
+};
+
+// Re-read once when the temperature jumps more than ThresholdTenths/10 C from the
+// last accepted reading; the re-read is used if it succeeds, otherwise the original
+template <typename Reader, uint16_t ThresholdTenths = 10, uint32_t DelayMs = 2000>
+struct JumpCheck {
+    bool hasLast = false;
+    float last = 0;
+
+    inline bool process(Sample& sample) {
+        const float threshold = ThresholdTenths / 10.0f;
+        if (hasLast && fabsf(sample.temperature - last) > threshold) {
+            sample.flags |= SAMPLE_JUMP;
+            Reader::wait(DelayMs);
+
+            float retryTemp = 0;
+            float retryHumidity = 0;
+            if (Reader::read(retryTemp, retryHumidity)) {
+                if (fabsf(retryTemp - last) > threshold) {
+                    sample.flags |= SAMPLE_JUMP_PERSISTED;
+                }
+                sample.temperature = retryTemp;
+                sample.humidity = retryHumidity;
+            } else {
+                sample.flags |= SAMPLE_REREAD_FAILED;
+            }
+        }
+        hasLast = true;
+        last = sample.temperature;
+        return true;
+    }
+};
+
+// Step-change detection: two-sided CUSUM of the raw temperature against a
+// slowly tracking baseline. Deviations beyond SlackHundredths/100 C accumulate;
+// SAMPLE_CHANGE_UP/DOWN is flagged when the sum passes ThresholdTenths/10 C
+// (defaults: a 1 C step is flagged on its 2nd sample, a 2 C step on its 1st).
+// The baseline follows each sample with weight BaselinePercent/100, so slow
+// drift and sensor noise keep both sums near zero
+template <uint16_t SlackHundredths = 15, uint16_t ThresholdTenths = 10, uint8_t BaselinePercent = 5>
+struct ChangeDetector {
+    bool primed = false;
+    float baseline = 0;
+    float rise = 0;     // Cumulative deviation above the baseline
+    float fall = 0;     // Cumulative deviation below the baseline
+
+    inline bool process(Sample& sample) {
+        if (!primed) {
+            baseline = sample.temperature;
+            primed = true;
+            return true;
+        }
+
+        const float slack = SlackHundredths / 100.0f;
+        const float threshold = ThresholdTenths / 10.0f;
+        float deviation = sample.temperature - baseline;
+        rise = fmaxf(0.0f, rise + deviation - slack);
+        fall = fmaxf(0.0f, fall - deviation - slack);
+
+        if (rise > threshold || fall > threshold) {
+            sample.flags |= (rise > fall) ? SAMPLE_CHANGE_UP : SAMPLE_CHANGE_DOWN;
+            baseline = sample.temperature;  // Track the new level from here
+            rise = 0;
+            fall = 0;
+        } else {
+            baseline += (BaselinePercent / 100.0f) * deviation;
+        }
+        return true;
+    }
+};
+
+// ====================================================================
+// Filter
+// ====================================================================
+
+// Outlier rejection: replace each reading with the median of the last N
+template <uint8_t N>
+struct MedianFilter {
+    float temps[N] = {};
+    float hums[N] = {};
+    uint8_t index = 0;
+    uint8_t count = 0;
+
+    inline bool process(Sample& sample) {
+        temps[index] = sample.temperature;
+        hums[index] = sample.humidity;
+        index = (index + 1) % N;
+        if (count < N) count++;
+
+        sample.temperature = median(temps);
+        sample.humidity = median(hums);
+        return true;
+    }
+
+    inline float median(const float* values) const {
+        float sorted[N];
+        for (uint8_t i = 0; i < count; i++) {
+            float v = values[i];
+            uint8_t j = i;
+            for (; j > 0 && sorted[j - 1] > v; j--) {
+                sorted[j] = sorted[j - 1];
+            }
+            sorted[j] = v;
+        }
+        return (count & 1) ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0f;
+    }
+};
+
+// Exponential smoothing with weight AlphaPercent/100 on the newest reading
+template <uint8_t AlphaPercent>
+struct EmaSmoothing {
+    bool primed = false;
+    float temperature = 0;
+    float humidity = 0;
+
+    inline bool process(Sample& sample) {
+        const float alpha = AlphaPercent / 100.0f;
+        if (primed) {
+            temperature += alpha * (sample.temperature - temperature);
+            humidity += alpha * (sample.humidity - humidity);
+        } else {
+            temperature = sample.temperature;
+            humidity = sample.humidity;
+            primed = true;
+        }
+        sample.temperature = temperature;
+        sample.humidity = humidity;
+        return true;
+    }
+};
+
+// Derived metric: dew point (Magnus formula, Sonntag constants)
+struct DewPoint {
+    inline bool process(Sample& sample) {
+        if (sample.humidity <= 0.0f) {
+            sample.dewPoint = NAN;
+            return true;
+        }
+        const float b = 17.62f;
+        const float c = 243.12f;
+        float gamma = logf(sample.humidity / 100.0f) + b * sample.temperature / (c + sample.temperature);
+        sample.dewPoint = c * gamma / (b - gamma);
+        return true;
+    }
+};
+
+// ====================================================================
+// Aggregate
+// ====================================================================
+
+// Moving average over the last size() readings (size adjustable up to Capacity)
+// A flagged step change restarts the window so the average does not lag the step
+template <size_t Capacity>
+class MovingAverage {
+public:
+    inline bool process(Sample& sample) {
+        if (sample.flags & SAMPLE_CHANGE) {
+            _index = 0;
+            _count = 0;
+        }
+        _temps[_index] = sample.temperature;
+        _hums[_index] = sample.humidity;
+        _index = (_index + 1) % _size;
+        if (_count < _size) _count++;
+
+        float sumTemp = 0.0f;
+        float sumHum = 0.0f;
+        for (size_t i = 0; i < _count; i++) {
+            sumTemp += _temps[i];
+            sumHum += _hums[i];
+        }
+        sample.avgTemperature = sumTemp / _count;
+        sample.avgHumidity = sumHum / _count;
+        return true;
+    }
+
+    // Resize the window; keeps the newest readings that still fit
+    void setSize(size_t size) {
+        if (size < 1) size = 1;
+        if (size > Capacity) size = Capacity;
+
+        // Put the readings in order (oldest first), then drop the oldest that no longer fit
+        if (_count == _size) {
+            std::rotate(_temps, _temps + _index, _temps + _size);
+            std::rotate(_hums, _hums + _index, _hums + _size);
+        }
+        if (_count > size) {
+            memmove(_temps, _temps + _count - size, size * sizeof(float));
+            memmove(_hums, _hums + _count - size, size * sizeof(float));
+            _count = size;
+        }
+        _size = size;
+        _index = _count % _size;
+    }
+
+    size_t getSize() const { return _size; }
+    size_t getCount() const { return _count; }
+
+private:
+    float _temps[Capacity];
+    float _hums[Capacity];
+    size_t _size = Capacity;
+    size_t _index = 0;
+    size_t _count = 0;
+};
+
+// ====================================================================
+// Emit
+// ====================================================================
+
+// Pass a sample on when it is the first, carries a step change, MaxSilenceSec have
+// passed, or the average temperature moved at least ChangeHundredths/100 C since
+// the last one passed
+template <uint16_t ChangeHundredths = 50, uint32_t MaxSilenceSec = 3600>
+struct PublishGate {
+    uint32_t lastTime = 0;
+    float lastTemperature = 0;
+
+    inline bool process(Sample& sample) {
+        if (lastTime == 0) {
+            sample.publishReason = PUBLISH_FIRST;
+        } else if (sample.flags & SAMPLE_CHANGE) {
+            sample.publishReason = PUBLISH_CHANGE_POINT;
+        } else if (sample.time - lastTime >= MaxSilenceSec) {
+            sample.publishReason = PUBLISH_INTERVAL;
+        } else if (fabsf(sample.avgTemperature - lastTemperature) >= ChangeHundredths / 100.0f) {
+            sample.publishReason = PUBLISH_CHANGE;
+        } else {
+            sample.publishReason = PUBLISH_NONE;
+            return false;
+        }
+        lastTime = sample.time;
+        lastTemperature = sample.avgTemperature;
+        return true;
+    }
+};
+
+// Compression: drop samples whose averages moved less than StepHundredths/100
+// (C or %) from the last sample passed on
+template <uint16_t StepHundredths>
+struct Deadband {
+    bool primed = false;
+    float temperature = 0;
+    float humidity = 0;
+
+    inline bool process(Sample& sample) {
+        const float step = StepHundredths / 100.0f;
+        if (primed && fabsf(sample.avgTemperature - temperature) < step &&
+            fabsf(sample.avgHumidity - humidity) < step) {
+            return false;
+        }
+        primed = true;
+        temperature = sample.avgTemperature;
+        humidity = sample.avgHumidity;
+        return true;
+    }
+};
+
+// Batching: collect N samples, pass on the sample that completes a batch
+// (the sink reads the batch through samples())
+template <uint8_t N>
+struct Batch {
+    Sample batch[N];
+    uint8_t count = 0;
+
+    inline bool process(Sample& sample) {
+        if (count == N) {
+            count = 0;
+        }
+        batch[count++] = sample;
+        sample.batchCount = count;
+        return count == N;
+    }
+
+    const Sample* samples() const { return batch; }
+};
+
+// Hand the sample to the application: Sink: static bool emit(const Sample&)
+template <typename Sink>
+struct Emit {
+    inline bool process(Sample& sample) { return Sink::emit(sample); }
+};
+
+// Observe the sample at this point of the pipeline: Hook: static void observe(const Sample&)
+template <typename Hook>
+struct Tap {
+    inline bool process(Sample& sample) {
+        Hook::observe(sample);
+        return true;
+    }
+};
+
+#endif // SAMPLE_PIPELINE_H
@@ -0,0 +1,30 @@
+/*
+ * SelfBench - On-device micro-benchmarks timed with the DWT cycle counter
+ */
+
+#include "SelfBench.h"
+
+#if FEATURE_DIAGNOSTICS
+
+SelfBench::SelfBench() : _count(0) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+size_t SelfBench::format(char* out, size_t size) {
+    int len = snprintf(out, size, "{\"os\":\"%s\",\"mhz\":%lu,\"cyc\":{",
+                       System.version().c_str(), (unsigned long)(SystemCoreClock / 1000000));
+    for (uint8_t i = 0; i < _count && len > 0 && (size_t)len < size; i++) {
+        len += snprintf(out + len, size - len, "%s\"%s\":%lu", i ? "," : "",
+                        _results[i].name, (unsigned long)_results[i].cycles);
+    }
+    if (len > 0 && (size_t)len < size) {
+        len += snprintf(out + len, size - len, "}}");
+    }
+    if (len < 0) {
+        len = 0;
+    }
+    return ((size_t)len < size) ? len : size - 1;
+}
+
+#endif // FEATURE_DIAGNOSTICS
@@ -0,0 +1,64 @@
+/*
+ * SelfBench - On-device micro-benchmarks timed with the DWT cycle counter
+ * Compares firmware builds and Device OS versions on real hardware without
+ * a debugger; the kernels themselves are defined by the application
+ */
+
+#ifndef SELF_BENCH_H
+#define SELF_BENCH_H
+
+#include "Particle.h"
+#include "nrf52840.h"
+#include "Features.h"
+
+#if FEATURE_DIAGNOSTICS
+
+class SelfBench {
+public:
+    static const uint8_t MAX_RESULTS = 12;
+    static const uint8_t REPEATS = 5;     // Best of 5 runs (filters system thread preemption)
+
+    // Enables the DWT cycle counter
+    SelfBench();
+
+    // Time iterations calls of fn, keep cycles per call (best run)
+    template <typename F>
+    void run(const char* name, uint16_t iterations, F fn) {
+        if (_count == MAX_RESULTS || iterations == 0) {
+            return;
+        }
+        uint32_t best = UINT32_MAX;
+        for (uint8_t r = 0; r < REPEATS; r++) {
+            uint32_t start = DWT->CYCCNT;
+            for (uint16_t i = 0; i < iterations; i++) {
+                fn();
+            }
+            uint32_t elapsed = DWT->CYCCNT - start;
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+        _results[_count].name = name;
+        _results[_count].cycles = best / iterations;
+        _count++;
+    }
+
+    // Compact JSON: {"os":"6.1.1","mhz":64,"cyc":{"<name>":<cycles per call>,...}}
+    // Returns the length written (truncated to size - 1)
+    size_t format(char* out, size_t size);
+
+    uint8_t getCount() { return _count; }
+
+private:
+    struct Result {
+        const char* name;
+        uint32_t cycles;
+    };
+
+    Result _results[MAX_RESULTS];
+    uint8_t _count;
+};
+
+#endif // FEATURE_DIAGNOSTICS
+
+#endif // SELF_BENCH_H
@@ -0,0 +1,113 @@
+/*
+ * SensorRecovery - Power-cycle recovery state machine for a latched-up DHT22
+ * Pure logic with caller-supplied time (no Particle dependencies) so it can be
+ * compiled and simulated on a host
+ */
+
+#ifndef SENSOR_RECOVERY_H
+#define SENSOR_RECOVERY_H
+
+#include <stdint.h>
+
+class SensorRecovery {
+public:
+    enum State : uint8_t {
+        HEALTHY = 0,      // Last read succeeded
+        FAILING = 1,      // Consecutive failures below threshold
+        POWER_OFF = 2,    // Sensor supply switched off
+        SETTLING = 3,     // Supply restored, waiting for sensor to stabilize
+        RECOVERING = 4    // Reads allowed again, waiting for first success
+    };
+
+    enum Action : uint8_t {
+        ACTION_NONE = 0,
+        ACTION_POWER_OFF = 1,
+        ACTION_POWER_ON = 2
+    };
+
+    // failThreshold: consecutive failed reads before power cycling
+    // offMs: time supply stays off; settleMs: time after power-on before reading
+    SensorRecovery(uint8_t failThreshold = 5, uint32_t offMs = 2000, uint32_t settleMs = 2000)
+        : _failThreshold(failThreshold), _offMs(offMs), _settleMs(settleMs),
+          _state(HEALTHY), _pendingAction(ACTION_NONE), _consecutiveFailures(0),
+          _outageStart(0), _stateSince(0), _powerCycles(0), _recoveries(0),
+          _lastRecoveryMs(0) {
+    }
+
+    // Report the outcome of a (retried) measurement
+    void onReadResult(bool success, uint32_t nowMs) {
+        if (success) {
+            if (_state == RECOVERING) {
+                _recoveries++;
+                _lastRecoveryMs = nowMs - _outageStart;
+            }
+            _consecutiveFailures = 0;
+            enter(HEALTHY, nowMs);
+            return;
+        }
+
+        _consecutiveFailures++;
+
+        if (_state == HEALTHY) {
+            _outageStart = nowMs;
+            enter(FAILING, nowMs);
+        }
+        if ((_state == FAILING || _state == RECOVERING) && _consecutiveFailures >= _failThreshold) {
+            // Power cycle; a failed recovery needs another full streak before retrying
+            _consecutiveFailures = 0;
+            _powerCycles++;
+            _pendingAction = ACTION_POWER_OFF;
+            enter(POWER_OFF, nowMs);
+        }
+    }
+
+    // Advance timers; returns the supply action the caller must perform now
+    Action update(uint32_t nowMs) {
+        if (_pendingAction != ACTION_NONE) {
+            Action action = (Action)_pendingAction;
+            _pendingAction = ACTION_NONE;
+            _stateSince = nowMs;  // Off time starts when the caller cuts power
+            return action;
+        }
+        if (_state == POWER_OFF && nowMs - _stateSince >= _offMs) {
+            enter(SETTLING, nowMs);
+            return ACTION_POWER_ON;
+        }
+        if (_state == SETTLING && nowMs - _stateSince >= _settleMs) {
+            enter(RECOVERING, nowMs);
+        }
+        return ACTION_NONE;
+    }
+
+    // False while the sensor is powered off or settling
+    bool readAllowed() const { return _state != POWER_OFF && _state != SETTLING; }
+
+    State getState() const { return (State)_state; }
+    uint8_t getConsecutiveFailures() const { return _consecutiveFailures; }
+    uint32_t getPowerCycles() const { return _powerCycles; }
+    uint32_t getRecoveries() const { return _recoveries; }
+    // Time from the first failed read to the first good read after power cycling
+    uint32_t getLastRecoveryMs() const { return _lastRecoveryMs; }
+
+private:
+    uint8_t _failThreshold;
+    uint32_t _offMs;
+    uint32_t _settleMs;
+
+    uint8_t _state;
+    uint8_t _pendingAction;
+    uint8_t _consecutiveFailures;
+    uint32_t _outageStart;      // First failure after the last good read
+    uint32_t _stateSince;
+
+    uint32_t _powerCycles;
+    uint32_t _recoveries;
+    uint32_t _lastRecoveryMs;
+
+    void enter(State state, uint32_t nowMs) {
+        _state = state;
+        _stateSince = nowMs;
+    }
+};
+
+#endif // SENSOR_RECOVERY_H
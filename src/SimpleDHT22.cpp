@@ -5,7 +5,9 @@
 
 #include "SimpleDHT22.h"
 
-SimpleDHT22::SimpleDHT22(pin_t pin) : _pin(pin), _lastTemperature(0), _lastHumidity(0), _lastReadSuccess(false) {
+SimpleDHT22::SimpleDHT22(pin_t pin) : _pin(pin), _powerPin(PIN_INVALID), _powerActiveHigh(true), _powered(true),
+                                       _lastTemperature(0), _lastHumidity(0), _lastReadSuccess(false),
+                                       _lastReadTime(0), _localStep(DHT_STEP_IDLE), _step(&_localStep) {
     // Initialize timing parameters to defaults
     resetTimingDefaults();
 }
@@ -18,11 +20,40 @@ void SimpleDHT22::resetTimingDefaults() {
 }
 
 void SimpleDHT22::begin() {
+    if (hasPowerControl()) {
+        pinMode(_powerPin, OUTPUT);
+        powerOn();
+    }
     pinMode(_pin, INPUT);  // No internal pull-up, use external resistor only
     Log.info("DHT22 Init: Using hardware timer + Particle GPIO on pin %d", _pin);
     delay(1000);    // DHT22 requires 1 second to stabilize after power-on
 }
 
+void SimpleDHT22::setPowerPin(pin_t pin, bool activeHigh) {
+    _powerPin = pin;
+    _powerActiveHigh = activeHigh;
+}
+
+void SimpleDHT22::powerOn() {
+    if (!hasPowerControl()) {
+        return;
+    }
+    pinMode(_pin, INPUT);  // Release DATA back to the pull-up
+    digitalWrite(_powerPin, _powerActiveHigh ? HIGH : LOW);
+    _powered = true;
+}
+
+void SimpleDHT22::powerOff() {
+    if (!hasPowerControl()) {
+        return;
+    }
+    digitalWrite(_powerPin, _powerActiveHigh ? LOW : HIGH);
+    pinMode(_pin, OUTPUT);
+    digitalWrite(_pin, LOW);  // Avoid phantom-powering the sensor through DATA
+    _powered = false;
+    _lastReadSuccess = false;
+}
+
 // Initialize hardware timer (TIMER1) for microsecond precision
 // TIMER1 runs at 16MHz, we set prescaler to get 1MHz (1 tick = 1us)
 void SimpleDHT22::initHardwareTimer() {
@@ -57,7 +88,13 @@ void SimpleDHT22::stopHardwareTimer() {
 }
 
 bool SimpleDHT22::read(float &temperature, float &humidity) {
-    uint8_t data[5] = {0, 0, 0, 0, 0};
+    if (!_powered) {
+        _lastReadSuccess = false;
+        return false;
+    }
+
+    DHTFrame frame;
+    const uint8_t* data = frame.data;
     bool success = false;
     int attempts = 0;
     const int maxAttempts = 2;  // Try twice before giving up
@@ -66,7 +103,7 @@ bool SimpleDHT22::read(float &temperature, float &humidity) {
         attempts++;
 
         // Read raw data from sensor
-        if (!readRawData(data)) {
+        if (!readRawData(frame)) {
             if (attempts < maxAttempts) {
                 Log.warn("DHT22 read attempt %d failed, retrying...", attempts);
                 delay(100);  // Short delay before retry
@@ -128,14 +165,43 @@ bool SimpleDHT22::read(float &temperature, float &humidity) {
     return true;
 }
 
-bool SimpleDHT22::readRawData(uint8_t data[5]) {
-    // Ensure minimum 2 second interval between reads (DHT22 requirement)
-    static uint32_t lastReadTime = 0;
+bool SimpleDHT22::readFrame(DHTFrame &frame) {
+    memset(&frame, 0, sizeof(frame));
+    if (!_powered) {
+        frame.failStep = DHT_STEP_START_SIGNAL;
+        return false;
+    }
+
+    bool complete = readRawData(frame);
+    frame.failStep = complete ? DHT_STEP_IDLE : *_step;
+    return complete;
+}
+
+bool SimpleDHT22::decodeFrame(const DHTFrame &frame, uint16_t threshold, uint8_t data[5]) {
+    memset(data, 0, 5);
+
+    // Bit i is the high pulse between edges 4 + 2i and 5 + 2i (after the response preamble)
+    uint8_t bits = (frame.edgeCount > 4) ? (frame.edgeCount - 4) / 2 : 0;
+    for (uint8_t i = 0; i < bits; i++) {
+        uint16_t high = frame.edges[5 + 2 * i] - frame.edges[4 + 2 * i];
+        if (high > threshold) {
+            data[i / 8] |= (1 << (7 - (i % 8)));
+        }
+    }
+    return bits == 40;
+}
+
+bool SimpleDHT22::readRawData(DHTFrame &frame) {
+    // Clear edges and bytes left from a previous attempt
+    frame.edgeCount = 0;
+    memset(frame.data, 0, sizeof(frame.data));
+
+    // Ensure minimum 2 second interval between reads of this sensor (DHT22 requirement)
     uint32_t now = millis();
-    if (now - lastReadTime < 2000) {
-        delay(2000 - (now - lastReadTime));
+    if (now - _lastReadTime < 2000) {
+        delay(2000 - (now - _lastReadTime));
     }
-    lastReadTime = millis();
+    _lastReadTime = millis();
 
     // Initialize and start hardware timer for precise timing
     initHardwareTimer();
@@ -145,6 +211,7 @@ bool SimpleDHT22::readRawData(uint8_t data[5]) {
     noInterrupts();
 
     // Step 1: Send start signal (pull low for 1-10ms, we use 1.1ms)
+    *_step = DHT_STEP_START_SIGNAL;
     pinMode(_pin, OUTPUT);
     digitalWrite(_pin, LOW);
     delayHardwareMicros(_startSignal);  // Hardware timer delay
@@ -153,61 +220,69 @@ bool SimpleDHT22::readRawData(uint8_t data[5]) {
     digitalWrite(_pin, HIGH);
     delayHardwareMicros(30);  // 20-40us per datasheet
     pinMode(_pin, INPUT);     // No internal pull-up, rely on external resistor
+    captureEdge(frame, getHardwareMicros());
     delayHardwareMicros(10);  // Small settling time
 
     // Step 3: Wait for sensor response - DHT pulls low for ~80us
+    *_step = DHT_STEP_WAIT_RESPONSE_LOW;
     if (!waitForState(LOW, _responseTimeout)) {
         interrupts();
         stopHardwareTimer();
         return false;
     }
+    captureEdge(frame, getHardwareMicros());
 
     // Step 4: Wait for sensor to pull high for ~80us
+    *_step = DHT_STEP_WAIT_RESPONSE_HIGH;
     if (!waitForState(HIGH, _responseTimeout)) {
         interrupts();
         stopHardwareTimer();
         return false;
     }
+    captureEdge(frame, getHardwareMicros());
 
     // Step 5: Wait for sensor to pull low (ready to send data)
+    *_step = DHT_STEP_WAIT_DATA_START;
     if (!waitForState(LOW, _responseTimeout)) {
         interrupts();
         stopHardwareTimer();
         return false;
     }
+    captureEdge(frame, getHardwareMicros());
+
+    // Step 6: Read 40 bits of data (5 bytes), timing each high pulse
+    // Bit 0: ~26-28us high, Bit 1: ~70us high
+    bool complete = true;
+    for (uint8_t bit = 0; bit < 40; bit++) {
+        *_step = DHT_STEP_READ_BITS | bit;
+
+        // Wait for low-to-high transition (start of bit)
+        if (!waitForState(HIGH, _bitTimeout)) {
+            complete = false;
+            break;
+        }
 
-    // Step 6: Read 40 bits of data (5 bytes)
-    for (int i = 0; i < 5; i++) {
-        for (int j = 7; j >= 0; j--) {
-            // Wait for low-to-high transition (start of bit)
-            if (!waitForState(HIGH, _bitTimeout)) {
-                interrupts();
-                stopHardwareTimer();
-                return false;
-            }
-
-            // Measure high pulse duration to determine bit value using hardware timer
-            // Bit 0: ~26-28us high, Bit 1: ~70us high
-            uint32_t highStart = getHardwareMicros();
-            if (!waitForState(LOW, _bitTimeout)) {
-                interrupts();
-                stopHardwareTimer();
-                return false;
-            }
-            uint32_t highDuration = getHardwareMicros() - highStart;
-
-            // Threshold: >50us = 1, <50us = 0 (per DHT22 datasheet)
-            if (highDuration > _bitThreshold) {
-                data[i] |= (1 << j);
-            }
+        uint32_t highStart = getHardwareMicros();
+        if (!waitForState(LOW, _bitTimeout)) {
+            complete = false;
+            break;
         }
+        uint32_t highEnd = getHardwareMicros();
+        captureEdge(frame, highStart);
+        captureEdge(frame, highEnd);
     }
 
     // Re-enable interrupts and stop hardware timer
     interrupts();
     stopHardwareTimer();
+    if (complete) {
+        *_step = DHT_STEP_IDLE;
+    }
 
-    return true;
+    // Bits from the high pulses (> _bitThreshold us = 1, default 50us per DHT22
+    // datasheet); a timed-out frame keeps the bits read before the timeout
+    decodeFrame(frame, _bitThreshold, frame.data);
+    return complete;
 }
 
 inline bool SimpleDHT22::waitForState(uint8_t state, uint16_t timeout) {
@@ -10,6 +10,29 @@
 #include "Particle.h"
 #include "nrf52840.h"
 
+// Protocol steps reported through the step tracker (for hang diagnosis)
+// During bit reads the tracker holds DHT_STEP_READ_BITS | bitIndex (0-39)
+enum DHTStep : uint8_t {
+    DHT_STEP_IDLE = 0,
+    DHT_STEP_START_SIGNAL = 1,
+    DHT_STEP_WAIT_RESPONSE_LOW = 2,
+    DHT_STEP_WAIT_RESPONSE_HIGH = 3,
+    DHT_STEP_WAIT_DATA_START = 4,
+    DHT_STEP_READ_BITS = 0x40
+};
+
+// Raw frame capture (edge timestamps in hardware timer microseconds)
+// Edge 0 = line released after start signal, 1-3 = response edges,
+// then a rising and falling edge per data bit
+#define DHT_FRAME_EDGES 84
+
+struct DHTFrame {
+    uint16_t edges[DHT_FRAME_EDGES];
+    uint8_t edgeCount;      // Edges captured before the read completed or timed out
+    uint8_t data[5];        // Decoded bytes (partial if the read failed)
+    uint8_t failStep;       // DHTStep that timed out (DHT_STEP_IDLE = frame complete)
+};
+
 class SimpleDHT22 {
 public:
     SimpleDHT22(pin_t pin);
@@ -17,9 +40,25 @@ public:
     // Initialize the sensor
     void begin();
 
+    // Optional supply switching (GPIO or load switch enable pin feeding DHT22 VCC)
+    void setPowerPin(pin_t pin, bool activeHigh = true);
+    bool hasPowerControl() { return _powerPin != PIN_INVALID; }
+    void powerOn();     // Caller must wait >= 1s before reading
+    void powerOff();    // Also drives DATA low so the sensor is not fed through the pull-up
+    bool isPowered() { return _powered; }
+
     // Read temperature and humidity (blocking call, takes ~5ms)
     bool read(float &temperature, float &humidity);
 
+    // Single read attempt capturing every edge (no retry, for lab characterization)
+    // Returns true if the frame completed; checksum is left to the caller
+    bool readFrame(DHTFrame &frame);
+
+    // Decode data bytes from captured edges (bit = high pulse longer than threshold)
+    // Every read is decoded here; a partial frame yields the bits it holds
+    // Returns false if the frame holds fewer than 40 bits; checksum is left to the caller
+    static bool decodeFrame(const DHTFrame &frame, uint16_t threshold, uint8_t data[5]);
+
     // Get last successful readings
     float getTemperature() { return _lastTemperature; }
     float getHumidity() { return _lastHumidity; }
@@ -40,11 +79,18 @@ public:
     // Reset to default timing parameters
     void resetTimingDefaults();
 
+    // Report protocol progress to an external byte (e.g. in retained memory)
+    void setStepTracker(volatile uint8_t* tracker) { _step = tracker; }
+
 private:
     pin_t _pin;
+    pin_t _powerPin;
+    bool _powerActiveHigh;
+    bool _powered;
     float _lastTemperature;
     float _lastHumidity;
     bool _lastReadSuccess;
+    uint32_t _lastReadTime;     // millis() of the last read (2 s minimum applies per sensor)
 
     // Timing parameters for DHT22 (in microseconds) - now configurable for DOE
     uint16_t _startSignal;      // 1-10ms start signal (default 1.1ms)
@@ -52,6 +98,17 @@ private:
     uint16_t _bitTimeout;       // Bit signal timeout (default 100us)
     uint16_t _bitThreshold;     // Bit decision threshold (default 50us)
 
+    // Current protocol step (points at _localStep unless a tracker is set)
+    volatile uint8_t _localStep;
+    volatile uint8_t* _step;
+
+    // Every read records its edges into a frame and decodes it afterwards
+    static inline void captureEdge(DHTFrame &frame, uint32_t us) {
+        if (frame.edgeCount < DHT_FRAME_EDGES) {
+            frame.edges[frame.edgeCount++] = (uint16_t)us;
+        }
+    }
+
     // Hardware timer functions (nRF52840 TIMER1) for precise timing
     void initHardwareTimer();
     void startHardwareTimer();
@@ -59,8 +116,8 @@ private:
     void delayHardwareMicros(uint32_t us);
     void stopHardwareTimer();
 
-    // Read raw data from sensor
-    bool readRawData(uint8_t data[5]);
+    // Read one frame from the sensor (edges and decoded bytes)
+    bool readRawData(DHTFrame &frame);
 
     // Wait for pin state change with timeout (hardware timer version)
     inline bool waitForState(uint8_t state, uint16_t timeout);
@@ -0,0 +1,258 @@
+/*
+ * FrameCorpus - Memory-mappable corpus of recorded DHT22 frames
+ *
+ * A corpus is one file of fixed-size records, so frame i sits at a known
+ * offset and a reader maps the file and walks it with no parsing. Written by
+ * bridge/lab-stream-reader.py (--corpus) from lab captures and by
+ * tools/frame-corpus.cpp (synth) from the frame simulator; layout must stay
+ * in sync with the writer in lab-stream-reader.py.
+ *
+ * File (little-endian):
+ *   0       CorpusHeader (64 bytes)
+ *   64      CorpusSession table (64 bytes each, CORPUS_SESSION_CAPACITY slots)
+ *   65536   CorpusRecord[recordCount] (208 bytes each)
+ *
+ * A writer appends records, then updates the session entry, then the record
+ * count in the header, so a corpus cut short by a crash stays readable up to
+ * the last count written.
+ */
+
+#ifndef FRAME_CORPUS_H
+#define FRAME_CORPUS_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CORPUS_MAGIC "DHTCORP"          // 8 bytes with the terminator
+#define CORPUS_VERSION 1
+#define CORPUS_EDGES 84                 // DHT_FRAME_EDGES
+#define CORPUS_RECORDS_OFFSET 65536
+#define CORPUS_SESSION_CAPACITY 1023
+
+// Where a session's frames came from
+enum CorpusSource : uint8_t {
+    CORPUS_SOURCE_LAB = 0,              // USB lab stream capture
+    CORPUS_SOURCE_SYNTH = 1             // Frame simulator
+};
+
+struct CorpusHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t recordCount;
+    uint64_t recordsOffset;
+    uint32_t sessionCount;
+    uint32_t sessionCapacity;
+    uint8_t reserved[24];
+};
+
+struct CorpusSession {
+    uint64_t firstRecord;
+    uint64_t recordCount;
+    int64_t startedUnix;
+    uint8_t source;                     // CorpusSource
+    uint8_t reserved[7];
+    char label[32];                     // Device, site or simulator settings
+};
+
+// One read attempt: captured edges, the timing it ran with and its outcome
+struct CorpusRecord {
+    uint16_t edges[CORPUS_EDGES];       // Hardware timer us, valid up to edgeCount
+    uint32_t seq;                       // Frame number within the capture
+    uint32_t ms;                        // Device millis() at the read
+    uint16_t startSignal;
+    uint16_t responseTimeout;
+    uint16_t bitTimeout;
+    uint16_t bitThreshold;
+    uint8_t result;                     // LabReadResult
+    uint8_t failStep;                   // DHTStep that timed out (0 = frame complete)
+    uint8_t edgeCount;
+    uint8_t reserved0;
+    uint8_t data[5];                    // Bytes decoded on the device
+    uint8_t reserved1[3];
+    uint32_t session;                   // Index into the session table
+    uint16_t maxZeroHigh;               // Longest 0-bit high pulse (us)
+    uint16_t minOneHigh;                // Shortest 1-bit high pulse (us)
+    int16_t temperature10;
+    uint16_t humidity10;
+};
+
+static_assert(sizeof(CorpusHeader) == 64, "CorpusHeader layout");
+static_assert(sizeof(CorpusSession) == 64, "CorpusSession layout");
+static_assert(sizeof(CorpusRecord) == 208, "CorpusRecord layout");
+static_assert(64 + CORPUS_SESSION_CAPACITY * sizeof(CorpusSession) <= CORPUS_RECORDS_OFFSET,
+              "session table overlaps records");
+
+// Read-only mapping of a corpus
+class FrameCorpusReader {
+public:
+    FrameCorpusReader() : _map(nullptr), _length(0), _header(nullptr) {}
+    ~FrameCorpusReader() { close(); }
+
+    // Map the file, returns false (with a message on stderr) if it is not a corpus
+    bool open(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "%s: cannot open\n", path);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < CORPUS_RECORDS_OFFSET) {
+            fprintf(stderr, "%s: too short for a corpus\n", path);
+            ::close(fd);
+            return false;
+        }
+        _length = st.st_size;
+        _map = mmap(nullptr, _length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (_map == MAP_FAILED) {
+            _map = nullptr;
+            fprintf(stderr, "%s: mmap failed\n", path);
+            return false;
+        }
+        madvise(_map, _length, MADV_SEQUENTIAL);
+
+        _header = (const CorpusHeader*)_map;
+        if (memcmp(_header->magic, CORPUS_MAGIC, 8) != 0 || _header->version != CORPUS_VERSION ||
+            _header->recordSize != sizeof(CorpusRecord) ||
+            _header->sessionCount > CORPUS_SESSION_CAPACITY ||
+            _header->recordsOffset != CORPUS_RECORDS_OFFSET || _header->recordsOffset > _length) {
+            fprintf(stderr, "%s: not a version %d frame corpus\n", path, CORPUS_VERSION);
+            close();
+            return false;
+        }
+        // Records past the end of the file (count written, data lost) are not exposed
+        _count = (_length - _header->recordsOffset) / sizeof(CorpusRecord);
+        if (_header->recordCount < _count) {
+            _count = _header->recordCount;
+        }
+        return true;
+    }
+
+    void close() {
+        if (_map) {
+            munmap(_map, _length);
+        }
+        _map = nullptr;
+        _header = nullptr;
+        _count = 0;
+    }
+
+    uint64_t size() const { return _count; }
+    const CorpusRecord* records() const {
+        return (const CorpusRecord*)((const uint8_t*)_map + _header->recordsOffset);
+    }
+    const CorpusRecord& operator[](uint64_t index) const { return records()[index]; }
+
+    uint32_t sessionCount() const { return _header->sessionCount; }
+    const CorpusSession& session(uint32_t index) const {
+        return ((const CorpusSession*)((const uint8_t*)_map + sizeof(CorpusHeader)))[index];
+    }
+
+private:
+    void* _map;
+    size_t _length;
+    const CorpusHeader* _header;
+    uint64_t _count = 0;
+};
+
+// Appends one session of records to a new or existing corpus
+class FrameCorpusWriter {
+public:
+    FrameCorpusWriter() : _file(nullptr) {
+        memset(&_header, 0, sizeof(_header));
+        memset(&_session, 0, sizeof(_session));
+    }
+    ~FrameCorpusWriter() { close(); }
+
+    bool open(const char* path, CorpusSource source, const char* label, int64_t startedUnix) {
+        _file = fopen(path, "r+b");
+        if (_file) {
+            if (fread(&_header, sizeof(_header), 1, _file) != 1 ||
+                memcmp(_header.magic, CORPUS_MAGIC, 8) != 0 || _header.version != CORPUS_VERSION ||
+                _header.recordSize != sizeof(CorpusRecord) || _header.recordsOffset != CORPUS_RECORDS_OFFSET ||
+                _header.sessionCount > CORPUS_SESSION_CAPACITY) {
+                fprintf(stderr, "%s: not a version %d frame corpus\n", path, CORPUS_VERSION);
+                fclose(_file);
+                _file = nullptr;
+                return false;
+            }
+        } else {
+            _file = fopen(path, "w+b");
+            if (!_file) {
+                fprintf(stderr, "%s: cannot create\n", path);
+                return false;
+            }
+            memset(&_header, 0, sizeof(_header));
+            memcpy(_header.magic, CORPUS_MAGIC, 8);
+            _header.version = CORPUS_VERSION;
+            _header.recordSize = sizeof(CorpusRecord);
+            _header.recordsOffset = CORPUS_RECORDS_OFFSET;
+            _header.sessionCapacity = CORPUS_SESSION_CAPACITY;
+        }
+        if (_header.sessionCount == CORPUS_SESSION_CAPACITY) {
+            // No session of ours to commit; leave the file as it was
+            fprintf(stderr, "%s: session table full\n", path);
+            fclose(_file);
+            _file = nullptr;
+            return false;
+        }
+
+        memset(&_session, 0, sizeof(_session));
+        _session.firstRecord = _header.recordCount;
+        _session.startedUnix = startedUnix;
+        _session.source = source;
+        strncpy(_session.label, label, sizeof(_session.label) - 1);
+        _sessionIndex = _header.sessionCount++;
+
+        // Records past the header's count are a torn append; overwrite them
+        fseeko(_file, _header.recordsOffset + _header.recordCount * sizeof(CorpusRecord), SEEK_SET);
+        return commit();
+    }
+
+    // Append a record (its session field is set here)
+    bool append(CorpusRecord record) {
+        record.session = _sessionIndex;
+        if (fwrite(&record, sizeof(record), 1, _file) != 1) {
+            return false;
+        }
+        _session.recordCount++;
+        return true;
+    }
+
+    // Make the records appended so far visible to readers
+    bool commit() {
+        _header.recordCount = _session.firstRecord + _session.recordCount;
+        off_t end = ftello(_file);
+        bool ok = fflush(_file) == 0 &&
+                  fseeko(_file, sizeof(CorpusHeader) + _sessionIndex * sizeof(CorpusSession), SEEK_SET) == 0 &&
+                  fwrite(&_session, sizeof(_session), 1, _file) == 1 && fflush(_file) == 0 &&
+                  fseeko(_file, 0, SEEK_SET) == 0 &&
+                  fwrite(&_header, sizeof(_header), 1, _file) == 1 && fflush(_file) == 0;
+        fseeko(_file, end < (off_t)CORPUS_RECORDS_OFFSET ? CORPUS_RECORDS_OFFSET : end, SEEK_SET);
+        return ok;
+    }
+
+    void close() {
+        if (_file) {
+            commit();
+            fclose(_file);
+            _file = nullptr;
+        }
+    }
+
+    uint64_t written() const { return _session.recordCount; }
+
+private:
+    FILE* _file;
+    CorpusHeader _header;
+    CorpusSession _session;
+    uint32_t _sessionIndex = 0;
+};
+
+#endif // FRAME_CORPUS_H
@@ -0,0 +1,321 @@
+/*
+ * FrameDecode - Bulk DHT22 frame decoding over a frame corpus
+ *
+ * Replays recorded frames against candidate timing parameters: a frame
+ * passes at (bit threshold, bit timeout) if none of its 80 bit pulses
+ * would have timed out and the bytes decoded at the threshold checksum.
+ * decodeGrid() evaluates a whole grid in one pass over the records, so
+ * a DOE over a large corpus is bound by memory bandwidth, not by a loop
+ * per frame and parameter set.
+ *
+ * The scalar kernels are the reference (same bit decision as
+ * SimpleDHT22::decodeFrame()); the SSE4.1 and AVX2 kernels must produce
+ * identical results, which `frame-corpus verify` checks. Vector kernels
+ * are compiled with target attributes and picked at run time, so no
+ * -m flags are needed.
+ */
+
+#ifndef FRAME_DECODE_H
+#define FRAME_DECODE_H
+
+#include "FrameCorpus.h"
+
+#include <stddef.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRAME_DECODE_X86 1
+#endif
+
+enum DecodeKernel : uint8_t {
+    DECODE_SCALAR,
+    DECODE_SSE41,
+    DECODE_AVX2,
+    DECODE_KERNELS
+};
+
+// Decode one frame at a bit threshold; false (data zeroed) if it is incomplete
+static inline bool frameDecode(const CorpusRecord& record, uint16_t threshold, uint8_t data[5]) {
+    memset(data, 0, 5);
+    if (record.edgeCount < CORPUS_EDGES) {
+        return false;
+    }
+    // Bit i is the high pulse between edges 4 + 2i and 5 + 2i (after the response preamble)
+    for (uint8_t i = 0; i < 40; i++) {
+        uint16_t high = record.edges[5 + 2 * i] - record.edges[4 + 2 * i];
+        if (high > threshold) {
+            data[i / 8] |= (1 << (7 - (i % 8)));
+        }
+    }
+    return true;
+}
+
+static inline bool frameChecksumOk(const uint8_t data[5]) {
+    return (uint8_t)(data[0] + data[1] + data[2] + data[3]) == data[4];
+}
+
+// Longest of the 80 bit pulses (low then high per bit); the read times out
+// if a pulse exceeds the bit timeout
+static inline uint16_t framePulseMax(const CorpusRecord& record) {
+    uint16_t longest = 0;
+    for (uint8_t i = 3; i < CORPUS_EDGES - 1; i++) {
+        longest = std::max<uint16_t>(longest, record.edges[i + 1] - record.edges[i]);
+    }
+    return longest;
+}
+
+// Index of the first (ascending) bit timeout the frame survives; count if none
+static inline size_t frameTimeoutIndex(uint16_t pulseMax, const uint16_t* bitTimeouts, size_t timeoutCount) {
+    size_t index = 0;
+    while (index < timeoutCount && bitTimeouts[index] < pulseMax) {
+        index++;
+    }
+    return index;
+}
+
+// Grid counts are accumulated per record at the first timeout it survives
+// (column timeoutCount = none); prefix sums along each row give the passes
+static inline void gridFinish(uint64_t* counts, size_t thresholdCount, size_t timeoutCount) {
+    for (size_t t = 0; t < thresholdCount; t++) {
+        uint64_t* row = counts + t * (timeoutCount + 1);
+        for (size_t b = 1; b < timeoutCount; b++) {
+            row[b] += row[b - 1];
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Scalar reference
+
+static inline uint64_t decodeFramesScalar(const CorpusRecord* records, uint64_t count, uint16_t threshold,
+                                          uint8_t (*data)[5]) {
+    uint64_t complete = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        complete += frameDecode(records[i], threshold, data[i]);
+    }
+    return complete;
+}
+
+static inline void decodeGridScalar(const CorpusRecord* records, uint64_t count, const uint16_t* thresholds,
+                                    size_t thresholdCount, const uint16_t* bitTimeouts, size_t timeoutCount,
+                                    uint64_t* counts) {
+    uint8_t data[5];
+    for (uint64_t i = 0; i < count; i++) {
+        if (records[i].edgeCount < CORPUS_EDGES) {
+            continue;
+        }
+        size_t column = frameTimeoutIndex(framePulseMax(records[i]), bitTimeouts, timeoutCount);
+        for (size_t t = 0; t < thresholdCount; t++) {
+            frameDecode(records[i], thresholds[t], data);
+            counts[t * (timeoutCount + 1) + column] += frameChecksumOk(data);
+        }
+    }
+    gridFinish(counts, thresholdCount, timeoutCount);
+}
+
+#ifdef FRAME_DECODE_X86
+
+// ---------------------------------------------------------------------------
+// SSE4.1: 8 pulses per vector. Subtracting edges 3.. from edges 4.. gives
+// low and high pulse widths interleaved, so each 32-bit lane holds one
+// bit's high pulse in its upper half. Lanes are reversed before movemask
+// so bits come out MSB first, as the DHT22 sends them.
+
+__attribute__((target("sse4.1")))
+static inline void frameHighSse41(const CorpusRecord& record, __m128i high[10], __m128i* widest) {
+    __m128i longest = _mm_setzero_si128();
+    for (int k = 0; k < 10; k++) {
+        __m128i pulses = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(record.edges + 4 + 8 * k)),
+                                       _mm_loadu_si128((const __m128i*)(record.edges + 3 + 8 * k)));
+        longest = _mm_max_epu16(longest, pulses);
+        high[k] = _mm_shuffle_epi32(_mm_srli_epi32(pulses, 16), _MM_SHUFFLE(0, 1, 2, 3));
+    }
+    *widest = longest;
+}
+
+__attribute__((target("sse4.1")))
+static inline uint16_t framePulseMaxSse41(__m128i widest) {
+    // max(x) = ~min(~x); minpos finds the minimum of 8 unsigned 16-bit lanes
+    __m128i ones = _mm_set1_epi32(-1);
+    return 0xFFFF - (uint16_t)_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_xor_si128(widest, ones)));
+}
+
+__attribute__((target("sse4.1")))
+static inline void frameBytesSse41(const __m128i high[10], __m128i threshold, uint8_t data[5]) {
+    for (int n = 0; n < 5; n++) {
+        int upper = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(high[2 * n], threshold)));
+        int lower = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(high[2 * n + 1], threshold)));
+        data[n] = (uint8_t)(upper << 4 | lower);
+    }
+}
+
+__attribute__((target("sse4.1")))
+static uint64_t decodeFramesSse41(const CorpusRecord* records, uint64_t count, uint16_t threshold,
+                                  uint8_t (*data)[5]) {
+    __m128i limit = _mm_set1_epi32(threshold);
+    uint64_t complete = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        if (records[i].edgeCount < CORPUS_EDGES) {
+            memset(data[i], 0, 5);
+            continue;
+        }
+        __m128i high[10], widest;
+        frameHighSse41(records[i], high, &widest);
+        frameBytesSse41(high, limit, data[i]);
+        complete++;
+    }
+    return complete;
+}
+
+__attribute__((target("sse4.1")))
+static void decodeGridSse41(const CorpusRecord* records, uint64_t count, const uint16_t* thresholds,
+                            size_t thresholdCount, const uint16_t* bitTimeouts, size_t timeoutCount,
+                            uint64_t* counts) {
+    uint8_t data[5];
+    for (uint64_t i = 0; i < count; i++) {
+        if (records[i].edgeCount < CORPUS_EDGES) {
+            continue;
+        }
+        __m128i high[10], widest;
+        frameHighSse41(records[i], high, &widest);
+        size_t column = frameTimeoutIndex(framePulseMaxSse41(widest), bitTimeouts, timeoutCount);
+        for (size_t t = 0; t < thresholdCount; t++) {
+            frameBytesSse41(high, _mm_set1_epi32(thresholds[t]), data);
+            counts[t * (timeoutCount + 1) + column] += frameChecksumOk(data);
+        }
+    }
+    gridFinish(counts, thresholdCount, timeoutCount);
+}
+
+// ---------------------------------------------------------------------------
+// AVX2: 16 pulses per vector, so one vector's movemask is one data byte
+
+__attribute__((target("avx2")))
+static inline void frameHighAvx2(const CorpusRecord& record, __m256i high[5], __m128i* widest) {
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256i longest = _mm256_setzero_si256();
+    for (int k = 0; k < 5; k++) {
+        __m256i pulses = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(record.edges + 4 + 16 * k)),
+                                          _mm256_loadu_si256((const __m256i*)(record.edges + 3 + 16 * k)));
+        longest = _mm256_max_epu16(longest, pulses);
+        high[k] = _mm256_permutevar8x32_epi32(_mm256_srli_epi32(pulses, 16), reverse);
+    }
+    *widest = _mm_max_epu16(_mm256_castsi256_si128(longest), _mm256_extracti128_si256(longest, 1));
+}
+
+__attribute__((target("avx2")))
+static inline void frameBytesAvx2(const __m256i high[5], __m256i threshold, uint8_t data[5]) {
+    for (int n = 0; n < 5; n++) {
+        data[n] = (uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(high[n], threshold)));
+    }
+}
+
+__attribute__((target("avx2")))
+static uint64_t decodeFramesAvx2(const CorpusRecord* records, uint64_t count, uint16_t threshold,
+                                 uint8_t (*data)[5]) {
+    __m256i limit = _mm256_set1_epi32(threshold);
+    uint64_t complete = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        if (records[i].edgeCount < CORPUS_EDGES) {
+            memset(data[i], 0, 5);
+            continue;
+        }
+        __m256i high[5];
+        __m128i widest;
+        frameHighAvx2(records[i], high, &widest);
+        frameBytesAvx2(high, limit, data[i]);
+        complete++;
+    }
+    return complete;
+}
+
+__attribute__((target("avx2")))
+static void decodeGridAvx2(const CorpusRecord* records, uint64_t count, const uint16_t* thresholds,
+                           size_t thresholdCount, const uint16_t* bitTimeouts, size_t timeoutCount,
+                           uint64_t* counts) {
+    uint8_t data[5];
+    for (uint64_t i = 0; i < count; i++) {
+        if (records[i].edgeCount < CORPUS_EDGES) {
+            continue;
+        }
+        __m256i high[5];
+        __m128i widest;
+        frameHighAvx2(records[i], high, &widest);
+        size_t column = frameTimeoutIndex(framePulseMaxSse41(widest), bitTimeouts, timeoutCount);
+        for (size_t t = 0; t < thresholdCount; t++) {
+            frameBytesAvx2(high, _mm256_set1_epi32(thresholds[t]), data);
+            counts[t * (timeoutCount + 1) + column] += frameChecksumOk(data);
+        }
+    }
+    gridFinish(counts, thresholdCount, timeoutCount);
+}
+
+#endif // FRAME_DECODE_X86
+
+// ---------------------------------------------------------------------------
+// Dispatch
+
+static inline bool decodeKernelSupported(DecodeKernel kernel) {
+    switch (kernel) {
+    case DECODE_SCALAR:
+        return true;
+#ifdef FRAME_DECODE_X86
+    case DECODE_SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case DECODE_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+static inline DecodeKernel decodeKernelBest() {
+    for (int k = DECODE_KERNELS - 1; k > DECODE_SCALAR; k--) {
+        if (decodeKernelSupported((DecodeKernel)k)) {
+            return (DecodeKernel)k;
+        }
+    }
+    return DECODE_SCALAR;
+}
+
+static inline const char* decodeKernelName(DecodeKernel kernel) {
+    static const char* const NAMES[DECODE_KERNELS] = {"scalar", "sse4.1", "avx2"};
+    return NAMES[kernel];
+}
+
+// Decode every record at one threshold into data (zeroed for incomplete
+// frames); returns the number of complete frames
+static inline uint64_t decodeFrames(DecodeKernel kernel, const CorpusRecord* records, uint64_t count,
+                                    uint16_t threshold, uint8_t (*data)[5]) {
+#ifdef FRAME_DECODE_X86
+    if (kernel == DECODE_AVX2) {
+        return decodeFramesAvx2(records, count, threshold, data);
+    }
+    if (kernel == DECODE_SSE41) {
+        return decodeFramesSse41(records, count, threshold, data);
+    }
+#endif
+    return decodeFramesScalar(records, count, threshold, data);
+}
+
+// Checksum passes for every (threshold, bit timeout) pair; bitTimeouts must
+// be ascending. counts has thresholdCount rows of timeoutCount + 1 entries
+// (zeroed by the caller, last column is scratch); counts[t][b] is the number
+// of frames that pass at thresholds[t] and bitTimeouts[b].
+static inline void decodeGrid(DecodeKernel kernel, const CorpusRecord* records, uint64_t count,
+                              const uint16_t* thresholds, size_t thresholdCount, const uint16_t* bitTimeouts,
+                              size_t timeoutCount, uint64_t* counts) {
+#ifdef FRAME_DECODE_X86
+    if (kernel == DECODE_AVX2) {
+        return decodeGridAvx2(records, count, thresholds, thresholdCount, bitTimeouts, timeoutCount, counts);
+    }
+    if (kernel == DECODE_SSE41) {
+        return decodeGridSse41(records, count, thresholds, thresholdCount, bitTimeouts, timeoutCount, counts);
+    }
+#endif
+    decodeGridScalar(records, count, thresholds, thresholdCount, bitTimeouts, timeoutCount, counts);
+}
+
+#endif // FRAME_DECODE_H
@@ -0,0 +1,120 @@
+"""Benchmarks of the bridge's event handling and sharded worker pool.
+
+paths:   events per second on one core through the line protocol fast path
+         and through the Point path (BRIDGE_FAST_PATH=0), no network or IPC
+workers: streams a pre-rendered burst of events from bridge/cloud-standin.py
+         over a local HTTP connection into bridge/particle-bridge.py at 1, 2,
+         4 and 8 worker processes
+
+InfluxDB writes are replaced by rendering the records into a byte counter,
+and bridge output goes to /dev/null.
+
+Usage:
+  python tools/bridge-bench.py [paths|workers] [--events 200000] [--devices 1000] [--workers 1 2 4 8]
+
+Needs the bridge dependencies (influxdb-client, requests). Scaling stops at
+the core count of the machine, and at the single reader process beyond it.
+"""
+import argparse
+import importlib.util
+import multiprocessing
+import os
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def load(name, path):
+    spec = importlib.util.spec_from_file_location(name, os.path.join(ROOT, path))
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+bridge = load('particle_bridge', 'bridge/particle-bridge.py')
+bridge.ARCHIVE_DIR = ''  # Event handling only
+standin = load('cloud_standin', 'bridge/cloud-standin.py')
+
+
+class NullWriteApi:
+    """Renders what would be sent to InfluxDB, sends nothing"""
+
+    def __init__(self):
+        self.bytes = 0
+
+    def write(self, bucket, record):
+        if isinstance(record, (bytes, str)):
+            self.bytes += len(record)
+            return
+        for point in record if isinstance(record, list) else [record]:
+            self.bytes += len(point.to_line_protocol())
+
+
+def null_setup():
+    sys.stdout = open(os.devnull, 'w')
+    bridge.write_api = NullWriteApi()
+
+
+def bench_paths(events, devices):
+    """Single core: frame, decode, render and write, in batches of 64 messages"""
+    framer = bridge.SseFramer()
+    messages = framer.feed(''.join(standin.FleetModel(devices).burst(events)))
+    stdout = sys.stdout
+    print(f"{'path':<12}{'events/s':>12}{'us/event':>10}")
+    rates = {}
+    for name, fast in (('point', False), ('fast', True)):
+        bridge.FAST_PATH = fast
+        bridge.envelope_seq.clear()
+        null_setup()
+        start = time.perf_counter()
+        for i in range(0, len(messages), 64):
+            for event_name, event_data in messages[i:i + 64]:
+                bridge.handle_message(event_name, event_data)
+            bridge.flush_lines()
+        elapsed = time.perf_counter() - start
+        sys.stdout = stdout
+        rates[name] = len(messages) / elapsed
+        print(f"{name:<12}{rates[name]:>12.0f}{1e6 / rates[name]:>10.1f}")
+    print(f"fast path speedup {rates['fast'] / rates['point']:.1f}x\n")
+
+
+def run(url, workers):
+    dispatcher = bridge.ShardedDispatcher(workers, setup=null_setup)
+    start = time.perf_counter()
+    response = bridge.requests.get(f'{url}/v1/events', stream=True)
+    bridge.read_stream(response, dispatcher)
+    response.close()
+    dispatcher.close()
+    return time.perf_counter() - start
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Bridge benchmarks')
+    parser.add_argument('bench', nargs='?', choices=('paths', 'workers'), help='run only this benchmark')
+    parser.add_argument('--events', type=int, default=200000)
+    parser.add_argument('--devices', type=int, default=1000)
+    parser.add_argument('--workers', type=int, nargs='+', default=[1, 2, 4, 8])
+    args = parser.parse_args()
+
+    print(f"{args.events} events from {args.devices} devices, {os.cpu_count()} cores\n")
+    if args.bench != 'workers':
+        bench_paths(args.events, args.devices)
+    if args.bench == 'paths':
+        return
+
+    # Workers inherit the loaded bridge module
+    multiprocessing.set_start_method('fork')
+    server = standin.CloudStandIn(0, args.devices, events=args.events).start()
+    print(f"{'workers':>8}{'seconds':>10}{'events/s':>12}{'speedup':>9}")
+    base = None
+    for workers in args.workers:
+        elapsed = run(server.url, workers)
+        rate = args.events / elapsed
+        base = base or rate
+        print(f"{workers:>8}{elapsed:>10.2f}{rate:>12.0f}{rate / base:>8.2f}x")
+    server.shutdown()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,155 @@
+"""Checks that malformed events and dead workers cannot stop the bridge.
+
+Feeds bridge/particle-bridge.py malformed messages (a capture block that is
+not an object, a capture block whose data is not a string, a wrapper that
+is not an object, an envelope that is plain text) followed by a valid
+reading, through:
+
+workers: the sharded worker pool; the reading must still be written
+restart: a worker killed while the reader runs; it must be restarted and
+         the next reading written
+replay:  an archive segment holding the same messages; replay must not stop
+
+InfluxDB writes are captured in a file instead of sent. Exits non-zero if
+any check fails.
+
+Usage:
+  python tools/bridge-fault-test.py
+
+Needs the bridge dependencies (influxdb-client, requests).
+"""
+import importlib.util
+import json
+import multiprocessing
+import os
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def load(name, path):
+    spec = importlib.util.spec_from_file_location(name, os.path.join(ROOT, path))
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+bridge = load('particle_bridge', 'bridge/particle-bridge.py')
+bridge.ARCHIVE_DIR = ''  # Set per check
+standin = load('cloud_standin', 'bridge/cloud-standin.py')
+
+DEVICE = 'e00fce68000000000000abcd'
+PUBLISHED = '2025-01-18T06:00:00.000Z'
+
+
+def wrapper(data):
+    return json.dumps({'data': data, 'ttl': 60, 'published_at': PUBLISHED, 'coreid': DEVICE})
+
+
+def reading(temperature):
+    return ('sensor/reading', wrapper(standin.reading_json(DEVICE, temperature, 45.0, 1737180000)))
+
+
+MALFORMED = [
+    ('sensor/capture', wrapper('[1]')),
+    ('sensor/capture', wrapper('{"id":1,"part":1,"parts":1,"n":1,"d":5}')),
+    (None, '5'),  # Wrapper is not an object
+    ('env', wrapper('abc')),
+]
+
+
+class FileWriteApi:
+    """Appends every record written to a file (shared by worker processes)"""
+
+    def __init__(self, path):
+        self.path = path
+
+    def write(self, bucket, record):
+        if isinstance(record, bytes):
+            record = record.decode()
+        elif not isinstance(record, str):
+            record = '\n'.join(p.to_line_protocol() for p in (record if isinstance(record, list) else [record]))
+        with open(self.path, 'a') as f:
+            f.write(record + '\n')
+
+
+failures = 0
+
+
+def check(ok, what):
+    global failures
+    print(f"  {what:<60} {'ok' if ok else 'FAILED'}")
+    if not ok:
+        failures += 1
+
+
+def written(path):
+    if not os.path.exists(path):
+        return ''
+    with open(path) as f:
+        return f.read()
+
+
+def quiet_setup(path):
+    def setup():
+        sys.stdout = sys.stderr = open(os.devnull, 'w')
+        bridge.write_api = FileWriteApi(path)
+    return setup
+
+
+def check_workers(directory):
+    print("Malformed events in front of a reading")
+    path = os.path.join(directory, 'workers.lp')
+    dispatcher = bridge.ShardedDispatcher(1, setup=quiet_setup(path))
+    dispatcher.submit(MALFORMED)
+    dispatcher.submit([reading(21.5)])
+    dispatcher.close()
+    check(dispatcher.processes[0].exitcode == 0, "worker survived and stopped cleanly")
+    check('temperature=21.5' in written(path), "reading after the malformed events written")
+
+
+def check_restart(directory):
+    print("Worker killed while the reader runs")
+    path = os.path.join(directory, 'restart.lp')
+    dispatcher = bridge.ShardedDispatcher(1, setup=quiet_setup(path))
+    dead = dispatcher.processes[0]
+    dead.kill()
+    dead.join(5)
+    dispatcher.submit([reading(22.5)])
+    dispatcher.close()
+    check(dispatcher.processes[0] is not dead, "dead worker replaced")
+    check('temperature=22.5' in written(path), "reading after the restart written")
+
+
+def check_replay(directory):
+    print("Archived malformed events")
+    path = os.path.join(directory, 'replay.lp')
+    archive = bridge.EventArchive(os.path.join(directory, 'archive'), 0)
+    archive.append(1737180000, MALFORMED + [reading(23.5)])
+    archive.file.close()
+    segment = os.path.join(archive.directory, archive.hour + archive.suffix)
+
+    stdout, stderr = sys.stdout, sys.stderr
+    quiet_setup(path)()
+    try:
+        events, points = bridge.replay_segment(segment, 0, float('inf'))
+    finally:
+        sys.stdout, sys.stderr = stdout, stderr
+    check(events == len(MALFORMED) + 1, "every archived message replayed")
+    check(points == 1 and 'temperature=23.5' in written(path), "reading after the malformed events written")
+
+
+def main():
+    multiprocessing.set_start_method('fork')
+    bridge.FAST_PATH = True
+    with tempfile.TemporaryDirectory() as directory:
+        check_workers(directory)
+        check_restart(directory)
+        check_replay(directory)
+    print(f"\n{'FAILED' if failures else 'All checks passed'}")
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,386 @@
+/*
+ * cloud-link-sim - Host simulation of the firmware's cloud publish path
+ *
+ * Runs src/EventEnvelope.cpp against an emulated cloud link (tools/host/)
+ * with configurable latency, loss, rate limit and outages, feeding it the
+ * firmware's event mix: readings, low-priority config chatter, the odd
+ * sensor error and optionally a DOE phase (results, summary and CSV chunks).
+ * Compares the envelope with per-event publishing (FEATURE_ENVELOPE=0)
+ * without a device or a Particle account.
+ *
+ * The energy model (tools/host/EnergyModel.h) charges CPU time of every
+ * sample (bit-bang frames with interrupts off, busy-wait retries), radio
+ * time of every publish, sleep or idle time between samples and the sensor
+ * supply, and reports mAh per day for the configuration simulated.
+ *
+ * Build and run:
+ *   g++ -O2 -std=c++17 -I tools/host -I src tools/cloud-link-sim.cpp src/EventEnvelope.cpp -o cloud-link-sim
+ *   ./cloud-link-sim [--hours 24] [--interval 300] [--latency 150] [--jitter 100]
+ *                    [--loss 0.01] [--rate 1] [--burst 4] [--outage 60:30]... [--doe 2]
+ *                    [--direct] [--seed 1] [--verbose]
+ *                    [--sample 10] [--sensors 1] [--gating] [--settle 2000] [--prime]
+ *                    [--fail 0.01] [--sleep none|stop|ulp] [--battery 2000]
+ *
+ * --outage START:MINUTES takes the link down at START minutes for MINUTES.
+ * --doe HOURS runs one DOE phase starting at that hour.
+ * --gating, --settle and --prime follow DHT_POWER_GATING, DHT_POWER_SETTLE_MS
+ * and FRESHNESS_PRIME; --fail is the fraction of reads that fail and are retried.
+ * --sleep models sleeping between samples (the firmware stays awake today);
+ * the envelope is then flushed before every sleep.
+ */
+
+#include "Particle.h"
+#include "EnergyModel.h"
+#include "EventEnvelope.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// Firmware settings (src/RemoteTempHumidityMonitor.ino)
+#define ENVELOPE_WINDOW_MS 1000
+#define ENVELOPE_MAX_HOLD_MS 300000
+#define LOOP_MS 100                  // Envelope service() period
+
+// Sampling cost (src/SimpleDHT22.cpp timing, default start signal)
+#define START_SIGNAL_US 1100
+#define FRAME_REST_US 4230           // Release, response and 40 bits after the start signal
+#define SAMPLE_WORK_MS 5             // Pipeline, JSON and trace work per measurement
+#define RETRY_WAIT_MS 2000           // Failed read: delay(100), then the driver's 2 s read spacing
+#define PRIME_LEAD_MS 2000           // FRESHNESS_PRIME: sensor read this long ahead
+
+enum SleepMode { SLEEP_NONE, SLEEP_STOP, SLEEP_ULP };
+
+struct SamplingConfig {
+    uint32_t intervalSec = 10;
+    uint8_t sensors = 1;
+    bool gating = false;
+    uint32_t settleMs = 2000;
+    bool prime = false;
+    float failRate = 0.0f;
+    SleepMode sleep = SLEEP_NONE;
+};
+
+struct SamplingStats {
+    uint32_t samples = 0;
+    uint32_t reads = 0;
+    uint32_t retries = 0;
+};
+
+struct Message {
+    uint32_t id;
+    uint32_t atMs;
+    std::string name;
+    std::string data;
+    EnvelopePriority priority;
+};
+
+struct Delivery {
+    uint32_t postedMs = 0;
+    uint32_t arrivalMs = 0;
+    bool delivered = false;
+};
+
+static std::vector<Delivery> deliveries;
+
+// Every generated payload starts with {"id":N so the receiver can match it
+static std::string payload(uint32_t id, const char* body, size_t size) {
+    char head[32];
+    snprintf(head, sizeof(head), "{\"id\":%lu,", (unsigned long)id);
+    std::string data = std::string(head) + body;
+    if (data.size() + 1 < size) {
+        data.append(size - data.size() - 1, '0');
+    }
+    return data + "}";
+}
+
+static void receive(const char* data, uint32_t arrivalMs) {
+    const char* id = strstr(data, "{\"id\":");
+    if (!id) {
+        return;
+    }
+    size_t index = strtoul(id + 6, nullptr, 10);
+    if (index < deliveries.size() && !deliveries[index].delivered) {
+        deliveries[index].delivered = true;
+        deliveries[index].arrivalMs = arrivalMs;
+    }
+}
+
+// Cloud side: split envelopes back into their messages, as the bridge does
+static void cloudReceiver(const char* name, const char* data, uint32_t arrivalMs) {
+    if (strcmp(name, ENVELOPE_EVENT_NAME) != 0) {
+        receive(data, arrivalMs);
+        return;
+    }
+    for (const char* line = strchr(data, '\n'); line; line = strchr(line + 1, '\n')) {
+        const char* tab = strchr(line, '\t');
+        if (tab) {
+            receive(tab + 1, arrivalMs);
+        }
+    }
+}
+
+static std::vector<Message> eventMix(uint32_t hours, uint32_t intervalSec, int doeHour, uint32_t seed) {
+    std::vector<Message> messages;
+    uint32_t endMs = hours * 3600000u;
+    srand(seed);
+    auto add = [&](uint32_t atMs, const char* name, const char* body, size_t size, EnvelopePriority priority) {
+        uint32_t id = messages.size();
+        messages.push_back({id, atMs, name, payload(id, body, size), priority});
+    };
+
+    for (uint32_t t = 0; t < endMs; t += intervalSec * 1000) {
+        add(t, "sensor/reading", "\"measurement\":\"environment\",\"pad\":\"", 190, ENVELOPE_NORMAL);
+        if (rand() % 50 == 0) {
+            add(t + 2000, "sensor/error", "\"error\":\"DHT22 read failed", 40, ENVELOPE_NORMAL);
+        }
+    }
+    for (uint32_t t = 60000; t < endMs; t += 6 * 3600000) {
+        add(t, "config/interval", "\"interval\":\"", 40, ENVELOPE_LOW);
+    }
+    if (doeHour >= 0) {
+        // One OFAT phase: 16 configurations of 30 reads, then summary and CSV chunks 1 s apart
+        uint32_t t = doeHour * 3600000u;
+        for (int i = 0; i < 16; i++, t += 60000) {
+            add(t, "doe/result", "\"ss\":\"", 110, ENVELOPE_NORMAL);
+        }
+        add(t, "doe/phase_summary", "\"param\":\"start_signal\",\"stats\":\"", 260, ENVELOPE_NORMAL);
+        for (int chunk = 0; chunk < 3; chunk++) {
+            add(t + chunk * 1000, "doe/phase_data", "\"param\":\"start_signal\",\"data\":\"", 618, ENVELOPE_NORMAL);
+        }
+    }
+    std::stable_sort(messages.begin(), messages.end(),
+                     [](const Message& a, const Message& b) { return a.atMs < b.atMs; });
+    return messages;
+}
+
+// Charge one measurement: every sensor read (twice when priming), failed reads retried once
+static void chargeSample(const SamplingConfig& sampling, EnergyModel& energy, std::mt19937& rng,
+                         SamplingStats& stats) {
+    const EnergyCurrents& currents = energy.currents;
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    uint32_t reads = sampling.sensors * (sampling.prime ? 2 : 1);
+    uint32_t retries = 0;
+    for (uint32_t i = 0; i < reads; i++) {
+        if (uniform(rng) < sampling.failRate) {
+            retries++;
+        }
+    }
+    reads += retries;
+
+    double frameMs = (START_SIGNAL_US + FRAME_REST_US) / 1000.0;
+    energy.charge(ENERGY_CPU_BUSY, currents.cpuBusyMa,
+                  reads * frameMs + retries * RETRY_WAIT_MS + SAMPLE_WORK_MS);
+    energy.charge(ENERGY_SENSOR, currents.sensorMeasureMa, (double)reads * currents.sensorMeasureMs);
+    if (sampling.gating) {
+        // Powered from settle time ahead of the (priming) read until the conversion ends
+        uint32_t onMs = sampling.settleMs + (sampling.prime ? PRIME_LEAD_MS : 0) + currents.sensorMeasureMs;
+        energy.charge(ENERGY_SENSOR, currents.sensorStandbyMa, (double)sampling.sensors * onMs);
+    }
+
+    stats.samples++;
+    stats.reads += reads;
+    stats.retries += retries;
+}
+
+// Time between samples: awake or asleep, modem attached, sensor powered unless gated
+static void chargeBaseline(const SamplingConfig& sampling, EnergyModel& energy, uint32_t ms) {
+    const EnergyCurrents& currents = energy.currents;
+    switch (sampling.sleep) {
+        case SLEEP_NONE: energy.charge(ENERGY_CPU_IDLE, currents.cpuIdleMa, ms); break;
+        case SLEEP_STOP: energy.charge(ENERGY_SLEEP, currents.stopMa, ms); break;
+        case SLEEP_ULP: energy.charge(ENERGY_SLEEP, currents.ulpMa, ms); break;
+    }
+    energy.charge(ENERGY_RADIO_IDLE, currents.radioIdleMa, ms);
+    if (!sampling.gating) {
+        energy.charge(ENERGY_SENSOR, currents.sensorStandbyMa, (double)sampling.sensors * ms);
+    }
+}
+
+static uint32_t percentile(std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char** argv) {
+    CloudLink& link = CloudLink::instance();
+    EnergyModel& energy = EnergyModel::instance();
+    SamplingConfig sampling;
+    float batteryMah = 0;
+    uint32_t hours = 24;
+    uint32_t intervalSec = 300;
+    int doeHour = -1;
+    uint32_t seed = 1;
+    bool direct = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : "0";
+        if (arg == "--direct") {
+            direct = true;
+            continue;
+        } else if (arg == "--verbose") {
+            Log.verbose = true;
+            continue;
+        } else if (arg == "--gating") {
+            sampling.gating = true;
+            continue;
+        } else if (arg == "--prime") {
+            sampling.prime = true;
+            continue;
+        } else if (arg == "--sample") {
+            sampling.intervalSec = std::max(1ul, strtoul(value, nullptr, 10));
+        } else if (arg == "--sensors") {
+            sampling.sensors = atoi(value);
+        } else if (arg == "--settle") {
+            sampling.settleMs = strtoul(value, nullptr, 10);
+        } else if (arg == "--fail") {
+            sampling.failRate = strtof(value, nullptr);
+        } else if (arg == "--sleep") {
+            std::string mode = value;
+            sampling.sleep = mode == "stop" ? SLEEP_STOP : mode == "ulp" ? SLEEP_ULP : SLEEP_NONE;
+        } else if (arg == "--battery") {
+            batteryMah = strtof(value, nullptr);
+        } else if (arg == "--hours") {
+            hours = strtoul(value, nullptr, 10);
+        } else if (arg == "--interval") {
+            intervalSec = strtoul(value, nullptr, 10);
+        } else if (arg == "--latency") {
+            link.config.latencyMs = strtoul(value, nullptr, 10);
+        } else if (arg == "--jitter") {
+            link.config.jitterMs = strtoul(value, nullptr, 10);
+        } else if (arg == "--loss") {
+            link.config.loss = strtof(value, nullptr);
+        } else if (arg == "--rate") {
+            link.config.rate = strtof(value, nullptr);
+        } else if (arg == "--burst") {
+            link.config.burst = strtof(value, nullptr);
+        } else if (arg == "--outage") {
+            char* end;
+            uint32_t start = strtoul(value, &end, 10);
+            uint32_t minutes = (*end == ':') ? strtoul(end + 1, nullptr, 10) : 0;
+            link.outages.push_back({start * 60000u, (start + minutes) * 60000u});
+        } else if (arg == "--doe") {
+            doeHour = atoi(value);
+        } else if (arg == "--seed") {
+            seed = strtoul(value, nullptr, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+        i++;
+    }
+
+    link.seed(seed);
+    link.receiver = cloudReceiver;
+
+    // A publish keeps the CPU awake for its round trip and the modem active
+    uint32_t publishMs = 0;
+    link.transmitted = [&](uint32_t startMs, uint32_t busyMs) {
+        energy.transmit(startMs, busyMs);
+        energy.charge(ENERGY_CPU_IDLE, energy.currents.cpuIdleMa, busyMs);
+        publishMs += busyMs;
+    };
+    std::mt19937 sampleRng(seed);
+    SamplingStats stats;
+    std::vector<Message> messages = eventMix(hours, intervalSec, doeHour, seed);
+    deliveries.resize(messages.size());
+
+    // Run past the last message long enough for the maximum hold to expire
+    EventEnvelope envelope(ENVELOPE_WINDOW_MS, ENVELOPE_MAX_HOLD_MS);
+    uint32_t endMs = hours * 3600000u + ENVELOPE_MAX_HOLD_MS + 60000;
+    size_t next = 0;
+    uint32_t dropped = 0;
+    uint32_t nextSampleMs = 0;
+    while (link.now < endMs) {
+        uint32_t stepStart = link.now;
+        publishMs = 0;
+        if (link.now >= nextSampleMs && link.now < hours * 3600000u) {
+            chargeSample(sampling, energy, sampleRng, stats);
+            nextSampleMs += sampling.intervalSec * 1000;
+        }
+        while (next < messages.size() && messages[next].atMs <= link.now) {
+            const Message& message = messages[next++];
+            Delivery& delivery = deliveries[message.id];
+            delivery.postedMs = link.now;
+            bool ok = direct ? Particle.connected() && Particle.publish(message.name.c_str(), message.data.c_str(), PRIVATE)
+                             : envelope.post(message.name.c_str(), message.data.c_str(), message.priority);
+            if (!ok && direct) {
+                dropped++;
+            }
+        }
+        if (!direct) {
+            envelope.service();
+            if (sampling.sleep != SLEEP_NONE) {
+                envelope.flush();
+            }
+        }
+        link.now += LOOP_MS;
+        chargeBaseline(sampling, energy, link.now - stepStart - publishMs);
+    }
+    energy.settleTail(link.now);
+    if (!direct) {
+        dropped = envelope.getDropped();
+    }
+
+    std::vector<uint32_t> latencies;
+    for (const Delivery& delivery : deliveries) {
+        if (delivery.delivered) {
+            latencies.push_back(delivery.arrivalMs - delivery.postedMs);
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    uint32_t outageMinutes = 0;
+    for (const CloudOutage& outage : link.outages) {
+        outageMinutes += (outage.endMs - outage.startMs) / 60000;
+    }
+    printf("%u h, reading every %u s, latency %u+%u ms, loss %.1f%%, %.1f event/s (burst %.0f), "
+           "%zu outage(s) %u min\n",
+           hours, intervalSec, link.config.latencyMs, link.config.jitterMs, link.config.loss * 100,
+           link.config.rate, link.config.burst, link.outages.size(), outageMinutes);
+    if (direct) {
+        printf("Mode: one publish per event (FEATURE_ENVELOPE=0)\n\n");
+    } else {
+        printf("Mode: envelope (window %d ms, max hold %d ms)\n\n", ENVELOPE_WINDOW_MS, ENVELOPE_MAX_HOLD_MS);
+    }
+
+    size_t delivered = latencies.size();
+    printf("Messages      %zu posted, %zu delivered (%.1f%%), %u dropped",
+           messages.size(), delivered, 100.0 * delivered / messages.size(), dropped);
+    if (!direct) {
+        printf(", %u still queued", envelope.getPending());
+    }
+    printf("\nLatency ms    p50 %u  p90 %u  p99 %u  max %u\n",
+           percentile(latencies, 0.50), percentile(latencies, 0.90),
+           percentile(latencies, 0.99), latencies.empty() ? 0 : latencies.back());
+    printf("Data ops      %u (%.2f per message delivered)\n",
+           link.accepted, delivered ? (double)link.accepted / delivered : 0.0);
+    printf("Refused       %u rate limited, %u lost, %u oversize, %u offline\n",
+           link.rateLimited, link.lost, link.oversize, link.offline);
+
+    static const char* const SLEEP_NAMES[] = {"awake", "STOP sleep", "ULP sleep"};
+    printf("\nEnergy        sample every %u s, %u sensor(s)%s%s, %s between samples, "
+           "%u reads (%u retried)\n",
+           sampling.intervalSec, sampling.sensors, sampling.gating ? ", power gated" : "",
+           sampling.prime ? ", priming read" : "", SLEEP_NAMES[sampling.sleep], stats.reads, stats.retries);
+    double perDay = 86400000.0 / link.now;
+    for (uint8_t i = 0; i < ENERGY_CATEGORIES; i++) {
+        EnergyCategory category = (EnergyCategory)i;
+        printf("  %-11s %8.2f mAh/day  %5.1f%%\n", EnergyModel::name(category),
+               energy.mAh(category) * perDay, 100.0 * energy.mAh(category) / energy.totalMah());
+    }
+    printf("  %-11s %8.2f mAh/day  (%.2f mA average)", "total", energy.totalMah() * perDay,
+           energy.totalMah() * perDay / 24);
+    if (batteryMah > 0) {
+        printf(", %.0f days on %.0f mAh", batteryMah / (energy.totalMah() * perDay), batteryMah);
+    }
+    printf("\n");
+    return 0;
+}
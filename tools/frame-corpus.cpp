@@ -0,0 +1,371 @@
+/*
+ * frame-corpus - Inspect, synthesize and replay DHT22 frame corpora
+ *
+ * info    sessions, frame counts and outcomes of a corpus
+ * synth   append simulated frames (DHT22 pulse timing with Gaussian jitter,
+ *         a fraction of reads cut short by timeouts)
+ * replay  offline DOE over the bit threshold and bit timeout: one pass
+ *         over the corpus with the bulk decoder (FrameDecode.h) reports the
+ *         pass rate of every pair, so timing can be chosen from recorded
+ *         frames without a device
+ * verify  check the vector decode kernels against the scalar reference and
+ *         compare their throughput
+ *
+ * Build and run:
+ *   g++ -O2 -std=c++17 tools/frame-corpus.cpp -o frame-corpus
+ *   ./frame-corpus synth frames.dhtc 1000000 [--jitter 4] [--fail 0.01] [--seed 1]
+ *   ./frame-corpus info frames.dhtc
+ *   ./frame-corpus replay frames.dhtc [--thresholds 30:70:5] [--bit-timeouts 60:120:10]
+ *                                     [--kernel scalar|sse4.1|avx2]
+ *   ./frame-corpus verify frames.dhtc [--thresholds 30:70:5] [--bit-timeouts 60:120:10]
+ *
+ * Lab captures are added with bridge/lab-stream-reader.py --corpus.
+ */
+
+#include "FrameDecode.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+// DHT22 pulse timing (datasheet typical values, us)
+#define RESPONSE_DELAY_US 30        // Release to sensor pulling low
+#define RESPONSE_LOW_US 80
+#define RESPONSE_HIGH_US 80
+#define BIT_LOW_US 50
+#define ZERO_HIGH_US 27
+#define ONE_HIGH_US 70
+
+static int info(const char* path) {
+    FrameCorpusReader corpus;
+    if (!corpus.open(path)) {
+        return 1;
+    }
+    printf("%llu frames in %u session(s)\n\n", (unsigned long long)corpus.size(), corpus.sessionCount());
+    printf("%4s %-32s %-6s %20s %12s %8s %8s %8s %8s\n",
+           "#", "label", "source", "started (UTC)", "frames", "ok", "timeout", "checksum", "range");
+    for (uint32_t s = 0; s < corpus.sessionCount(); s++) {
+        const CorpusSession& session = corpus.session(s);
+        uint64_t results[4] = {};
+        uint64_t end = std::min<uint64_t>(session.firstRecord + session.recordCount, corpus.size());
+        for (uint64_t i = session.firstRecord; i < end; i++) {
+            results[corpus[i].result & 3]++;
+        }
+        char started[24];
+        time_t t = (time_t)session.startedUnix;
+        strftime(started, sizeof(started), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+        printf("%4u %-32.32s %-6s %20s %12llu %8llu %8llu %8llu %8llu\n", s, session.label,
+               session.source == CORPUS_SOURCE_SYNTH ? "synth" : "lab", started,
+               (unsigned long long)session.recordCount, (unsigned long long)results[0],
+               (unsigned long long)results[1], (unsigned long long)results[2], (unsigned long long)results[3]);
+    }
+    return 0;
+}
+
+static int synth(const char* path, uint64_t frames, float jitter, float failRate, uint32_t seed) {
+    char label[32];
+    snprintf(label, sizeof(label), "synth jitter=%.1fus fail=%.3f", jitter, failRate);
+    FrameCorpusWriter writer;
+    if (!writer.open(path, CORPUS_SOURCE_SYNTH, label, time(nullptr))) {
+        return 1;
+    }
+
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, jitter);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    auto pulse = [&](float us) { return (uint16_t)std::max(1L, lroundf(us + noise(rng))); };
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t n = 0; n < frames; n++) {
+        CorpusRecord record;
+        memset(&record, 0, sizeof(record));
+        record.seq = (uint32_t)n;
+        record.ms = (uint32_t)(n * 2000);
+        record.startSignal = 1100;
+        record.responseTimeout = 200;
+        record.bitTimeout = 100;
+        record.bitThreshold = 50;
+
+        // A plausible reading: humidity 20-90 %, temperature 10-35 C
+        uint16_t hum10 = 200 + rng() % 700;
+        int16_t temp10 = 100 + rng() % 250;
+        uint8_t bytes[5] = {(uint8_t)(hum10 >> 8), (uint8_t)hum10, (uint8_t)(temp10 >> 8), (uint8_t)temp10, 0};
+        bytes[4] = bytes[0] + bytes[1] + bytes[2] + bytes[3];
+
+        uint16_t t = rng();
+        uint16_t* e = record.edges;
+        e[0] = t;
+        e[1] = e[0] + pulse(RESPONSE_DELAY_US);
+        e[2] = e[1] + pulse(RESPONSE_LOW_US);
+        e[3] = e[2] + pulse(RESPONSE_HIGH_US);
+        for (uint8_t i = 0; i < 40; i++) {
+            bool one = bytes[i / 8] & (1 << (7 - (i % 8)));
+            e[4 + 2 * i] = e[3 + 2 * i] + pulse(BIT_LOW_US);
+            e[5 + 2 * i] = e[4 + 2 * i] + pulse(one ? ONE_HIGH_US : ZERO_HIGH_US);
+        }
+        record.edgeCount = CORPUS_EDGES;
+
+        if (uniform(rng) < failRate) {
+            // Timed out partway: the edges after the stall never came
+            record.edgeCount = 1 + rng() % (CORPUS_EDGES - 1);
+            memset(e + record.edgeCount, 0, (CORPUS_EDGES - record.edgeCount) * sizeof(uint16_t));
+            record.failStep = record.edgeCount < 4 ? 1 + record.edgeCount
+                                                   : 0x40 | ((record.edgeCount - 4) / 2);
+            record.result = 1;
+        } else {
+            frameDecode(record, record.bitThreshold, record.data);
+            record.result = frameChecksumOk(record.data) ? 0 : 2;
+            record.temperature10 = temp10;
+            record.humidity10 = hum10;
+        }
+        record.maxZeroHigh = 0;
+        record.minOneHigh = 0xFFFF;
+        for (uint8_t i = 0; 5 + 2 * i < record.edgeCount; i++) {
+            uint16_t high = e[5 + 2 * i] - e[4 + 2 * i];
+            if (high > record.bitThreshold) {
+                record.minOneHigh = std::min(record.minOneHigh, high);
+            } else {
+                record.maxZeroHigh = std::max(record.maxZeroHigh, high);
+            }
+        }
+
+        if (!writer.append(record)) {
+            fprintf(stderr, "%s: write failed\n", path);
+            return 1;
+        }
+        if ((n + 1) % 1000000 == 0) {
+            writer.commit();
+        }
+    }
+    writer.close();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%llu frames appended to %s (%.1f M frames/s)\n", (unsigned long long)frames, path,
+           frames / seconds / 1e6);
+    return 0;
+}
+
+// "from:to:step" or a single value, ascending
+static bool parseRange(const char* text, std::vector<uint16_t>& values) {
+    unsigned from, to, step = 1;
+    int fields = sscanf(text, "%u:%u:%u", &from, &to, &step);
+    if (fields == 1) {
+        to = from;
+    } else if (fields < 2 || to < from || step == 0 || to > 0xFFFF) {
+        return false;
+    }
+    values.clear();
+    for (unsigned value = from; value <= to; value += step) {
+        values.push_back((uint16_t)value);
+    }
+    return true;
+}
+
+static uint64_t completeFrames(const FrameCorpusReader& corpus) {
+    uint64_t complete = 0;
+    for (uint64_t i = 0; i < corpus.size(); i++) {
+        complete += corpus[i].edgeCount == CORPUS_EDGES;
+    }
+    return complete;
+}
+
+static int replay(const char* path, const std::vector<uint16_t>& thresholds,
+                  const std::vector<uint16_t>& bitTimeouts, DecodeKernel kernel) {
+    FrameCorpusReader corpus;
+    if (!corpus.open(path)) {
+        return 1;
+    }
+    uint64_t count = corpus.size();
+    uint64_t complete = completeFrames(corpus);
+    size_t columns = bitTimeouts.size() + 1;
+    std::vector<uint64_t> counts(thresholds.size() * columns, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    decodeGrid(kernel, corpus.records(), count, thresholds.data(), thresholds.size(), bitTimeouts.data(),
+               bitTimeouts.size(), counts.data());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%llu frames, %llu complete\n\n", (unsigned long long)count, (unsigned long long)complete);
+    printf("Checksum pass rate by bit threshold (rows) and bit timeout (columns), us\n");
+    printf("%9s", "");
+    for (uint16_t timeout : bitTimeouts) {
+        if (timeout == 0xFFFF) {
+            printf(" %8s", "any");
+        } else {
+            printf(" %8u", timeout);
+        }
+    }
+    printf("\n");
+    for (size_t t = 0; t < thresholds.size(); t++) {
+        printf("%9u", thresholds[t]);
+        for (size_t b = 0; b < bitTimeouts.size(); b++) {
+            printf(" %7.3f%%", complete ? 100.0 * counts[t * columns + b] / complete : 0.0);
+        }
+        printf("\n");
+    }
+
+    // Threshold in the middle of the best plateau at the loosest timeout, so
+    // it keeps the widest margin; then the tightest timeout that loses nothing
+    size_t last = bitTimeouts.size() - 1;
+    uint64_t bestOk = 0;
+    for (size_t t = 0; t < thresholds.size(); t++) {
+        bestOk = std::max(bestOk, counts[t * columns + last]);
+    }
+    size_t runStart = 0, runLength = 0, bestStart = 0, bestLength = 0;
+    for (size_t t = 0; t < thresholds.size(); t++) {
+        if (counts[t * columns + last] == bestOk) {
+            runStart = runLength ? runStart : t;
+            runLength++;
+            if (runLength > bestLength) {
+                bestStart = runStart;
+                bestLength = runLength;
+            }
+        } else {
+            runLength = 0;
+        }
+    }
+    size_t best = bestStart + (bestLength - 1) / 2;
+    size_t timeout = 0;
+    while (counts[best * columns + timeout] < bestOk) {
+        timeout++;
+    }
+
+    printf("\nBest bit threshold: %u us", thresholds[best]);
+    if (bitTimeouts[timeout] != 0xFFFF) {
+        printf(", bit timeout: %u us", bitTimeouts[timeout]);
+    }
+    printf(" (%.3f%% of complete frames)\n", complete ? 100.0 * bestOk / complete : 0.0);
+    printf("%s kernel: %.2f GB/s, %.0f M frame decodes/s (%zu parameter sets in one pass)\n",
+           decodeKernelName(kernel), count * sizeof(CorpusRecord) / seconds / 1e9,
+           count * thresholds.size() / seconds / 1e6, thresholds.size() * bitTimeouts.size());
+    return 0;
+}
+
+static int verify(const char* path, const std::vector<uint16_t>& thresholds,
+                  const std::vector<uint16_t>& bitTimeouts) {
+    FrameCorpusReader corpus;
+    if (!corpus.open(path)) {
+        return 1;
+    }
+    const CorpusRecord* records = corpus.records();
+    uint64_t count = corpus.size();
+    size_t cells = thresholds.size() * (bitTimeouts.size() + 1);
+    std::vector<uint64_t> reference(cells, 0);
+    double referenceSeconds = 0;
+    bool allMatch = true;
+
+    printf("%llu frames, %zu bit thresholds x %zu bit timeouts\n\n", (unsigned long long)count,
+           thresholds.size(), bitTimeouts.size());
+    printf("%-8s %-10s %10s %10s %8s\n", "kernel", "result", "GB/s", "M dec/s", "speedup");
+    for (int k = DECODE_SCALAR; k < DECODE_KERNELS; k++) {
+        DecodeKernel kernel = (DecodeKernel)k;
+        if (!decodeKernelSupported(kernel)) {
+            printf("%-8s %-10s\n", decodeKernelName(kernel), "no CPU support");
+            continue;
+        }
+
+        // Decoded bytes, block by block against the scalar reference
+        bool match = true;
+        if (kernel != DECODE_SCALAR) {
+            const uint64_t BLOCK = 1 << 16;
+            std::vector<uint8_t> expected(BLOCK * 5), actual(BLOCK * 5);
+            for (uint64_t first = 0; first < count && match; first += BLOCK) {
+                uint64_t n = std::min(BLOCK, count - first);
+                for (uint16_t threshold : thresholds) {
+                    uint64_t a = decodeFramesScalar(records + first, n, threshold, (uint8_t(*)[5])expected.data());
+                    uint64_t b = decodeFrames(kernel, records + first, n, threshold, (uint8_t(*)[5])actual.data());
+                    if (a != b || memcmp(expected.data(), actual.data(), n * 5) != 0) {
+                        match = false;
+                        break;
+                    }
+                }
+            }
+        }
+
+        std::vector<uint64_t> counts(cells, 0);
+        auto start = std::chrono::steady_clock::now();
+        decodeGrid(kernel, records, count, thresholds.data(), thresholds.size(), bitTimeouts.data(),
+                   bitTimeouts.size(), counts.data());
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (kernel == DECODE_SCALAR) {
+            reference = counts;
+            referenceSeconds = seconds;
+        } else {
+            // The scratch column is not part of the result
+            for (size_t t = 0; t < thresholds.size(); t++) {
+                for (size_t b = 0; b < bitTimeouts.size(); b++) {
+                    size_t cell = t * (bitTimeouts.size() + 1) + b;
+                    match = match && counts[cell] == reference[cell];
+                }
+            }
+        }
+        allMatch = allMatch && match;
+
+        printf("%-8s %-10s %10.2f %10.0f %7.1fx\n", decodeKernelName(kernel), match ? "identical" : "MISMATCH",
+               count * sizeof(CorpusRecord) / seconds / 1e9, count * thresholds.size() / seconds / 1e6,
+               referenceSeconds / seconds);
+    }
+    return allMatch ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    const char* usage = "Usage: %s info|synth|replay|verify <corpus> [options]\n";
+    if (argc < 3) {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+    std::string command = argv[1];
+    const char* path = argv[2];
+
+    float jitter = 4.0f;
+    float failRate = 0.01f;
+    uint32_t seed = 1;
+    std::vector<uint16_t> thresholds, bitTimeouts = {0xFFFF};
+    parseRange("30:70:5", thresholds);
+    DecodeKernel kernel = decodeKernelBest();
+    int first = command == "synth" ? 4 : 3;
+    for (int i = first; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--jitter") {
+            jitter = strtof(argv[i + 1], nullptr);
+        } else if (arg == "--fail") {
+            failRate = strtof(argv[i + 1], nullptr);
+        } else if (arg == "--seed") {
+            seed = strtoul(argv[i + 1], nullptr, 10);
+        } else if (arg == "--thresholds" || arg == "--bit-timeouts") {
+            if (!parseRange(argv[i + 1], arg == "--thresholds" ? thresholds : bitTimeouts)) {
+                fprintf(stderr, "%s: expected from:to[:step] or a single value\n", argv[i]);
+                return 1;
+            }
+        } else if (arg == "--kernel") {
+            int k = DECODE_SCALAR;
+            while (k < DECODE_KERNELS && strcmp(decodeKernelName((DecodeKernel)k), argv[i + 1]) != 0) {
+                k++;
+            }
+            if (k == DECODE_KERNELS || !decodeKernelSupported((DecodeKernel)k)) {
+                fprintf(stderr, "Kernel %s not available on this CPU\n", argv[i + 1]);
+                return 1;
+            }
+            kernel = (DecodeKernel)k;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (command == "info") {
+        return info(path);
+    } else if (command == "synth" && argc > 3) {
+        return synth(path, strtoull(argv[3], nullptr, 10), jitter, failRate, seed);
+    } else if (command == "replay") {
+        return replay(path, thresholds, bitTimeouts, kernel);
+    } else if (command == "verify") {
+        return verify(path, thresholds, bitTimeouts);
+    }
+    fprintf(stderr, usage, argv[0]);
+    return 1;
+}
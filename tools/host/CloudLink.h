@@ -0,0 +1,110 @@
+/*
+ * CloudLink - Emulated device-to-cloud link for host builds
+ *
+ * Sits behind tools/host/Particle.h: every publish sees the link latency,
+ * random loss, the cloud rate limit, scheduled outages and the event data
+ * limit, and every publish the cloud accepts is handed to the receiver as
+ * the cloud would see it. Time is virtual; publish() advances it by the
+ * round trip, as Device OS waits for the cloud's acknowledgement.
+ */
+
+#ifndef CLOUD_LINK_H
+#define CLOUD_LINK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <vector>
+
+struct CloudLinkConfig {
+    uint32_t latencyMs = 150;   // One way, device to cloud
+    uint32_t jitterMs = 100;    // Uniform extra one-way latency
+    float loss = 0.0f;          // Fraction of publishes lost on the way (never acknowledged)
+    float rate = 1.0f;          // Cloud rate limit, events per second...
+    float burst = 4.0f;         // ...after a burst of up to this many
+    size_t maxData = 622;       // Event data limit (bytes)
+};
+
+struct CloudOutage {
+    uint32_t startMs;
+    uint32_t endMs;
+};
+
+class CloudLink {
+public:
+    CloudLinkConfig config;
+    std::vector<CloudOutage> outages;
+    std::function<void(const char* name, const char* data, uint32_t arrivalMs)> receiver;
+    std::function<void(uint32_t startMs, uint32_t busyMs)> transmitted;  // Radio time, for energy models
+    uint32_t now = 0;           // Virtual millis()
+
+    // Publish outcomes; accepted publishes are the data operations used
+    uint32_t accepted = 0;
+    uint32_t lost = 0;
+    uint32_t rateLimited = 0;
+    uint32_t oversize = 0;
+    uint32_t offline = 0;
+
+    static CloudLink& instance() {
+        static CloudLink link;
+        return link;
+    }
+
+    void seed(uint32_t value) { _rng.seed(value); }
+
+    bool connected() const {
+        for (const CloudOutage& outage : outages) {
+            if (now >= outage.startMs && now < outage.endMs) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool publish(const char* name, const char* data) {
+        if (!connected()) {
+            offline++;
+            return false;
+        }
+        if (strlen(data) > config.maxData) {
+            oversize++;
+            return false;
+        }
+
+        uint32_t oneWay = config.latencyMs + (config.jitterMs ? _rng() % (config.jitterMs + 1) : 0);
+        uint32_t sent = now;
+        now += 2 * oneWay;
+        if (transmitted) {
+            transmitted(sent, 2 * oneWay);
+        }
+        if (_uniform(_rng) < config.loss) {
+            lost++;
+            return false;
+        }
+
+        // Token bucket, refilled at the configured rate up to the burst size
+        _tokens = std::min(config.burst, _tokens + (sent - _refilled) * config.rate / 1000.0f);
+        _refilled = sent;
+        if (_tokens < 1.0f) {
+            rateLimited++;
+            return false;
+        }
+        _tokens -= 1.0f;
+
+        accepted++;
+        if (receiver) {
+            receiver(name, data, sent + oneWay);
+        }
+        return true;
+    }
+
+private:
+    std::mt19937 _rng{1};
+    std::uniform_real_distribution<float> _uniform{0.0f, 1.0f};
+    float _tokens = 4.0f;
+    uint32_t _refilled = 0;
+};
+
+#endif // CLOUD_LINK_H
@@ -0,0 +1,94 @@
+/*
+ * EnergyModel - Charge accounting for host simulations
+ *
+ * Every activity is charged as current x time to a category, so a simulated
+ * run can be reported as mAh per day and broken down by what drew it.
+ * Currents are Boron ballpark figures (nRF52840 plus LTE-M modem, DHT22);
+ * calibrate them with a power analyser before trusting absolute numbers.
+ * Comparisons between configurations hold either way.
+ */
+
+#ifndef ENERGY_MODEL_H
+#define ENERGY_MODEL_H
+
+#include <stdint.h>
+#include <algorithm>
+
+enum EnergyCategory : uint8_t {
+    ENERGY_CPU_BUSY,     // Bit-bang frames (interrupts off), busy-wait delays, sample processing
+    ENERGY_CPU_IDLE,     // Awake in loop() or waiting for a publish acknowledgement
+    ENERGY_SLEEP,        // STOP/ULP sleep between samples
+    ENERGY_RADIO_IDLE,   // Modem attached, nothing to send
+    ENERGY_RADIO_TX,     // Modem active for a publish, including its inactivity tail
+    ENERGY_SENSOR,       // DHT22 supply
+    ENERGY_CATEGORIES
+};
+
+struct EnergyCurrents {
+    float cpuBusyMa = 6.0f;         // 64 MHz, running
+    float cpuIdleMa = 4.0f;         // Awake, Device OS idle between loop() calls
+    float stopMa = 0.6f;            // STOP sleep, RAM and modem standby retained
+    float ulpMa = 0.1f;             // Ultra-low-power sleep
+    float radioIdleMa = 1.5f;       // Modem attached (eDRX/standby average)
+    float radioTxMa = 120.0f;       // Modem active during a publish round trip
+    float radioTailMa = 25.0f;      // Connected mode held after the last publish...
+    uint32_t radioTailMs = 4000;    // ...for this long (network inactivity timer)
+    float sensorStandbyMa = 0.05f;  // DHT22 powered, idle
+    float sensorMeasureMa = 1.5f;   // DHT22 converting, after every read...
+    uint32_t sensorMeasureMs = 2000; // ...for about this long
+};
+
+class EnergyModel {
+public:
+    EnergyCurrents currents;
+
+    static EnergyModel& instance() {
+        static EnergyModel model;
+        return model;
+    }
+
+    void charge(EnergyCategory category, float mA, double ms) {
+        _mAms[category] += mA * ms;
+    }
+
+    // Radio busy for a publish; a tail still running from the previous
+    // publish is cut short by this one
+    void transmit(uint32_t startMs, uint32_t busyMs) {
+        settleTail(startMs);
+        charge(ENERGY_RADIO_TX, currents.radioTxMa, busyMs);
+        _tailStart = startMs + busyMs;
+        _tailEnd = _tailStart + currents.radioTailMs;
+    }
+
+    // Charge whatever tail has elapsed by nowMs (call once at the end of a run)
+    void settleTail(uint32_t nowMs) {
+        uint32_t end = std::min(_tailEnd, nowMs);
+        if (end > _tailStart) {
+            charge(ENERGY_RADIO_TX, currents.radioTailMa, end - _tailStart);
+        }
+        _tailStart = _tailEnd = 0;
+    }
+
+    double mAh(EnergyCategory category) const { return _mAms[category] / 3600000.0; }
+
+    double totalMah() const {
+        double total = 0;
+        for (uint8_t i = 0; i < ENERGY_CATEGORIES; i++) {
+            total += mAh((EnergyCategory)i);
+        }
+        return total;
+    }
+
+    static const char* name(EnergyCategory category) {
+        static const char* const NAMES[ENERGY_CATEGORIES] = {
+            "cpu busy", "cpu idle", "sleep", "radio idle", "radio tx", "sensor"};
+        return NAMES[category];
+    }
+
+private:
+    double _mAms[ENERGY_CATEGORIES] = {};
+    uint32_t _tailStart = 0;
+    uint32_t _tailEnd = 0;
+};
+
+#endif // ENERGY_MODEL_H
@@ -0,0 +1,63 @@
+/*
+ * Host stand-in for the Device OS calls made by the cloud publish path
+ * (src/EventEnvelope.cpp): millis(), Log, Particle.connected() and
+ * Particle.publish(), all backed by the emulated link in CloudLink.h.
+ * Only for host tools; Particle builds use the real header.
+ */
+
+#ifndef PARTICLE_H
+#define PARTICLE_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "CloudLink.h"
+
+enum PublishFlag { PRIVATE, PUBLIC };
+
+inline uint32_t millis() {
+    return CloudLink::instance().now;
+}
+
+struct HostLogger {
+    bool verbose = false;
+
+    void info(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        print("INFO", format, args);
+        va_end(args);
+    }
+
+    void warn(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        print("WARN", format, args);
+        va_end(args);
+    }
+
+private:
+    void print(const char* level, const char* format, va_list args) {
+        if (!verbose) {
+            return;
+        }
+        fprintf(stderr, "%10lu %s ", (unsigned long)millis(), level);
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    }
+};
+
+struct HostCloud {
+    bool connected() { return CloudLink::instance().connected(); }
+
+    bool publish(const char* name, const char* data, PublishFlag) {
+        return CloudLink::instance().publish(name, data);
+    }
+};
+
+inline HostLogger Log;
+inline HostCloud Particle;
+
+#endif // PARTICLE_H
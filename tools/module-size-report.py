@@ -0,0 +1,109 @@
+"""Report the flash and RAM cost of each firmware feature module.
+
+Builds the firmware once with every module enabled and once with each module
+(see src/Features.h) turned off, then prints the size of every image and the
+per-module delta. Flash = text + data, RAM = data + bss, as reported by
+arm-none-eabi-size.
+
+Usage:
+  python tools/module-size-report.py [--platform boron]
+  python tools/module-size-report.py --elf full=a.elf no_doe=b.elf ...
+
+Building needs a local Device OS toolchain (Particle Workbench). The build
+command defaults to the Workbench buildscripts Makefile and can be replaced
+with --build; {app}, {out}, {platform} and {flags} are substituted.
+"""
+import argparse
+import glob
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Image name -> modules disabled
+VARIANTS = {
+    'full': (),
+    'no_publishing': ('FEATURE_PUBLISHING',),
+    'no_doe': ('FEATURE_DOE',),
+    'no_capture': ('FEATURE_CAPTURE',),
+    'no_diagnostics': ('FEATURE_DIAGNOSTICS',),
+    'lean': ('FEATURE_DOE', 'FEATURE_DIAGNOSTICS'),
+}
+
+DEFAULT_BUILD = ('make -f {makefile} compile-user PLATFORM={platform} APPDIR={app} '
+                 'TARGET_DIR={out} EXTRA_CFLAGS="{flags}"')
+
+
+def elf_size(path, size_tool):
+    """Return (text, data, bss) from Berkeley-format size output"""
+    out = subprocess.run([size_tool, path], check=True, capture_output=True, text=True).stdout
+    text, data, bss = (int(v) for v in out.splitlines()[1].split()[:3])
+    return text, data, bss
+
+
+def build(name, disabled, args):
+    out = os.path.join(args.work, name)
+    os.makedirs(out, exist_ok=True)
+    flags = ' '.join(f'-D{m}=0' for m in disabled)
+    cmd = args.build.format(makefile=args.makefile, platform=args.platform, app=ROOT,
+                            out=out, flags=flags)
+    print(f"building {name}: {flags or '(all modules)'}", file=sys.stderr)
+    result = subprocess.run(cmd, shell=True, capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.stderr.write(result.stdout[-2000:] + result.stderr[-2000:])
+        sys.exit(f"build of {name} failed")
+    elfs = glob.glob(os.path.join(out, '**', '*.elf'), recursive=True)
+    if not elfs:
+        sys.exit(f"no .elf produced for {name} in {out}")
+    return max(elfs, key=os.path.getmtime)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Per-module flash/RAM report')
+    parser.add_argument('--platform', default='boron')
+    parser.add_argument('--build', default=DEFAULT_BUILD, help='build command template')
+    parser.add_argument('--makefile', default=os.environ.get('PARTICLE_MAKEFILE', ''),
+                        help='Workbench buildscripts Makefile (or set PARTICLE_MAKEFILE)')
+    parser.add_argument('--size', default='arm-none-eabi-size', help='size tool')
+    parser.add_argument('--work', help='build output directory (default: temporary)')
+    parser.add_argument('--elf', nargs='+', metavar='NAME=PATH',
+                        help='size prebuilt images instead of building (names as in VARIANTS)')
+    args = parser.parse_args()
+
+    if args.elf:
+        images = dict(item.split('=', 1) for item in args.elf)
+    else:
+        if '{makefile}' in args.build and not args.makefile:
+            sys.exit('set PARTICLE_MAKEFILE or pass --makefile/--build')
+        temp = None
+        if not args.work:
+            temp = args.work = tempfile.mkdtemp(prefix='module-size-')
+        images = {name: build(name, disabled, args) for name, disabled in VARIANTS.items()}
+
+    sizes = {name: elf_size(path, args.size) for name, path in images.items()}
+
+    print(f"{'image':<16}{'flash':>10}{'ram':>10}{'text':>10}{'data':>8}{'bss':>8}")
+    for name, (text, data, bss) in sizes.items():
+        print(f"{name:<16}{text + data:>10}{data + bss:>10}{text:>10}{data:>8}{bss:>8}")
+
+    if 'full' in sizes:
+        text, data, bss = sizes['full']
+        print(f"\n{'module':<22}{'flash':>10}{'ram':>10}")
+        for name, disabled in VARIANTS.items():
+            if name == 'full' or name not in sizes or len(disabled) != 1:
+                continue
+            t, d, b = sizes[name]
+            print(f"{disabled[0]:<22}{(text + data) - (t + d):>10}{(data + bss) - (d + b):>10}")
+        if 'lean' in sizes:
+            t, d, b = sizes['lean']
+            print(f"{'lean image saves':<22}{(text + data) - (t + d):>10}{(data + bss) - (d + b):>10}")
+
+    if not args.elf and temp:
+        shutil.rmtree(temp, ignore_errors=True)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,138 @@
+/*
+ * pipeline-bench - Host benchmark of the sample pipeline stages
+ *
+ * Times every stage of src/SamplePipeline.h on its own and two composed
+ * pipelines (the firmware's default and one with every optional stage),
+ * using a synthetic sensor in place of the DHT22.
+ *
+ * Build and run:
+ *   g++ -O2 -std=c++17 -I src tools/pipeline-bench.cpp -o pipeline-bench
+ *   ./pipeline-bench [samples]
+ *
+ * Host timings show relative stage cost only; the Boron's Cortex-M4F at
+ * 64 MHz is roughly two orders of magnitude slower per stage.
+ */
+
+#include "SamplePipeline.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Synthetic DHT22: slow drift with noise and an occasional spike
+struct FakeReader {
+    static uint32_t state;
+
+    static bool read(float& temperature, float& humidity) {
+        state = state * 1664525u + 1013904223u;
+        float noise = ((state >> 16) & 0xFF) / 255.0f - 0.5f;
+        temperature = 21.0f + noise * 0.2f + ((state & 0x3FF) == 0 ? 5.0f : 0.0f);
+        humidity = 45.0f + noise;
+        return (state & 0xFF) != 0;  // ~0.4% failed reads
+    }
+
+    static void wait(uint32_t) {}
+};
+uint32_t FakeReader::state = 12345;
+
+// Three synthetic sensors for SensorVote
+struct FakeVoteReader {
+    static bool read(uint8_t sensor, float& temperature, float& humidity) {
+        bool ok = FakeReader::read(temperature, humidity);
+        temperature += sensor * 0.05f;
+        return ok;
+    }
+};
+
+struct NullHook {
+    static void observe(const Sample&) {}
+};
+
+struct NullSink {
+    static volatile float last;
+    static bool emit(const Sample& sample) {
+        last = sample.avgTemperature;
+        return true;
+    }
+};
+volatile float NullSink::last;
+
+// Prepared input so single-stage timings exclude the sensor
+static Sample makeSample(uint32_t i) {
+    Sample sample;
+    sample.time = 1700000000u + i * 10;
+    FakeReader::read(sample.temperature, sample.humidity);
+    sample.avgTemperature = sample.temperature;
+    sample.avgHumidity = sample.humidity;
+    sample.valid = true;
+    return sample;
+}
+
+static volatile float sink;
+
+template <typename Pipeline>
+double bench(const char* name, Pipeline& pipeline, const Sample* input, size_t count) {
+    uint32_t passed = 0;
+    float checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        Sample sample = input[i];
+        passed += pipeline.process(sample);
+        // Consume the outputs so the compiler cannot drop the stage
+        checksum += sample.temperature + sample.avgTemperature + sample.avgHumidity;
+        if (sample.dewPoint == sample.dewPoint) checksum += sample.dewPoint;
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink = checksum;
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / count;
+    printf("%-34s %9.1f ns/sample  %5.1f%% passed\n", name, ns, 100.0 * passed / count);
+    return ns;
+}
+
+// One-stage pipeline timing helper
+template <typename Stage>
+double benchStage(const char* name, const Sample* input, size_t count) {
+    SamplePipeline<Stage> pipeline;
+    return bench(name, pipeline, input, count);
+}
+
+int main(int argc, char** argv) {
+    size_t count = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 1000000;
+    Sample* input = new Sample[count];
+    for (size_t i = 0; i < count; i++) {
+        input[i] = makeSample(i);
+    }
+
+    printf("%zu samples\n\n", count);
+    printf("Single stages\n");
+    benchStage<SamplePipeline<>>("empty pipeline (baseline)", input, count);
+    benchStage<RetryAcquire<FakeReader, 1, 0>>("RetryAcquire (synthetic sensor)", input, count);
+    benchStage<SensorVote<FakeVoteReader, 3>>("SensorVote<3> (synthetic sensors)", input, count);
+    benchStage<RangeCheck>("RangeCheck", input, count);
+    benchStage<JumpCheck<FakeReader, 10, 0>>("JumpCheck", input, count);
+    benchStage<ChangeDetector<15, 10, 5>>("ChangeDetector", input, count);
+    benchStage<MedianFilter<5>>("MedianFilter<5>", input, count);
+    benchStage<EmaSmoothing<30>>("EmaSmoothing<30>", input, count);
+    benchStage<DewPoint>("DewPoint", input, count);
+    benchStage<MovingAverage<30>>("MovingAverage<30> (default 300 s)", input, count);
+    benchStage<MovingAverage<360>>("MovingAverage<360> (3600 s)", input, count);
+    benchStage<PublishGate<50, 3600>>("PublishGate", input, count);
+    benchStage<Deadband<10>>("Deadband<10>", input, count);
+    benchStage<Batch<6>>("Batch<6>", input, count);
+    benchStage<Emit<NullSink>>("Emit", input, count);
+    benchStage<Tap<NullHook>>("Tap", input, count);
+
+    printf("\nComposed pipelines\n");
+    SamplePipeline<RetryAcquire<FakeReader, 1, 0>, JumpCheck<FakeReader, 10, 0>,
+                   ChangeDetector<15, 10, 5>, Tap<NullHook>, MovingAverage<30>, Tap<NullHook>,
+                   PublishGate<50, 3600>, Emit<NullSink>> firmware;
+    bench("firmware default", firmware, input, count);
+
+    SamplePipeline<RetryAcquire<FakeReader, 1, 0>, RangeCheck, JumpCheck<FakeReader, 10, 0>,
+                   ChangeDetector<15, 10, 5>, MedianFilter<5>, EmaSmoothing<30>, DewPoint, MovingAverage<30>,
+                   PublishGate<50, 3600>, Deadband<10>, Batch<6>, Emit<NullSink>> everything;
+    bench("every optional stage", everything, input, count);
+
+    delete[] input;
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * sensor-recovery-sim - Host simulation and checks of the hung-sensor recovery
+ *
+ * Drives src/SensorRecovery.h the way loop() does (update() every 100 ms,
+ * a measurement every 10 s while reads are allowed) against a simulated
+ * DHT22 that latches up and comes back only after its supply is cycled.
+ * Checks the recovery path through POWER_OFF, SETTLING and RECOVERING, a
+ * failed recovery backing off for another full failure streak, and the
+ * streak resetting on a good read. Exits non-zero if any check fails.
+ *
+ * Build and run:
+ *   g++ -O2 -std=c++17 -I src tools/sensor-recovery-sim.cpp -o sensor-recovery-sim
+ *   ./sensor-recovery-sim
+ */
+
+#include "SensorRecovery.h"
+
+#include <cstdio>
+#include <vector>
+
+// Firmware settings (RemoteTempHumidityMonitor.ino)
+#define RECOVERY_FAIL_THRESHOLD 5
+#define DHT_POWER_OFF_MS 2000
+#define DHT_POWER_SETTLE_MS 2000
+#define MEASUREMENT_INTERVAL 10000
+#define LOOP_MS 100
+
+// DHT22 that fails while latched; a power cycle clears the latch-up unless
+// the sensor is dead for the next `deadCycles` cycles
+struct SimSensor {
+    bool latched = false;
+    bool powered = true;
+    int deadCycles = 0;
+
+    bool read() const { return powered && !latched; }
+
+    void powerOff() { powered = false; }
+
+    void powerOn() {
+        powered = true;
+        if (deadCycles > 0) {
+            deadCycles--;
+        } else {
+            latched = false;
+        }
+    }
+};
+
+struct Sim {
+    SensorRecovery recovery{RECOVERY_FAIL_THRESHOLD, DHT_POWER_OFF_MS, DHT_POWER_SETTLE_MS};
+    SimSensor sensor;
+    uint32_t now = 0;
+    uint32_t lastMeasurement = 0;
+    std::vector<SensorRecovery::State> states;  // Every state entered, in order
+    int reads = 0;
+
+    void note() {
+        if (states.empty() || states.back() != recovery.getState()) {
+            states.push_back(recovery.getState());
+        }
+    }
+
+    // Run loop() passes for ms of simulated time
+    void run(uint32_t ms) {
+        for (uint32_t end = now + ms; now < end; now += LOOP_MS) {
+            switch (recovery.update(now)) {
+                case SensorRecovery::ACTION_POWER_OFF:
+                    sensor.powerOff();
+                    break;
+                case SensorRecovery::ACTION_POWER_ON:
+                    sensor.powerOn();
+                    break;
+                default:
+                    break;
+            }
+            note();
+            if (recovery.readAllowed() && now - lastMeasurement >= MEASUREMENT_INTERVAL) {
+                recovery.onReadResult(sensor.read(), now);
+                lastMeasurement = now;
+                reads++;
+                note();
+            }
+        }
+    }
+
+    // Run until the next measurement has been taken
+    void measure() {
+        int before = reads;
+        while (reads == before) {
+            run(LOOP_MS);
+        }
+    }
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) {
+        failures++;
+    }
+}
+
+static bool visited(const Sim& sim, std::vector<SensorRecovery::State> expected) {
+    size_t i = 0;
+    for (SensorRecovery::State state : sim.states) {
+        if (i < expected.size() && state == expected[i]) {
+            i++;
+        }
+    }
+    return i == expected.size();
+}
+
+static void recoversAfterPowerCycle() {
+    printf("Latch-up cleared by one power cycle\n");
+    Sim sim;
+    sim.run(30000);
+    sim.sensor.latched = true;
+    uint32_t firstFailure = 0;
+    for (int i = 0; i < RECOVERY_FAIL_THRESHOLD; i++) {
+        sim.measure();
+        if (i == 0) {
+            firstFailure = sim.now;
+        }
+    }
+    check(sim.recovery.getState() == SensorRecovery::POWER_OFF, "power off after the failure streak");
+    sim.run(LOOP_MS);
+    check(!sim.sensor.powered && !sim.recovery.readAllowed(), "supply cut, no reads while off");
+    sim.run(DHT_POWER_OFF_MS);
+    check(sim.sensor.powered && sim.recovery.getState() == SensorRecovery::SETTLING, "supply restored, settling");
+    sim.measure();
+    uint32_t recoveredAt = sim.now;
+
+    check(visited(sim, {SensorRecovery::HEALTHY, SensorRecovery::FAILING, SensorRecovery::POWER_OFF,
+                        SensorRecovery::SETTLING, SensorRecovery::RECOVERING, SensorRecovery::HEALTHY}),
+          "HEALTHY > FAILING > POWER_OFF > SETTLING > RECOVERING > HEALTHY");
+    check(sim.recovery.getPowerCycles() == 1 && sim.recovery.getRecoveries() == 1, "one power cycle, one recovery");
+    check(sim.recovery.getLastRecoveryMs() == recoveredAt - firstFailure,
+          "recovery time = first failure to first good read");
+    printf("  recovery time %lu ms\n", (unsigned long)sim.recovery.getLastRecoveryMs());
+}
+
+static void failedRecoveryBacksOff() {
+    printf("Sensor still hung after the first power cycle\n");
+    Sim sim;
+    sim.run(30000);
+    sim.sensor.latched = true;
+    sim.sensor.deadCycles = 1;
+    for (int i = 0; i < RECOVERY_FAIL_THRESHOLD; i++) {
+        sim.measure();
+    }
+    sim.run(DHT_POWER_OFF_MS + DHT_POWER_SETTLE_MS + LOOP_MS);
+    check(sim.recovery.getState() == SensorRecovery::RECOVERING, "reads allowed again after settling");
+
+    // The first read after the cycle fails; no new cycle until a full streak
+    for (int i = 0; i < RECOVERY_FAIL_THRESHOLD - 1; i++) {
+        sim.measure();
+    }
+    check(sim.recovery.getState() == SensorRecovery::RECOVERING && sim.recovery.getPowerCycles() == 1,
+          "no second cycle before another full streak");
+    sim.measure();
+    check(sim.recovery.getState() == SensorRecovery::POWER_OFF && sim.recovery.getPowerCycles() == 2,
+          "second cycle after the next streak");
+    check(sim.recovery.getRecoveries() == 0, "failed recovery not counted");
+
+    sim.run(DHT_POWER_OFF_MS + LOOP_MS);
+    sim.measure();
+    check(sim.recovery.getState() == SensorRecovery::HEALTHY && sim.recovery.getRecoveries() == 1,
+          "recovered by the second cycle");
+}
+
+static void streakResetsOnSuccess() {
+    printf("Intermittent failures below the threshold\n");
+    Sim sim;
+    sim.run(30000);
+    sim.sensor.latched = true;
+    for (int i = 0; i < RECOVERY_FAIL_THRESHOLD - 1; i++) {
+        sim.measure();
+    }
+    check(sim.recovery.getState() == SensorRecovery::FAILING &&
+          sim.recovery.getConsecutiveFailures() == RECOVERY_FAIL_THRESHOLD - 1, "failing, one short of the threshold");
+    sim.sensor.latched = false;
+    sim.measure();
+    check(sim.recovery.getState() == SensorRecovery::HEALTHY && sim.recovery.getConsecutiveFailures() == 0,
+          "good read resets the streak");
+
+    sim.sensor.latched = true;
+    for (int i = 0; i < RECOVERY_FAIL_THRESHOLD - 1; i++) {
+        sim.measure();
+    }
+    check(sim.recovery.getPowerCycles() == 0 && sim.sensor.powered, "no power cycle for two short streaks");
+    check(sim.recovery.getRecoveries() == 0, "no recovery counted without a power cycle");
+}
+
+int main() {
+    recoversAfterPowerCycle();
+    failedRecoveryBacksOff();
+    streakResetsOnSuccess();
+    printf("\n%s\n", failures ? "FAILED" : "All checks passed");
+    return failures ? 1 : 0;
+}